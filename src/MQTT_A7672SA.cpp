@@ -49,6 +49,7 @@ A7672SA::A7672SA(gpio_num_t tx_pin, gpio_num_t rx_pin, gpio_num_t en_pin, int32_
     this->rx_pin = rx_pin;
     this->en_pin = en_pin;
     this->rx_buffer_size = rx_buffer_size < 128 ? 128 : rx_buffer_size;
+    this->baud_rate_ = baud_rate;
 
     const uart_config_t uart_config =
         {
@@ -78,9 +79,16 @@ bool A7672SA::begin()
     ESP_LOGV("BEGIN", "Enable Pin: %d", this->en_pin);
 
     gpio_set_level(this->en_pin, 1); //++ Restarting Simcomm via ENABLE pin
-    vTaskDelay(2000 / portTICK_PERIOD_MS);
+    vTaskDelay(BOOT_POWER_OFF_MS / portTICK_PERIOD_MS);
     gpio_set_level(this->en_pin, 0);
-    vTaskDelay(5000 / portTICK_PERIOD_MS);
+
+    // Sem espera fixa após liberar o EN: a tx_task sonda o modem e segue assim que ele responde
+    this->boot_ = {};
+    this->boot_.power_off_ms = BOOT_POWER_OFF_MS;
+    this->csock_cid_ = 0;
+    this->identity_invalidate_();
+    this->boot_start_ = millis();
+    this->boot_tracking_ = true;
 
     // Prepare response buffer early to avoid races
     if (this->at_response == NULL)
@@ -95,6 +103,13 @@ bool A7672SA::begin()
 
     this->rx_guard = xSemaphoreCreateMutex();               //++ Create FreeRtos Semaphore
     this->publish_guard = xSemaphoreCreateRecursiveMutex(); //++ Recursive Mutex for publish (reentrancy-safe)
+    this->inflight_guard = xSemaphoreCreateMutex();         //++ Protege a tabela de mensagens em voo (RX task x chamador)
+    this->seq_guard_ = xSemaphoreCreateRecursiveMutex();    //++ Sequências de vários comandos (HTTP, FSWRITE, CONNECT...)
+
+    if (this->conn_events_ == NULL) // mantido entre stop()/begin() para não invalidar tasks esperando nele
+        this->conn_events_ = xEventGroupCreate();
+    if (this->conn_since_ == 0)
+        this->conn_since_ = millis();
 
     uartQueue = xQueueCreate(UART_QUEUE_SIZE, sizeof(commandMessage));
 
@@ -126,8 +141,21 @@ bool A7672SA::stop()
         this->mqtt_disconnect();
     }
 
+    this->radio_sampler_stop();
+    this->operator_scan_cancel();
     DEINIT_UART();
 
+    // Modem desligado: zera todas as evidências de conectividade
+    this->at_ready = false;
+    this->sim_ready_ = false;
+    this->mqtt_connected = false;
+    this->cs_reg_stat_ = UNKNOWN;
+    this->ps_reg_stat_ = UNKNOWN;
+    this->eps_reg_stat_ = UNKNOWN;
+    for (int i = 0; i <= PDN_MAX_CID; i++)
+        this->pdn_active[i] = false;
+    this->conn_update_();
+
     if (this->at_response != NULL)
     {
         free(this->at_response);
@@ -150,6 +178,28 @@ bool A7672SA::stop()
         vSemaphoreDelete(this->publish_guard);
         this->publish_guard = NULL;
     }
+    if (this->seq_guard_)
+    {
+        vSemaphoreDelete(this->seq_guard_);
+        this->seq_guard_ = NULL;
+    }
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        if (this->inflight_[i].state != INFLIGHT_FREE)
+            this->inflight_release_(i, false);
+    }
+    this->ack_head_ = 0;
+    this->ack_count_ = 0;
+    for (int i = 0; i < MQTT_MAX_TOPIC_HANDLES; i++)
+    {
+        free(this->topic_handles_[i].prefix);
+        this->topic_handles_[i].prefix = NULL;
+    }
+    if (this->inflight_guard)
+    {
+        vSemaphoreDelete(this->inflight_guard);
+        this->inflight_guard = NULL;
+    }
 
     // Put modem in disabled state via EN pin (if configured)
     gpio_set_level(this->en_pin, 1);
@@ -215,38 +265,32 @@ void A7672SA::tx_task()
     static const char *TX_TASK_TAG = "SIM_TX_TASK";
     esp_log_level_set(TX_TASK_TAG, ESP_LOG_INFO);
 
-    while (this->at_ready == false)
+    if (!this->boot_wait_ready_())
     {
-        if (!uart_is_driver_installed(UART_NUM_1))
-            vTaskDelete(NULL);
-        send_cmd_to_simcomm("AT_READY", "AT+CFUN=1" GSM_NL);
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
-        send_cmd_to_simcomm("AT_READY", "AT+CFUN?" GSM_NL);
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
+        ESP_LOGV(TX_TASK_TAG, "UART driver removed during boot, exiting TX task");
+        vTaskDelete(NULL);
+        return;
     }
 
     if (silent_mode == false)
     {
-        send_cmd_to_simcomm("AT_ATE0", "ATE0" GSM_NL);
-        vTaskDelay(500 / portTICK_PERIOD_MS);
+        // Cada comando segue assim que o anterior é confirmado
+        this->boot_cmd_("AT_ATE0", "ATE0" GSM_NL);
 
         // send_cmd_to_simcomm("AT+CSCS", "AT+CSCS?" GSM_NL); // this is for SMS character set only
-        // vTaskDelay(500 / portTICK_PERIOD_MS);
         // send_cmd_to_simcomm("AT+CSCS=HEX", "AT+CSCS=\"HEX\"" GSM_NL); // IRA, UCS2, GSM, HEX
-        vTaskDelay(500 / portTICK_PERIOD_MS);
 
-        send_cmd_to_simcomm("CMEE", "AT+CMEE=2" GSM_NL); // verbose errors
-        vTaskDelay(500 / portTICK_PERIOD_MS);
-        send_cmd_to_simcomm("CREG=1", "AT+CREG=1" GSM_NL); // URC de registro 2G
-        vTaskDelay(500 / portTICK_PERIOD_MS);
-        send_cmd_to_simcomm("CGREG=1", "AT+CGREG=1" GSM_NL); // URC de registro PS
-        vTaskDelay(500 / portTICK_PERIOD_MS);
-        send_cmd_to_simcomm("CEREG=1", "AT+CEREG=1" GSM_NL); // URC de registro LTE
-        vTaskDelay(500 / portTICK_PERIOD_MS);
+        this->boot_cmd_("CMEE", "AT+CMEE=2" GSM_NL);     // verbose errors
+        this->boot_cmd_("CREG=1", "AT+CREG=1" GSM_NL);   // URC de registro 2G
+        this->boot_cmd_("CGREG=1", "AT+CGREG=1" GSM_NL); // URC de registro PS
+        this->boot_cmd_("CEREG=1", "AT+CEREG=1" GSM_NL); // URC de registro LTE
 
         // send_cmd_to_simcomm("AT+SIMCOMATI", "AT+SIMCOMATI" GSM_NL); // info do módulo
-        // vTaskDelay(500 / portTICK_PERIOD_MS);
     }
+    this->boot_mark_(this->boot_.init_done);
+    ESP_LOGI("BOOT", "RDY %u ms, AT %u ms (%u probes), CFUN %u ms, SIM %u ms, init %u ms",
+             this->boot_.rdy, this->boot_.at_ok, this->boot_.at_probes, this->boot_.cfun,
+             this->boot_.sim_ready, this->boot_.init_done);
 
     // send_cmd_to_simcomm("AT_ATV1", "ATV1" GSM_NL); // error roport
     // vTaskDelay(500 / portTICK_PERIOD_MS);
@@ -270,6 +314,91 @@ void A7672SA::tx_task()
     }
 }
 
+// Envia direto pela UART (a tx_task ainda não drena a fila) e espera o OK/ERROR
+bool A7672SA::boot_cmd_(const char *name, const char *cmd, uint32_t timeout)
+{
+    this->at_ok = false;
+    this->at_error = false;
+    if (send_cmd_to_simcomm(name, cmd) <= 0)
+    {
+        vTaskDelay(timeout / portTICK_PERIOD_MS);
+        return false;
+    }
+    this->wait_for_condition(timeout, [this]()
+                             { return this->at_ok || this->at_error; }, name);
+    bool ok = this->at_ok;
+    this->at_ok = false;
+    return ok;
+}
+
+// Espera o modem ficar pronto guiado pelo próprio modem: sonda "AT" a cada BOOT_AT_PROBE_MS até
+// a primeira resposta e só pede AT+CFUN=1 se o AT+CFUN? não vier com 1. Retorna false se a UART
+// foi removida (stop()) no meio da espera.
+bool A7672SA::boot_wait_ready_()
+{
+    if (this->at_ready) // REINIT_UART com o modem já de pé
+        return true;
+
+    uint32_t start = millis();
+    while (millis() - start < BOOT_READY_TIMEOUT_MS)
+    {
+        if (!uart_is_driver_installed(UART_NUM_1))
+            return false;
+        this->boot_.at_probes++;
+        if (this->boot_cmd_("AT_PROBE", "AT" GSM_NL, BOOT_AT_PROBE_MS))
+        {
+            this->boot_mark_(this->boot_.at_ok);
+            break;
+        }
+    }
+    if (this->boot_.at_ok == 0)
+        ESP_LOGW("BOOT", "No answer to AT after %d ms, forcing CFUN=1", BOOT_READY_TIMEOUT_MS);
+
+    while (this->at_ready == false)
+    {
+        if (!uart_is_driver_installed(UART_NUM_1))
+            return false;
+        this->boot_cmd_("AT_READY", "AT+CFUN?" GSM_NL);
+        if (this->at_ready)
+            break;
+        if (!this->boot_cmd_("AT_READY", "AT+CFUN=1" GSM_NL, BOOT_CFUN_TIMEOUT_MS))
+            vTaskDelay(BOOT_AT_PROBE_MS / portTICK_PERIOD_MS);
+    }
+    this->conn_update_();
+    return true;
+}
+
+void A7672SA::boot_mark_(uint32_t &milestone)
+{
+    if (milestone == 0)
+    {
+        uint32_t elapsed = millis() - this->boot_start_;
+        milestone = elapsed ? elapsed : 1;
+    }
+}
+
+// Marcos de boot chegam como linhas soltas e às vezes no mesmo bloco de outro URC,
+// por isso são procurados antes da tabela de handlers (que para no primeiro padrão)
+void A7672SA::boot_scan_(const char *data)
+{
+    if (strstr(data, GSM_NL "RDY" GSM_NL) || strstr(data, "ATREADY: 1"))
+        this->boot_mark_(this->boot_.rdy);
+    if (strstr(data, "CFUN: 1"))
+        this->boot_mark_(this->boot_.cfun);
+    if (strstr(data, "CPIN: READY")) // o estado do SIM fica com o handler do CPIN
+        this->boot_mark_(this->boot_.sim_ready);
+    if (strstr(data, "SMS DONE"))
+        this->boot_mark_(this->boot_.sms_done);
+    if (strstr(data, "PB DONE"))
+    {
+        this->boot_mark_(this->boot_.pb_done);
+        ESP_LOGI("BOOT", "SMS DONE %u ms, PB DONE %u ms", this->boot_.sms_done, this->boot_.pb_done);
+    }
+    // PB DONE é o último marco; sem SIM ele nunca chega, então a busca para após um minuto
+    if (this->boot_.pb_done || millis() - this->boot_start_ > 60000)
+        this->boot_tracking_ = false;
+}
+
 void A7672SA::rx_taskImpl(void *pvParameters)
 {
     static_cast<A7672SA *>(pvParameters)->rx_task();
@@ -312,20 +441,13 @@ void A7672SA::rx_task() //++ UART Receive Task
 #ifdef DEBUG_LTE
             ESP_LOGV(RX_TASK_TAG, "Read %d bytes, content: '%s'", rxBytes, this->at_response);
 #endif
-            int n_messages = 0;
-            char **messages = this->simcom_split_messages(this->at_response, &n_messages);
-            for (int i = 0; i < n_messages; i++)
-            {
-#ifdef DEBUG_LTE
-                ESP_LOGI(RX_TASK_TAG, "Message %d: '%s'", i, messages[i]);
-#endif
-                this->simcomm_response_parser(messages[i]);
-                free(messages[i]);
-            }
-            free(messages);
+            this->simcomm_dispatch(this->at_response);
         }
         if (this->rx_guard)
             xSemaphoreGive(this->rx_guard);
+        // Promove o keepalive assim que a sessão completa dois ciclos, mesmo sem publicações
+        if (this->mqtt_connected)
+            this->keepalive_check_proven_();
         vTaskDelay(10 / portTICK_PERIOD_MS);
     }
     // Buffer liberado por stop() após tasks serem encerradas
@@ -394,6 +516,41 @@ void A7672SA::PUBLISH_UNLOCK()
     this->publishing = false;
 }
 
+bool A7672SA::SEQ_LOCK(uint32_t timeout)
+{
+    if (this->seq_guard_ == NULL)
+        return true;
+    TaskHandle_t cur = xTaskGetCurrentTaskHandle();
+    TickType_t ticks = (timeout == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout);
+    if (cur == rxTaskHandle || cur == txTaskHandle)
+        ticks = 0;
+    return xSemaphoreTakeRecursive(this->seq_guard_, ticks) == pdPASS;
+}
+
+void A7672SA::SEQ_UNLOCK()
+{
+    if (this->seq_guard_ != NULL)
+        xSemaphoreGiveRecursive(this->seq_guard_);
+}
+
+// Segura o SEQ_LOCK até o fim do escopo (as sequências têm muitos retornos antecipados). Só as chamadas da
+// aplicação abrem um seq_scope, então ele também encerra uma busca de operadoras em curso
+struct seq_scope
+{
+    A7672SA &modem;
+    bool held;
+    explicit seq_scope(A7672SA &m) : modem(m), held(false)
+    {
+        m.operator_scan_cancel();
+        held = m.SEQ_LOCK();
+    }
+    ~seq_scope()
+    {
+        if (held)
+            modem.SEQ_UNLOCK();
+    }
+};
+
 void A7672SA::DEINIT_UART()
 {
     this->RX_LOCK();
@@ -423,10 +580,11 @@ void A7672SA::REINIT_UART(uint32_t resize, bool at_ready)
 {
     this->at_ready = at_ready;
     this->rx_buffer_size = resize;
+    this->conn_update_();
 
     const uart_config_t uart_config =
         {
-            .baud_rate = 115200,
+            .baud_rate = this->baud_rate_,
             .data_bits = UART_DATA_8_BITS,
             .parity = UART_PARITY_DISABLE,
             .stop_bits = UART_STOP_BITS_1,
@@ -465,6 +623,22 @@ void A7672SA::REINIT_UART(uint32_t resize, bool at_ready)
     this->RX_UNLOCK();
 }
 
+void A7672SA::simcomm_dispatch(const char *data)
+{
+    // Um mesmo bloco pode trazer várias respostas/URCs (ex.: vários +CMQTTPUB com publicações em pipeline)
+    int n_messages = 0;
+    char **messages = this->simcom_split_messages(data, &n_messages);
+    for (int i = 0; i < n_messages; i++)
+    {
+#ifdef DEBUG_LTE
+        ESP_LOGI("DISPATCH", "Message %d: '%s'", i, messages[i]);
+#endif
+        this->simcomm_response_parser(messages[i]);
+        free(messages[i]);
+    }
+    free(messages);
+}
+
 char **A7672SA::simcom_split_messages(const char *data, int *n_messages)
 {
     char **messages = NULL;
@@ -530,10 +704,67 @@ static int parse_cid_from_cgev(const char *p)
     return cid;
 }
 
+// Copia um campo do AT até a próxima vírgula fora de aspas (ou até end), sem as aspas;
+// retorna o início do campo seguinte. Não aloca: usado nos parsers de CSPN/CGPADDR/COPS.
+static const char *copy_at_field(const char *src, char *dst, size_t size, const char *end = nullptr)
+{
+    size_t n = 0;
+    bool quoted = false;
+    while (*src && src != end && (quoted || *src != ','))
+    {
+        if (*src == '"')
+            quoted = !quoted;
+        else if (n + 1 < size)
+            dst[n++] = *src;
+        src++;
+    }
+    dst[n] = 0;
+    return (*src == ',' && src != end) ? src + 1 : src;
+}
+
+// +COPS: (2,"VIVO","VIVO","72406",7),(1,"TIM BRASIL","TIM","72402",7),,(0,1,2,3,4),(0,1,2)
+// Percorre os grupos (...) até o ",," que separa as operadoras das listas de modos/formatos.
+static size_t parse_cops_list(const char *p, NetworkOperator *out, size_t max, bool *truncated)
+{
+    size_t n = 0;
+    *truncated = false;
+    while ((p = strchr(p, '(')) != nullptr)
+    {
+        const char *end = strchr(p, ')');
+        if (end == nullptr)
+            break;
+
+        NetworkOperator op = {};
+        char field[8];
+        const char *q = copy_at_field(p + 1, field, sizeof(field), end);
+        op.status = atoi(field);
+        q = copy_at_field(q, op.long_name, sizeof(op.long_name), end);
+        q = copy_at_field(q, op.short_name, sizeof(op.short_name), end);
+        q = copy_at_field(q, op.numeric_code, sizeof(op.numeric_code), end);
+        copy_at_field(q, field, sizeof(field), end);
+        op.access_tech = atoi(field);
+
+        if (op.numeric_code[0] != '\0')
+        {
+            if (n < max)
+                out[n++] = op;
+            else
+                *truncated = true;
+        }
+        p = end + 1;
+        if (p[0] == ',' && p[1] == ',')
+            break;
+    }
+    return n;
+}
+
 using ResponseHandler = std::function<void(const char *, const char *)>;
 
 void A7672SA::simcomm_response_parser(const char *data)
 {
+    if (this->boot_tracking_)
+        this->boot_scan_(data);
+
     // Mapa de padrões para funções de callback
     static const std::vector<std::pair<const char *, ResponseHandler>> response_handlers = {
         {"CMQTTCONNECT: 0,0" GSM_NL, [this](const char *data, const char *found)
@@ -557,24 +788,59 @@ void A7672SA::simcomm_response_parser(const char *data)
         {"CPIN: SIM REMOVED" GSM_NL, [this](const char *data, const char *found)
          {
              ESP_LOGV("PARSER", "SIM Removed");
+             this->sim_ready_ = false;
+             this->identity_invalidate_(true);
              this->at_error = true;
              this->at_ok = false;
          }},
+        {"CPIN: READY", [this](const char *data, const char *found)
+         {
+             ESP_LOGV("PARSER", "SIM Ready");
+             // a resposta ao AT+CPIN? de sim_ready() também passa aqui: só uma transição pode ser outro SIM
+             if (!this->sim_ready_)
+                 this->identity_invalidate_(true);
+             this->sim_ready_ = true;
+             if (strstr(found, GSM_OK) != nullptr) // resposta ao AT+CPIN? chega junto com o OK
+                 this->at_ok = true;
+         }},
+        {GSM_NL "RDY" GSM_NL, [this](const char *data, const char *found)
+         {
+             ESP_LOGV("PARSER", "Modem reset");
+             this->sim_ready_ = false;
+             this->identity_invalidate_(true);
+         }},
+        {"ATREADY: 1", [this](const char *data, const char *found)
+         {
+             ESP_LOGV("PARSER", "Modem reset");
+             this->sim_ready_ = false;
+             this->identity_invalidate_(true);
+         }},
         {"CFUN: 1" GSM_NL, [this](const char *data, const char *found)
          {
              ESP_LOGV("PARSER", "CFUN: 1");
              this->at_ready = true;
+             if (strstr(found, GSM_OK) != nullptr) // resposta ao AT+CFUN? chega junto com o OK
+                 this->at_ok = true;
          }},
-        {"CMQTTPUB: 0,0" GSM_NL, [this](const char *data, const char *found)
+        {"CMQTTPUB: 0,", [this](const char *data, const char *found)
          {
-             ESP_LOGV("PARSER", "Publish OK");
-             this->at_publish = true;
-             //  this->publishing = false;
+             int err = -1;
+             sscanf(found, "CMQTTPUB: 0,%d", &err);
+             ESP_LOGV("PARSER", "Publish ACK err=%d", err);
+             this->handle_publish_ack_(err);
          }},
         {"CMQTTSUB: 0,0" GSM_NL, [this](const char *data, const char *found)
          {
              ESP_LOGV("PARSER", "Subscribe OK");
          }},
+        {"CMQTTUNSUB: 0,", [this](const char *data, const char *found)
+         {
+             // +CMQTTUNSUB: 0,<err>: só err 0 veio do UNSUBACK do broker; os demais são falhas locais do modem
+             int err = -1;
+             sscanf(found, "CMQTTUNSUB: 0,%d", &err);
+             ESP_LOGV("PARSER", "Unsubscribe ACK err=%d", err);
+             this->probe_err_ = err < 0 ? 1 : err;
+         }},
         {GSM_NL ">", [this](const char *data, const char *found)
          {
              ESP_LOGV("PARSER", "AT Input");
@@ -585,6 +851,20 @@ void A7672SA::simcomm_response_parser(const char *data)
              ESP_LOGV("PARSER", "AT Input");
              this->at_input = true;
          }},
+        {GSM_NL "CONNECT" GSM_NL, [this](const char *data, const char *found)
+         {
+             ESP_LOGV("PARSER", "AT Input (FSWRITE)");
+             this->at_input = true;
+         }},
+        {"FSOPEN:", [this](const char *data, const char *found)
+         {
+             int fd = -1;
+             sscanf(found, "FSOPEN: %d", &fd);
+             ESP_LOGV("PARSER", "FSOPEN fd=%d", fd);
+             this->fs_opened_fd_ = fd;
+             if (strstr(found, GSM_OK) != nullptr)
+                 this->at_ok = true;
+         }},
         {GSM_ERROR, [this](const char *data, const char *found)
          {
              ESP_LOGV("PARSER", "AT ERROR");
@@ -645,6 +925,8 @@ void A7672SA::simcomm_response_parser(const char *data)
              ESP_LOGV("PARSER", "MQTT Disconnected");
              mqtt_status status = A7672SA_MQTT_DISCONNECTED;
              this->mqtt_connected = false;
+             this->inflight_requeue_(); // acks da sessão antiga não chegarão mais
+             this->keepalive_session_end_(true);
              if (this->on_mqtt_status_ != NULL)
                  this->on_mqtt_status_(status);
              this->mqtt_disconnect();
@@ -661,6 +943,8 @@ void A7672SA::simcomm_response_parser(const char *data)
         {GSM_NL "PB DONE", [this](const char *data, const char *found)
          {
              ESP_LOGV("PARSER", "PB DONE");
+             if (strstr(data, GSM_OK) != nullptr) // o OK de um comando de inicialização pode vir no mesmo bloco
+                 this->at_ok = true;
          }},
         {"HTTPACTION:", [this](const char *data, const char *found)
          {
@@ -676,53 +960,6 @@ void A7672SA::simcomm_response_parser(const char *data)
              ESP_LOGV("PARSER", "METHOD: %d, ERRORCODE: %d, DATALEN: %d", method, this->http_response_data.http_status_code, this->http_response_data.http_content_size);
              this->http_response = true;
          }},
-        {"HTTPHEAD:", [this](const char *data, const char *found)
-         {
-             // Parse header size
-             int hdr = 0;
-             if (sscanf(found, "HTTPHEAD: %d" GSM_NL, &hdr) == 1)
-             {
-                 this->http_response_data.http_header_size = hdr;
-                 ESP_LOGV("PARSER", "HEADLEN: %d", hdr);
-             }
-
-             // Work on a safe copy for searching headers
-             const char *p = found;
-             // Content-Length (case-insensitive)
-             const char *cl = strstr(p, "Content-Length:");
-             if (!cl)
-             {
-                 cl = strstr(p, "content-length:");
-             }
-             if (cl)
-             {
-                 int clen = 0;
-                 if (sscanf(cl, "Content-Length: %d", &clen) == 1 || sscanf(cl, "content-length: %d", &clen) == 1)
-                 {
-                     this->http_response_data.http_content_size = clen;
-                     ESP_LOGV("PARSER", "CONTENT_LENGTH: %d", clen);
-                 }
-             }
-
-             // ETag (case-insensitive)
-             const char *et = strstr(p, "etag:");
-             if (!et)
-             {
-                 et = strstr(p, "ETag:");
-             }
-             if (et)
-             {
-                 // Copy token after etag: "4094025aeef973f79d646563d890ba49"
-                 char tag[sizeof(this->http_response_data.http_etag)] = {0};
-                 if (sscanf(et, "etag: \"%32s\"", tag) == 1 || sscanf(et, "ETag: \"%32s\"", tag) == 1)
-                 {
-                     strncpy(this->http_response_data.http_etag, tag, sizeof(this->http_response_data.http_etag) - 1);
-                     this->http_response_data.http_etag[sizeof(this->http_response_data.http_etag) - 1] = '\0';
-                     ESP_LOGV("PARSER", "ETAG: %s", this->http_response_data.http_etag);
-                 }
-             }
-             this->http_response = true;
-         }},
         {"CPING:", [this](const char *data, const char *found)
          {
              // todo Handle three possible formats
@@ -737,121 +974,56 @@ void A7672SA::simcomm_response_parser(const char *data)
          {
              ESP_LOGV("PARSER", "Recebida resposta do comando COPS");
 
-             this->available_operators.clear();
-
-             String response(found);
-             if (response.indexOf("(") > 0)
+             if (strchr(found, '(') == nullptr)
              {
-                 int start = response.indexOf("(");
-                 int end = response.lastIndexOf(")");
-
-                 if (start > 0 && end > start)
+                 // Operadora atual: +COPS: <mode>,<format>,"<oper>",<AcT>
+                 int mode = 0, format = -1, act = -1;
+                 char oper[sizeof(this->current_operator_.numeric_code)] = {0};
+                 if (sscanf(found, "COPS: %d,%d,\"%7[^\"]\",%d", &mode, &format, oper, &act) >= 3 && format == 2)
                  {
-                     String operatorListStr = response.substring(start, end + 1);
-                     int currentPos = 0;
-                     while (true)
-                     {
-                         int openParen = operatorListStr.indexOf('(', currentPos);
-                         if (openParen == -1)
-                             break;
-
-                         int closeParen = operatorListStr.indexOf(')', openParen);
-                         if (closeParen == -1)
-                             break;
-
-                         String operatorData = operatorListStr.substring(openParen + 1, closeParen);
-                         NetworkOperator op = {0};
-                         int commaPos = 0;
-                         int startPos = 0;
-                         int fieldIndex = 0;
-
-                         while (true)
-                         {
-                             commaPos = operatorData.indexOf(',', startPos);
-                             String fieldValue;
-
-                             if (commaPos == -1)
-                             {
-                                 fieldValue = operatorData.substring(startPos);
-                             }
-                             else
-                             {
-                                 fieldValue = operatorData.substring(startPos, commaPos);
-                                 startPos = commaPos + 1;
-                             }
-
-                             switch (fieldIndex)
-                             {
-                             case 0: // Status
-                                 op.status = fieldValue.toInt();
-                                 break;
-                             case 1: // Nome longo
-                                 if (fieldValue.startsWith("\"") && fieldValue.endsWith("\""))
-                                 {
-                                     fieldValue = fieldValue.substring(1, fieldValue.length() - 1);
-                                 }
-                                 strncpy(op.long_name, fieldValue.c_str(), sizeof(op.long_name) - 1);
-                                 op.long_name[sizeof(op.long_name) - 1] = '\0';
-                                 break;
-                             case 2: // Nome curto
-                                 if (fieldValue.startsWith("\"") && fieldValue.endsWith("\""))
-                                 {
-                                     fieldValue = fieldValue.substring(1, fieldValue.length() - 1);
-                                 }
-                                 strncpy(op.short_name, fieldValue.c_str(), sizeof(op.short_name) - 1);
-                                 op.short_name[sizeof(op.short_name) - 1] = '\0';
-                                 break;
-                             case 3: // Código numérico
-                                 if (fieldValue.startsWith("\"") && fieldValue.endsWith("\""))
-                                 {
-                                     fieldValue = fieldValue.substring(1, fieldValue.length() - 1);
-                                 }
-                                 strncpy(op.numeric_code, fieldValue.c_str(), sizeof(op.numeric_code) - 1);
-                                 op.numeric_code[sizeof(op.numeric_code) - 1] = '\0';
-                                 break;
-                             case 4: // Tecnologia de acesso
-                                 op.access_tech = fieldValue.toInt();
-                                 break;
-                             }
-
-                             fieldIndex++;
-                             if (commaPos == -1 || fieldIndex >= 5)
-                             {
-                                 break;
-                             }
-                         }
-
-                         if (strlen(op.numeric_code) > 0)
-                         {
-                             this->available_operators.push_back(op);
-                             ESP_LOGV("PARSER", "Operadora: %s (%s), Código: %s, Status: %d, Tecnologia: %d",
-                                      op.long_name, op.short_name, op.numeric_code, op.status, op.access_tech);
-                         }
-                         currentPos = closeParen + 1;
-                     }
-
-                     this->operators_list_updated = true;
-                     this->at_ok = true;
-                     ESP_LOGV("PARSER", "Processadas %d operadoras", this->available_operators.size());
+                     strncpy(this->current_operator_.numeric_code, oper, sizeof(this->current_operator_.numeric_code) - 1);
+                     this->current_operator_.access_tech = act;
+                     ESP_LOGV("PARSER", "Operadora atual: %s, AcT: %d", oper, act);
                  }
+                 if (strstr(found, GSM_OK) != nullptr) // resposta ao AT+COPS? chega junto com o OK
+                     this->at_ok = true;
+                 return;
              }
+
+             // Lista do AT+COPS=?: monta fora da seção crítica e publica com uma cópia
+             operator_list list = {};
+             bool truncated = false;
+             list.count = parse_cops_list(found, list.ops, OPERATOR_LIST_MAX, &truncated);
+             list.truncated = truncated;
+             list.serving_act = this->current_operator_.numeric_code[0] ? this->current_operator_.access_tech : -1;
+             list.at_ms = millis();
+             for (int i = 0; i < list.count; i++)
+                 ESP_LOGV("PARSER", "Operadora: %s (%s), Código: %s, Status: %d, Tecnologia: %d",
+                          list.ops[i].long_name, list.ops[i].short_name, list.ops[i].numeric_code, list.ops[i].status, list.ops[i].access_tech);
+
+             portENTER_CRITICAL(&this->operators_lock_);
+             this->operators_ = list;
+             portEXIT_CRITICAL(&this->operators_lock_);
+
+             this->operators_list_updated = true;
+             this->at_ok = true;
+             ESP_LOGV("PARSER", "Processadas %d operadoras%s", list.count, truncated ? " (lista truncada)" : "");
          }}, // --- CGEV: EPS PDN ACT <cid>
         {"CGEV: EPS PDN ACT", [this](const char *data, const char *found)
          {
              int cid = parse_cid_from_cgev(found);
-             if (cid >= 0 && cid < 11)
-                 pdn_active[cid] = true;
+             if (cid >= 0 && cid <= PDN_MAX_CID)
+                 this->pdn_set_(cid, true);
              ESP_LOGV("PARSER", "CGEV: EPS PDN ACT, cid=%d", cid);
          }},
         // --- CGEV: EPS PDN DEACT <cid>
         {"CGEV: EPS PDN DEACT", [this](const char *data, const char *found)
          {
              int cid = parse_cid_from_cgev(found);
-             if (cid >= 0 && cid < 11)
-                 pdn_active[cid] = false;
+             if (cid >= 0 && cid <= PDN_MAX_CID)
+                 this->pdn_set_(cid, false);
              ESP_LOGW("PARSER", "CGEV: EPS PDN DEACT, cid=%d", cid);
-             // Sessões de app caíram
-             if (cid == DEFAULT_CID)
+             if (cid == this->mqtt_cid_) // outros PDNs (ex.: HTTP) não levam a sessão MQTT junto
              {
                  this->mqtt_connected = false;
                  if (this->on_mqtt_status_)
@@ -865,18 +1037,18 @@ void A7672SA::simcomm_response_parser(const char *data)
         {"CGEV: NW PDN ACT", [this](const char *data, const char *found)
          {
              int cid = parse_cid_from_cgev(found);
-             if (cid >= 0 && cid < 11)
-                 pdn_active[cid] = true;
+             if (cid >= 0 && cid <= PDN_MAX_CID)
+                 this->pdn_set_(cid, true);
              ESP_LOGV("PARSER", "CGEV: NW PDN ACT, cid=%d", cid);
          }},
         // --- CGEV: NW PDN DEACT <cid>
         {"CGEV: NW PDN DEACT", [this](const char *data, const char *found)
          {
              int cid = parse_cid_from_cgev(found);
-             if (cid >= 0 && cid < 11)
-                 pdn_active[cid] = false;
+             if (cid >= 0 && cid <= PDN_MAX_CID)
+                 this->pdn_set_(cid, false);
              ESP_LOGW("PARSER", "CGEV: NW PDN DEACT, cid=%d", cid);
-             if (cid == DEFAULT_CID)
+             if (cid == this->mqtt_cid_)
              {
                  this->mqtt_connected = false;
                  if (this->on_mqtt_status_)
@@ -890,8 +1062,8 @@ void A7672SA::simcomm_response_parser(const char *data)
         {"CGEV: ME DEACT", [this](const char *data, const char *found)
          {
              // Conservador: marcar todos CIDs como inativos //todo testar
-             for (int i = 0; i < 11; i++)
-                 pdn_active[i] = false;
+             for (uint8_t i = 0; i <= PDN_MAX_CID; i++)
+                 this->pdn_set_(i, false);
              ESP_LOGW("PARSER", "CGEV: ME DEACT (desativacao local do(s) PDN)");
              this->mqtt_connected = false;
              if (this->on_mqtt_status_)
@@ -903,8 +1075,8 @@ void A7672SA::simcomm_response_parser(const char *data)
         // --- CGEV: ME DETACH
         {"CGEV: ME DETACH", [this](const char *data, const char *found)
          {
-             for (int i = 0; i < 11; i++)
-                 pdn_active[i] = false;
+             for (uint8_t i = 0; i <= PDN_MAX_CID; i++)
+                 this->pdn_set_(i, false);
              ESP_LOGE("PARSER", "CGEV: ME DETACH (module detach)");
              this->mqtt_connected = false;
              if (this->on_mqtt_status_)
@@ -917,17 +1089,17 @@ void A7672SA::simcomm_response_parser(const char *data)
         {"CGEV: ME PDN ACT", [this](const char *data, const char *found)
          {
              int cid = parse_cid_from_cgev(found);
-             if (cid >= 0 && cid < 11)
-                 pdn_active[cid] = true;
+             if (cid >= 0 && cid <= PDN_MAX_CID)
+                 this->pdn_set_(cid, true);
              ESP_LOGV("PARSER", "CGEV: ME PDN ACT, cid=%d", cid);
          }},
         {"CGEV: ME PDN DEACT", [this](const char *data, const char *found)
          {
              int cid = parse_cid_from_cgev(found);
-             if (cid >= 0 && cid < 11)
-                 pdn_active[cid] = false;
+             if (cid >= 0 && cid <= PDN_MAX_CID)
+                 this->pdn_set_(cid, false);
              ESP_LOGW("PARSER", "CGEV: ME PDN DEACT, cid=%d", cid);
-             if (cid == DEFAULT_CID)
+             if (cid == this->mqtt_cid_)
              {
                  this->mqtt_connected = false;
                  if (this->on_mqtt_status_)
@@ -1009,6 +1181,7 @@ void A7672SA::simcomm_response_parser(const char *data)
         if (found != nullptr)
         {
             handler.second(data, found);
+            this->conn_update_();
             return;
         }
     }
@@ -1031,6 +1204,90 @@ void A7672SA::on_ps_lost_()
     // aqui você pode acordar sua task de reconexão para refazer CGATT/CGACT/TCP/MQTT com backoff
 }
 
+connectivity_state A7672SA::conn_level_() const
+{
+    if (this->mqtt_connected)
+        return CONN_MQTT_UP;
+    for (int cid = 1; cid <= PDN_MAX_CID; cid++)
+    {
+        if (this->pdn_active[cid])
+            return CONN_PDN_UP;
+    }
+    if (this->ps_ready())
+        return CONN_REGISTERED;
+    if (this->sim_ready_)
+        return CONN_SIM_READY;
+    if (this->at_ready)
+        return CONN_AT_READY;
+    return CONN_MODEM_OFF;
+}
+
+// Recalcula o nível a partir das flags; chamado após cada URC tratada e nos pontos
+// em que o próprio driver altera mqtt_connected/at_ready fora do parser.
+void A7672SA::conn_update_()
+{
+    connectivity_state to = this->conn_level_();
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&this->conn_lock_);
+    connectivity_state from = this->conn_state_;
+    if (to != from)
+    {
+        this->conn_time_in_state_[from] += now - this->conn_since_;
+        this->conn_entered_[to] = now;
+        this->conn_since_ = now;
+        this->conn_state_ = to;
+        this->conn_transitions_++;
+    }
+    portEXIT_CRITICAL(&this->conn_lock_);
+
+    if (to == from)
+        return;
+
+    if (this->conn_events_)
+    {
+        EventBits_t reached = CONN_BIT(to + 1) - 1;
+        EventBits_t all = CONN_BIT(CONN_STATE_COUNT) - 1;
+        xEventGroupClearBits(this->conn_events_, all & ~reached);
+        xEventGroupSetBits(this->conn_events_, reached);
+    }
+
+    ESP_LOGI("CONNECTIVITY", "%s -> %s", connectivity_name(from), connectivity_name(to));
+    if (this->on_connectivity_change_)
+        this->on_connectivity_change_(from, to, now);
+}
+
+bool A7672SA::wait_for_state(connectivity_state state, uint32_t timeout)
+{
+    if (state >= CONN_STATE_COUNT)
+        return false;
+    if (this->conn_state_ >= state)
+        return true;
+    if (this->conn_events_ == NULL)
+        return false;
+    TickType_t ticks = timeout == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeout);
+    EventBits_t bits = xEventGroupWaitBits(this->conn_events_, CONN_BIT(state), pdFALSE, pdTRUE, ticks);
+    return (bits & CONN_BIT(state)) != 0;
+}
+
+uint32_t A7672SA::time_in_state(connectivity_state state)
+{
+    if (state >= CONN_STATE_COUNT)
+        return 0;
+    portENTER_CRITICAL(&this->conn_lock_);
+    uint32_t total = this->conn_time_in_state_[state];
+    if (this->conn_state_ == state)
+        total += millis() - this->conn_since_;
+    portEXIT_CRITICAL(&this->conn_lock_);
+    return total;
+}
+
+const char *A7672SA::connectivity_name(connectivity_state state)
+{
+    static const char *const names[CONN_STATE_COUNT] = {"MODEM_OFF", "AT_READY", "SIM_READY", "REGISTERED", "PDN_UP", "MQTT_UP"};
+    return state < CONN_STATE_COUNT ? names[state] : "?";
+}
+
 void A7672SA::apply_creg_(registration_status st)
 {
     bool before = cs_ready();
@@ -1058,10 +1315,24 @@ void A7672SA::apply_cereg_(registration_status st)
 
 bool A7672SA::restart(uint32_t timeout)
 {
+    this->operator_scan_cancel();
     this->sendCommand("CFUN=0", "AT+CFUN=0" GSM_NL);
     vTaskDelay(2000 / portTICK_PERIOD_MS);
     this->sendCommand("RESTART", "AT+CRESET" GSM_NL);
-    return this->wait_response(timeout);
+    bool result = this->wait_response(timeout);
+
+    // Após o reset o modem refaz SIM/registro/PDN; os URCs de boot reconstroem o estado
+    this->sim_ready_ = false;
+    this->csock_cid_ = 0;
+    this->identity_invalidate_();
+    this->mqtt_connected = false;
+    this->cs_reg_stat_ = UNKNOWN;
+    this->ps_reg_stat_ = UNKNOWN;
+    this->eps_reg_stat_ = UNKNOWN;
+    for (int i = 0; i <= PDN_MAX_CID; i++)
+        this->pdn_active[i] = false;
+    this->conn_update_();
+    return result;
 }
 
 int A7672SA::send_cmd_to_simcomm(const char *logName, uint8_t *data, int len) //++ Sending AT Commands to Simcomm via UART
@@ -1114,7 +1385,12 @@ bool A7672SA::wait_for_condition(uint32_t timeout, std::function<bool()> conditi
     while (!condition_check() && millis() - start < timeout)
     {
         int rxBytes = 0;
-        if (uart_is_driver_installed(UART_NUM_1) && this->at_response != NULL)
+        // Só lê a UART se ninguém mais (rx_task, leitura de bloco binário) estiver com ela
+        bool acquired = false;
+        TaskHandle_t holder = this->rx_guard ? xSemaphoreGetMutexHolder(this->rx_guard) : NULL;
+        bool may_read = this->rx_guard == NULL || holder == xTaskGetCurrentTaskHandle() ||
+                        (acquired = (xSemaphoreTake(this->rx_guard, 0) == pdPASS));
+        if (may_read && uart_is_driver_installed(UART_NUM_1) && this->at_response != NULL)
         {
             rxBytes = uart_read_bytes(UART_NUM_1, this->at_response, this->rx_buffer_size, 0);
         }
@@ -1123,9 +1399,11 @@ bool A7672SA::wait_for_condition(uint32_t timeout, std::function<bool()> conditi
             if (this->at_response)
             {
                 this->at_response[rxBytes] = 0;
-                this->simcomm_response_parser(this->at_response);
+                this->simcomm_dispatch(this->at_response);
             }
         }
+        if (acquired)
+            xSemaphoreGive(this->rx_guard);
         vTaskDelay(10 / portTICK_PERIOD_MS);
     }
 
@@ -1249,37 +1527,198 @@ bool A7672SA::wait_http_response(uint32_t timeout)
 
 bool A7672SA::test_at(uint32_t timeout)
 {
+    this->operator_scan_cancel();
     this->sendCommand("AT_TEST", "AT" GSM_NL);
-    return this->wait_response(timeout);
+    if (!this->wait_response(timeout))
+        return false;
+    this->at_ready = true;
+    this->conn_update_();
+    return true;
 }
 
 bool A7672SA::sim_ready(uint32_t timeout)
 {
+    this->operator_scan_cancel();
     this->sendCommand("SIM_READY", "AT+CPIN?" GSM_NL);
     return this->wait_response(timeout);
 }
 
 int A7672SA::signal_quality(uint32_t timeout)
 {
-    if (this->publishing)
+    radio_sample sample;
+    if (this->radio_task_ == NULL && !this->publishing)
+    {
+        this->operator_scan_cancel();
+        this->radio_sample_now_(timeout);
+    }
+    if (!this->radio_snapshot(sample))
         return 0;
+    return sample.csq;
+}
 
-    this->sendCommand("SIGNAL_QUALITY", "AT+CSQ" GSM_NL);
-    if (this->wait_response(timeout))
-    {
-        String data_string = "";
-        String signal_quality = "";
+// +CSQ: <rssi>,<ber>
+// +CPSI: LTE,Online,724-05,0x1234,123456789,301,EUTRAN-BAND3,1650,5,5,-98,-1093,-791,11
+// +CPSI: GSM,Online,724-05,0x182d,12401,27 EGSM 900,-64,2110,42-42
+bool A7672SA::radio_sample_now_(uint32_t timeout)
+{
+    radio_sample sample = {};
+    sample.csq = 99;
+    sample.ber = 99;
 
-        for (int j = 0; j < strlen(this->at_response); j++)
+    bool ok = this->query_lines_("AT+CSQ;+CPSI?" GSM_NL, [&sample](const char *line)
+                                 {
+        if (strncmp(line, "+CSQ: ", 6) == 0)
+        {
+            unsigned rssi = 99, ber = 99;
+            sscanf(line + 6, "%u,%u", &rssi, &ber);
+            sample.csq = rssi;
+            sample.ber = ber;
+            return true;
+        }
+        if (strncmp(line, "+CPSI: ", 7) == 0)
         {
-            data_string += this->at_response[j];
+            unsigned mcc = 0, mnc = 0, tac = 0, cell = 0;
+            int rsrq = 0, rsrp = 0, rssi = 0, sinr = 0;
+            int n = sscanf(line + 7, "%11[^,],%*[^,],%u-%u,%x,%u,%*[^,],%*[^,],%*[^,],%*[^,],%*[^,],%d,%d,%d,%d",
+                           sample.system_mode, &mcc, &mnc, &tac, &cell, &rsrq, &rsrp, &rssi, &sinr);
+            sample.mcc = mcc;
+            sample.mnc = mnc;
+            sample.tac = tac;
+            sample.cell_id = cell;
+            if (n == 9 && strcmp(sample.system_mode, "LTE") == 0)
+            {
+                sample.rsrq = rsrq;
+                sample.rsrp = rsrp;
+                sample.rssi = rssi;
+                sample.sinr = sinr;
+            }
+            return true;
         }
+        return false; }, timeout);
+
+    if (!ok)
+        return false;
+    sample.at_ms = millis();
+    this->radio_publish_(sample);
+    return true;
+}
+
+void A7672SA::radio_publish_(const radio_sample &sample)
+{
+    portENTER_CRITICAL(&this->radio_lock_);
+    this->radio_seq_++; // ímpar: escrita em andamento
+    __sync_synchronize();
+    this->radio_history_[this->radio_head_] = sample;
+    this->radio_head_ = (this->radio_head_ + 1) % RADIO_HISTORY_SIZE;
+    if (this->radio_count_ < RADIO_HISTORY_SIZE)
+        this->radio_count_++;
+    __sync_synchronize();
+    this->radio_seq_++;
+    portEXIT_CRITICAL(&this->radio_lock_);
+}
+
+bool A7672SA::radio_snapshot(radio_sample &out) const
+{
+    return this->radio_history(&out, 1) == 1;
+}
+
+size_t A7672SA::radio_history(radio_sample *out, size_t max) const
+{
+    uint32_t seq;
+    size_t n;
+    do
+    {
+        while ((seq = this->radio_seq_) & 1)
+            ;
+        __sync_synchronize();
+        n = this->radio_count_ < max ? this->radio_count_ : max;
+        for (size_t i = 0; i < n; i++)
+            out[i] = this->radio_history_[(this->radio_head_ + RADIO_HISTORY_SIZE - 1 - i) % RADIO_HISTORY_SIZE];
+        __sync_synchronize();
+    } while (seq != this->radio_seq_);
+    return n;
+}
 
-        signal_quality = data_string.substring(data_string.indexOf(":") + 1, data_string.indexOf(","));
+// Brecha para amostrar: nada na fila de TX, nenhuma outra tarefa com a UART (além da própria
+// rx_task), nenhuma publicação e nenhuma sequência de vários comandos em curso. Durante o AT+COPS=? também
+// não: qualquer comando enviado cancelaria a busca
+bool A7672SA::radio_idle_() const
+{
+    if (!this->at_ready || this->publishing || this->cops_scanning_ || this->uartQueue == NULL || this->rx_guard == NULL)
+        return false;
+    if (this->seq_guard_ != NULL)
+    {
+        TaskHandle_t seq_holder = xSemaphoreGetMutexHolder(this->seq_guard_);
+        if (seq_holder != NULL && seq_holder != xTaskGetCurrentTaskHandle())
+            return false;
+    }
+    if (uxQueueMessagesWaiting(this->uartQueue) != 0)
+        return false;
+    TaskHandle_t holder = xSemaphoreGetMutexHolder(this->rx_guard);
+    return holder == NULL || holder == this->rxTaskHandle;
+}
 
-        return signal_quality.toInt();
+bool A7672SA::radio_sampler_start(uint32_t interval_ms, UBaseType_t priority)
+{
+    if (this->radio_task_ != NULL)
+    {
+        this->radio_interval_ms_ = interval_ms;
+        return true;
     }
-    return 0;
+    this->radio_interval_ms_ = interval_ms < 1000 ? 1000 : interval_ms;
+    this->radio_run_ = true;
+    if (xTaskCreate(this->radio_taskImpl, "radio_sampler", configIDLE_TASK_STACK_SIZE * 3, this, priority, &this->radio_task_) != pdPASS)
+    {
+        ESP_LOGE("RADIO", "Failed to create sampler task");
+        this->radio_run_ = false;
+        this->radio_task_ = NULL;
+        return false;
+    }
+    return true;
+}
+
+void A7672SA::radio_sampler_stop(uint32_t timeout)
+{
+    this->radio_run_ = false;
+    uint32_t start = millis();
+    while (this->radio_task_ != NULL && millis() - start < timeout)
+        vTaskDelay(pdMS_TO_TICKS(20));
+}
+
+void A7672SA::radio_taskImpl(void *pvParameters)
+{
+    static_cast<A7672SA *>(pvParameters)->radio_task();
+}
+
+void A7672SA::radio_task()
+{
+    uint32_t last = millis() - this->radio_interval_ms_;
+    while (this->radio_run_)
+    {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        if (millis() - last < this->radio_interval_ms_ || !this->radio_idle_())
+            continue;
+
+        // Só pega o SEQ_LOCK e o publish_guard se estiverem livres: uma sequência ou publicação
+        // nunca espera pelo amostrador além da consulta já em curso
+        if (!this->SEQ_LOCK(0))
+            continue;
+        if (xSemaphoreTakeRecursive(this->publish_guard, 0) != pdPASS)
+        {
+            this->SEQ_UNLOCK();
+            continue;
+        }
+        if (this->radio_idle_())
+        {
+            if (!this->radio_sample_now_(2000))
+                ESP_LOGW("RADIO", "CSQ/CPSI sample failed");
+            last = millis();
+        }
+        xSemaphoreGiveRecursive(this->publish_guard);
+        this->SEQ_UNLOCK();
+    }
+    this->radio_task_ = NULL;
+    vTaskDelete(NULL);
 }
 
 bool A7672SA::set_operator(bool automatic, NetworkOperator op, uint32_t timeout)
@@ -1287,10 +1726,11 @@ bool A7672SA::set_operator(bool automatic, NetworkOperator op, uint32_t timeout)
     if (this->publishing)
         return false;
 
+    this->operator_scan_cancel();
     if (automatic)
     {
         char data[20];
-        sprintf(data, "AT+COPS=0");
+        sprintf(data, "AT+COPS=0" GSM_NL);
         ESP_LOGV("SET_OPERATOR", "AT+COPS=0");
         this->sendCommand("SET_OPERATOR", data);
     }
@@ -1311,46 +1751,419 @@ bool A7672SA::set_network_mode(network_mode mode, uint32_t timeout)
     if (this->publishing)
         return false;
 
+    // O modo fica na NVM do modem; reenviar o mesmo valor só custaria um novo attach
+    int current = -1;
+    this->operator_scan_cancel();
+    this->query_lines_("AT+CNMP?" GSM_NL, [&current](const char *line)
+                       { return sscanf(line, "+CNMP: %d", &current) == 1; }, timeout);
+    if (current == mode)
+    {
+        this->network_mode_ = mode;
+        return true;
+    }
+
     char data[100];
     sprintf(data, "AT+CNMP=%d" GSM_NL, mode);
     this->sendCommand("SET_NETWORK_MODE", data);
 
-    return this->wait_response(timeout);
+    if (!this->wait_response(timeout))
+        return false;
+    this->network_mode_ = mode;
+    return true;
 }
 
-bool A7672SA::set_apn(const char *apn, const char *user, const char *password, uint32_t timeout)
+bool A7672SA::net_config_read(net_config &out, uint32_t timeout, uint8_t cid)
 {
-    if (this->publishing)
-        return false;
+    memset(&out, 0, sizeof(out));
+    out.auth_type = out.attached = out.active = -1;
+    out.creg_n = out.cgreg_n = out.cereg_n = -1;
+    out.cnmp = -1;
 
-    this->sendCommand("SET_APN", "AT+CREG=1" GSM_NL);
-    this->wait_response(timeout);
-    this->sendCommand("SET_APN", "AT+CEREG=1" GSM_NL);
-    this->wait_response(timeout);
-    this->sendCommand("SET_APN", "AT+CGREG=1" GSM_NL);
-    this->wait_response(timeout);
-
-    char data[100];
-    sprintf(data, "AT+CGDCONT=1,\"IPV4V6\",\"%s\"" GSM_NL, apn);
-    this->sendCommand("SET_APN", data);
-    if (this->wait_response(timeout))
-    {
-        sprintf(data, "AT+CGAUTH=1,1,\"%s\",\"%s\"" GSM_NL, user, password);
-        this->sendCommand("SET_APN", data);
-        if (this->wait_response(timeout))
+    this->operator_scan_cancel();
+    bool ok = this->query_lines_("AT+CGDCONT?;+CGAUTH?;+CNMP?;+CGATT?;+CGACT?;+CREG?;+CGREG?;+CEREG?" GSM_NL, [this, &out, cid](const char *line)
+                                 {
+        int line_cid = -1, a = -1, b = -1;
+        char field[8];
+        if (strncmp(line, "+CGDCONT: ", 10) == 0)
         {
-            sprintf(data, "AT+CGATT=1" GSM_NL);
-            this->sendCommand("SET_APN", data);
-            if (this->wait_response(timeout))
+            // +CGDCONT: 1,"IPV4V6","apn","0.0.0.0",0,0,0,0
+            const char *next = copy_at_field(line + 10, field, sizeof(field));
+            if (atoi(field) == cid)
+            {
+                next = copy_at_field(next, out.pdp_type, sizeof(out.pdp_type));
+                copy_at_field(next, out.apn, sizeof(out.apn));
+            }
+            return true;
+        }
+        if (strncmp(line, "+CGAUTH: ", 9) == 0)
+        {
+            // +CGAUTH: 1,1,"user"
+            const char *next = copy_at_field(line + 9, field, sizeof(field));
+            if (atoi(field) == cid)
             {
-                this->sendCommand("SET_APN", "AT+CGACT=1,1" GSM_NL);
-                return this->wait_response(timeout);
+                next = copy_at_field(next, field, sizeof(field));
+                out.auth_type = atoi(field);
+                copy_at_field(next, out.user, sizeof(out.user));
             }
+            return true;
+        }
+        if (sscanf(line, "+CNMP: %d", &a) == 1)
+        {
+            out.cnmp = a;
+            return true;
         }
+        if (sscanf(line, "+CGATT: %d", &a) == 1)
+        {
+            out.attached = a;
+            return true;
+        }
+        if (sscanf(line, "+CGACT: %d,%d", &line_cid, &a) == 2)
+        {
+            if (line_cid == cid)
+                out.active = a;
+            if (line_cid > 0 && line_cid <= PDN_MAX_CID)
+                this->pdn_set_(line_cid, a == 1);
+            return true;
+        }
+        // Linhas de registro também seguem para o parser, que atualiza cs/ps/eps_reg_stat_
+        if (sscanf(line, "+CREG: %d,%d", &a, &b) == 2)
+            out.creg_n = a;
+        else if (sscanf(line, "+CGREG: %d,%d", &a, &b) == 2)
+            out.cgreg_n = a;
+        else if (sscanf(line, "+CEREG: %d,%d", &a, &b) == 2)
+            out.cereg_n = a;
+        return false; }, timeout);
+
+    this->conn_update_();
+    return ok;
+}
+
+bool A7672SA::set_apn(const char *apn, const char *user, const char *password, uint32_t timeout)
+{
+    if (this->publishing)
+        return false;
+
+    net_config cur;
+    this->net_config_read(cur, timeout < 2000 ? 2000 : timeout, DEFAULT_CID);
+
+    if (cur.creg_n != 1)
+    {
+        this->sendCommand("SET_APN", "AT+CREG=1" GSM_NL);
+        this->wait_response(timeout);
+    }
+    if (cur.cereg_n != 1)
+    {
+        this->sendCommand("SET_APN", "AT+CEREG=1" GSM_NL);
+        this->wait_response(timeout);
+    }
+    if (cur.cgreg_n != 1)
+    {
+        this->sendCommand("SET_APN", "AT+CGREG=1" GSM_NL);
+        this->wait_response(timeout);
+    }
+
+    if (!this->pdn_apply_(DEFAULT_CID, "IPV4V6", apn, user, password, cur, timeout))
+        return false;
+    if (cur.attached != 1)
+    {
+        this->sendCommand("SET_APN", "AT+CGATT=1" GSM_NL);
+        if (!this->wait_response(timeout))
+            return false;
+    }
+    if (cur.active != 1)
+        return this->pdn_activate(DEFAULT_CID, timeout);
+    ESP_LOGV("SET_APN", "%s already active, nothing to apply", apn);
+    return true;
+}
+
+// CGDCONT/CGAUTH do cid só se diferirem de cur; contexto ativo com APN antigo é desativado
+// (cur.active = 0) para que a próxima ativação use o novo
+bool A7672SA::pdn_apply_(uint8_t cid, const char *pdp_type, const char *apn, const char *user, const char *password,
+                         net_config &cur, uint32_t timeout)
+{
+    char data[160];
+    bool context_changed = strcmp(cur.pdp_type, pdp_type) != 0 || strcasecmp(cur.apn, apn) != 0;
+    if (context_changed)
+    {
+        snprintf(data, sizeof(data), "AT+CGDCONT=%d,\"%s\",\"%s\"" GSM_NL, cid, pdp_type, apn);
+        this->sendCommand("SET_APN", data);
+        if (!this->wait_response(timeout))
+            return false;
+    }
+    // Sem usuário o APN não tem autenticação (tipo 0, não PAP com credenciais vazias).
+    // A senha não é legível: usuário e tipo iguais contam como já aplicados
+    // Cid sem linha +CGAUTH também está sem autenticação
+    int auth_type = user[0] != '\0' ? 1 : 0;
+    int cur_auth = cur.auth_type < 0 ? 0 : cur.auth_type;
+    if (context_changed || cur_auth != auth_type || strcmp(cur.user, user) != 0)
+    {
+        if (auth_type == 0)
+            snprintf(data, sizeof(data), "AT+CGAUTH=%d,0" GSM_NL, cid);
+        else
+            snprintf(data, sizeof(data), "AT+CGAUTH=%d,1,\"%s\",\"%s\"" GSM_NL, cid, user, password);
+        this->sendCommand("SET_APN", data);
+        if (!this->wait_response(timeout))
+            return false;
+    }
+    if (context_changed && cur.active == 1)
+    {
+        this->pdn_deactivate(cid, timeout);
+        cur.active = 0;
+    }
+
+    pdn_context &pdn = this->pdn_[cid];
+    strncpy(pdn.pdp_type, pdp_type, sizeof(pdn.pdp_type) - 1);
+    strncpy(pdn.apn, apn, sizeof(pdn.apn) - 1);
+    pdn.configured = true;
+    // Guardado para o perfil de attach (attach_remember_) quando a sessão MQTT subir neste cid
+    strncpy(this->pdn_user_[cid], user, sizeof(this->pdn_user_[cid]) - 1);
+    strncpy(this->pdn_password_[cid], password, sizeof(this->pdn_password_[cid]) - 1);
+    return true;
+}
+
+bool A7672SA::pdn_configure(uint8_t cid, const char *apn, const char *user, const char *password, const char *pdp_type, uint32_t timeout)
+{
+    if (this->publishing || cid < 1 || cid > PDN_MAX_CID)
+        return false;
+
+    net_config cur;
+    this->net_config_read(cur, timeout, cid);
+    return this->pdn_apply_(cid, pdp_type, apn, user, password, cur, timeout);
+}
+
+bool A7672SA::pdn_activate(uint8_t cid, uint32_t timeout)
+{
+    if (cid < 1 || cid > PDN_MAX_CID)
+        return false;
+    if (this->pdn_active[cid])
+        return true;
+
+    char data[24];
+    sprintf(data, "AT+CGACT=1,%d" GSM_NL, cid);
+    this->operator_scan_cancel();
+    this->sendCommand("PDN_ACTIVATE", data);
+    if (!this->wait_response(timeout))
+        return false;
+    this->pdn_set_(cid, true); // o +CGEV pode não vir para ativações pedidas pelo host
+    this->conn_update_();
+    return true;
+}
+
+bool A7672SA::pdn_deactivate(uint8_t cid, uint32_t timeout)
+{
+    if (cid < 1 || cid > PDN_MAX_CID)
+        return false;
+
+    char data[24];
+    sprintf(data, "AT+CGACT=0,%d" GSM_NL, cid);
+    this->operator_scan_cancel();
+    this->sendCommand("PDN_DEACTIVATE", data);
+    if (!this->wait_response(timeout))
+        return false;
+    this->pdn_set_(cid, false);
+    this->conn_update_();
+    return true;
+}
+
+void A7672SA::pdn_set_(uint8_t cid, bool active)
+{
+    if (cid > PDN_MAX_CID || this->pdn_active[cid] == active)
+        return;
+    this->pdn_active[cid] = active;
+    this->pdn_[cid].changed_ms = millis();
+    if (!active)
+        this->pdn_[cid].drops++;
+}
+
+pdn_context A7672SA::pdn_state(uint8_t cid) const
+{
+    pdn_context state = {};
+    if (cid <= PDN_MAX_CID)
+    {
+        state = this->pdn_[cid];
+        state.active = this->pdn_active[cid];
+    }
+    return state;
+}
+
+bool A7672SA::mqtt_bind_pdn(uint8_t cid)
+{
+    if (cid < 1 || cid > PDN_MAX_CID)
+        return false;
+    this->mqtt_cid_ = cid;
+    return true;
+}
+
+bool A7672SA::http_bind_pdn(uint8_t cid)
+{
+    if (cid < 1 || cid > PDN_MAX_CID)
+        return false;
+    this->http_cid_ = cid;
+    return true;
+}
+
+// AT+CSOCKSETPN escolhe o contexto dos serviços de socket (MQTT, HTTP) iniciados a seguir
+bool A7672SA::csock_select_(uint8_t cid, uint32_t timeout)
+{
+    if (this->csock_cid_ == cid)
+        return true;
+
+    char data[24];
+    sprintf(data, "AT+CSOCKSETPN=%d" GSM_NL, cid);
+    this->sendCommand("CSOCKSETPN", data);
+    if (!this->wait_response(timeout))
+    {
+        this->csock_cid_ = 0;
+        return false;
     }
+    this->csock_cid_ = cid;
+    return true;
+}
+
+// Ordem do fallback: operadora atual, depois LTE, UTRAN/HSPA e GSM
+static int operator_rank(const NetworkOperator &op)
+{
+    if (op.status == 2)
+        return 0;
+    if (op.access_tech == 7)
+        return 1;
+    if (op.access_tech == 2 || (op.access_tech >= 4 && op.access_tech <= 6))
+        return 2;
+    return 3;
+}
+
+bool A7672SA::attach_profile_load(attach_profile &out)
+{
+    if (this->nvs_load_(ATTACH_PROFILE_KEY, &out, sizeof(out)))
+        return out.numeric_code[0] != '\0';
+    // Tamanho diferente: perfil do formato antigo, que ainda levava usuário/senha do APN
+    this->nvs_erase_(ATTACH_PROFILE_KEY);
     return false;
 }
 
+void A7672SA::attach_profile_forget()
+{
+    this->nvs_erase_(ATTACH_PROFILE_KEY);
+}
+
+// Chamado após uma sessão MQTT subir: PDN + broker provam que operadora/RAT/APN funcionam
+void A7672SA::attach_remember_()
+{
+    const pdn_context &pdn = this->pdn_[this->mqtt_cid_];
+    if (!pdn.configured) // APN do cid do MQTT configurado fora desta instância: nada a salvar
+        return;
+
+    // O keepalive_select_ já consultou a operadora neste mqtt_connect; só pergunta de novo se ele não rodou
+    if (this->current_operator_.numeric_code[0] == '\0')
+    {
+        this->sendCommand("ATTACH_PROFILE", "AT+COPS=3,2;+COPS?" GSM_NL);
+        this->wait_response(2000);
+    }
+    if (this->current_operator_.numeric_code[0] == '\0')
+        return;
+
+    attach_profile profile = {};
+    strncpy(profile.apn, pdn.apn, sizeof(profile.apn) - 1);
+    memcpy(profile.numeric_code, this->current_operator_.numeric_code, sizeof(profile.numeric_code));
+    profile.access_tech = this->current_operator_.access_tech;
+    profile.network_mode = this->network_mode_;
+
+    attach_profile saved;
+    if (this->nvs_load_(ATTACH_PROFILE_KEY, &saved, sizeof(saved)) && memcmp(&saved, &profile, sizeof(profile)) == 0)
+        return; // não regrava a flash a cada reconexão
+    if (this->nvs_store_(ATTACH_PROFILE_KEY, &profile, sizeof(profile)))
+        ESP_LOGI("ATTACH", "Saved profile %s/%d APN %s", profile.numeric_code, profile.access_tech, profile.apn);
+}
+
+bool A7672SA::attach_try_(const char *cops, const attach_profile &profile, const char *user, const char *password, uint32_t deadline)
+{
+    uint32_t start = millis();
+    auto remaining = [start, deadline]()
+    {
+        uint32_t elapsed = millis() - start;
+        return elapsed + 1000 < deadline ? deadline - elapsed : 1000;
+    };
+
+    if (profile.network_mode != 0 && profile.network_mode != this->network_mode_)
+        this->set_network_mode((network_mode)profile.network_mode);
+
+    // O AT+COPS de seleção só responde depois da tentativa de registro
+    this->sendCommand("ATTACH", cops);
+    if (!this->wait_response(remaining()))
+        return false;
+    if (!this->wait_network(remaining()))
+        return false;
+    // O APN salvo é o do cid do MQTT
+    if (this->mqtt_cid_ != DEFAULT_CID)
+        return this->pdn_configure(this->mqtt_cid_, profile.apn, user, password, "IPV4V6", remaining()) &&
+               this->pdn_activate(this->mqtt_cid_, remaining());
+    return this->set_apn(profile.apn, user, password, remaining());
+}
+
+bool A7672SA::fast_attach(const char *apn, const char *user, const char *password, uint32_t deadline, uint32_t scan_timeout)
+{
+    if (this->publishing)
+        return false;
+
+    uint32_t start = millis();
+    attach_profile saved;
+    bool have_saved = this->attach_profile_load(saved);
+    attach_profile target = have_saved ? saved : attach_profile{};
+    const pdn_context &pdn = this->pdn_[this->mqtt_cid_];
+    if (!have_saved && pdn.configured)
+        strncpy(target.apn, pdn.apn, sizeof(target.apn) - 1);
+    if (apn != nullptr)
+    {
+        memset(target.apn, 0, sizeof(target.apn));
+        strncpy(target.apn, apn, sizeof(target.apn) - 1);
+    }
+    else if (user[0] == '\0' && pdn.configured && strcmp(pdn.apn, target.apn) == 0)
+    {
+        // credenciais só na RAM: as do último pdn_apply_ para este mesmo APN
+        user = this->pdn_user_[this->mqtt_cid_];
+        password = this->pdn_password_[this->mqtt_cid_];
+    }
+    if (target.apn[0] == '\0')
+    {
+        ESP_LOGW("ATTACH", "No APN given and no saved profile");
+        return false;
+    }
+
+    char cops[48];
+    if (have_saved)
+    {
+        // COPS=4: manual com fallback automático do próprio modem se a operadora não estiver disponível
+        snprintf(cops, sizeof(cops), "AT+COPS=4,2,\"%s\",%d" GSM_NL, saved.numeric_code, saved.access_tech);
+        this->operator_scan_cancel();
+        if (this->attach_try_(cops, target, user, password, deadline))
+        {
+            ESP_LOGI("ATTACH", "Attached with saved profile %s/%d in %u ms", saved.numeric_code, saved.access_tech, millis() - start);
+            return true;
+        }
+        ESP_LOGW("ATTACH", "Saved profile %s/%d failed after %u ms, scanning", saved.numeric_code, saved.access_tech, millis() - start);
+    }
+
+    target.network_mode = AUTOMATIC;
+    std::vector<NetworkOperator> ops = this->get_operator_list(scan_timeout);
+    std::stable_sort(ops.begin(), ops.end(), [](const NetworkOperator &a, const NetworkOperator &b)
+                     { return operator_rank(a) < operator_rank(b); });
+    for (const auto &op : ops)
+    {
+        if (op.status == 3) // proibida
+            continue;
+        snprintf(cops, sizeof(cops), "AT+COPS=1,2,\"%s\",%d" GSM_NL, op.numeric_code, op.access_tech);
+        if (this->attach_try_(cops, target, user, password, deadline))
+        {
+            ESP_LOGI("ATTACH", "Attached to %s/%d after scan in %u ms", op.numeric_code, op.access_tech, millis() - start);
+            return true;
+        }
+    }
+
+    bool ok = this->attach_try_("AT+COPS=0" GSM_NL, target, user, password, deadline);
+    ESP_LOGI("ATTACH", "Automatic selection %s in %u ms", ok ? "attached" : "failed", millis() - start);
+    return ok;
+}
+
 bool A7672SA::wait_network(uint32_t timeout_ms)
 {
     if (this->publishing)
@@ -1364,6 +2177,7 @@ bool A7672SA::wait_network(uint32_t timeout_ms)
     {
         if (ps_registration() == UNKNOWN && eps_registration() == UNKNOWN)
         {
+            this->operator_scan_cancel();
             sendCommand("WAIT_NETWORK", "AT+CGREG?" GSM_NL);
             (void)wait_response(2000); // seu parser já aplicará o estado
             if (!ready())
@@ -1383,6 +2197,7 @@ bool A7672SA::set_ntp_server(const char *ntp_server, int time_zone, uint32_t tim
 
     char data[100];
     sprintf(data, "AT+CNTP=\"%s\",%d" GSM_NL, ntp_server, time_zone);
+    this->operator_scan_cancel();
     this->sendCommand("SET_NTP_SERVER", data);
     if (this->wait_response(timeout))
     {
@@ -1447,35 +2262,97 @@ time_t convertToTimestamp(const char *arry)
  */
 std::vector<NetworkOperator> A7672SA::get_operator_list(uint32_t timeout)
 {
-    if (this->publishing)
+    operator_list list;
+    if (!this->operator_list_cached(list) && !this->publishing)
     {
-        ESP_LOGV("GET_OPERATOR_LIST", "Não foi possível executar: publicação em andamento");
-        return this->available_operators;
+        if (this->cops_task_ == NULL)
+            this->operator_scan_start(timeout);
+        uint32_t start = millis();
+        while (this->cops_task_ != NULL && millis() - start < timeout)
+            vTaskDelay(pdMS_TO_TICKS(100));
+        if (!this->operator_list_cached(list))
+            ESP_LOGV("GET_OPERATOR_LIST", "Timeout ao aguardar lista de operadoras");
     }
 
-    this->operators_list_updated = false;
+    // Só a API legada aloca: a lista em si vive em operators_
+    return std::vector<NetworkOperator>(list.ops, list.ops + list.count);
+}
+
+bool A7672SA::operator_list_cached(operator_list &out, uint32_t ttl_ms)
+{
+    portENTER_CRITICAL(&this->operators_lock_);
+    out = this->operators_;
+    portEXIT_CRITICAL(&this->operators_lock_);
+    return out.at_ms != 0 && millis() - out.at_ms < ttl_ms;
+}
+
+bool A7672SA::operator_scan_start(uint32_t timeout, UBaseType_t priority)
+{
+    if (this->cops_task_ != NULL)
+        return true;
+    if (this->publishing || this->uartQueue == NULL)
+        return false;
 
-    if (this->available_operators.size() > 0)
+    this->cops_timeout_ = timeout;
+    this->cops_cancel_ = false;
+    if (xTaskCreate(this->operator_scan_taskImpl, "operator_scan", configIDLE_TASK_STACK_SIZE * 2, this, priority, &this->cops_task_) != pdPASS)
     {
-        ESP_LOGV("GET_OPERATOR_LIST", "Lista de operadoras já carregada, não é necessário executar novamente");
-        return this->available_operators;
+        ESP_LOGE("OPERATOR_SCAN", "Failed to create scan task");
+        this->cops_task_ = NULL;
+        return false;
     }
+    return true;
+}
 
-    this->sendCommand("GET_OPERATOR_LIST", "AT+COPS=?" GSM_NL);
+// Qualquer caractere recebido aborta o AT+COPS=? (3GPP 27.007); o modem encerra com ERROR
+void A7672SA::operator_scan_cancel(uint32_t timeout)
+{
+    if (!this->cops_scanning_)
+        return;
+    this->cops_cancel_ = true;
+    this->send_cmd_to_simcomm("COPS_ABORT", GSM_NL);
+    if (xTaskGetCurrentTaskHandle() == this->rxTaskHandle) // quem despacha a resposta do abort não pode esperar por ela
+        return;
+    uint32_t start = millis();
+    while (this->cops_scanning_ && millis() - start < timeout)
+        vTaskDelay(pdMS_TO_TICKS(10));
+}
 
-    bool result = wait_for_condition(timeout, [this]()
-                                     { return this->operators_list_updated || this->at_error; }, "lista de operadoras");
+void A7672SA::operator_scan_taskImpl(void *pvParameters)
+{
+    static_cast<A7672SA *>(pvParameters)->operator_scan_task();
+}
 
-    if (result)
+void A7672SA::operator_scan_task()
+{
+    this->operators_list_updated = false;
+    this->at_error = false;
+    this->sendCommand("OPERATOR_SCAN", "AT+COPS=?" GSM_NL);
+    this->cops_scanning_ = true;
+
+    uint32_t start = millis();
+    while (!this->operators_list_updated && !this->at_error && !this->cops_cancel_ &&
+           millis() - start < this->cops_timeout_)
+        vTaskDelay(pdMS_TO_TICKS(100));
+
+    if (this->cops_cancel_)
     {
-        ESP_LOGV("GET_OPERATOR_LIST", "Lista de operadoras atualizada com sucesso");
+        // Espera o modem confirmar o abort antes de liberar a UART para o comando que cancelou
+        uint32_t abort_start = millis();
+        while (!this->operators_list_updated && !this->at_error && !this->at_ok && millis() - abort_start < 1000)
+            vTaskDelay(pdMS_TO_TICKS(10));
+        ESP_LOGI("OPERATOR_SCAN", "Cancelled after %u ms", millis() - start);
     }
+    else if (this->operators_list_updated)
+        ESP_LOGI("OPERATOR_SCAN", "%d operators in %u ms", this->operators_.count, millis() - start);
     else
-    {
-        ESP_LOGV("GET_OPERATOR_LIST", "Timeout ao aguardar lista de operadoras");
-    }
+        ESP_LOGW("OPERATOR_SCAN", "No list after %u ms", millis() - start);
 
-    return this->available_operators;
+    this->at_ok = false;
+    this->at_error = false;
+    this->cops_scanning_ = false;
+    this->cops_task_ = NULL;
+    vTaskDelete(NULL);
 }
 
 time_t A7672SA::get_ntp_time(uint32_t timeout)
@@ -1483,6 +2360,7 @@ time_t A7672SA::get_ntp_time(uint32_t timeout)
     if (this->publishing)
         return 0;
 
+    this->operator_scan_cancel();
     this->sendCommand("GET_NTP_TIME", "AT+CCLK?" GSM_NL);
     if (wait_response(timeout))
     {
@@ -1510,207 +2388,118 @@ time_t A7672SA::get_ntp_time(uint32_t timeout)
 }
 
 /*
-AT+CSPN anwser:
+AT+CGSN;+CICCID;+CSPN?;+CGPADDR anwser:
 >
+> 860710050359929
+> +ICCID: 89860318760238610932
 > +CSPN: "TIM",1
+> +CGPADDR: 1,41.3.5.144,254.128.0.0.0.0.0.0.24.69.231.10.121.241.106.179
 >
 > OK
+Sem SIM o modem para no +CICCID com ERROR, mas o IMEI já veio.
 */
-String A7672SA::get_provider_name(uint32_t timeout)
+bool A7672SA::identity_snapshot(modem_identity &out, bool refresh, uint32_t timeout)
 {
-    if (this->publishing)
-        return "NO SIM";
-
-    this->sendCommand("GET_PROVIDER_NAME", "AT+CSPN?" GSM_NL);
-    if (this->wait_response(timeout))
+    if (!refresh || this->publishing)
     {
-        String data_string = "";
-        String provider_name = "";
+        out = this->identity_;
+        return out.at_ms != 0;
+    }
+
+    modem_identity id = this->identity_;
+    bool cached = id.imei[0] && id.iccid[0];
+    id.provider[0] = 0;
+    id.provider_display = 0;
+    id.cid = 0;
+    id.ipv4[0] = 0;
+    id.ipv6[0] = 0;
 
-        for (int j = 0; j < strlen(this->at_response); j++)
+    this->operator_scan_cancel();
+    bool ok = this->query_lines_(cached ? "AT+CSPN?;+CGPADDR" GSM_NL : "AT+CGSN;+CICCID;+CSPN?;+CGPADDR" GSM_NL, [&id](const char *line)
+                                 {
+        size_t len = strlen(line);
+        if (len >= 14 && len < sizeof(id.imei) && strspn(line, "0123456789") == len)
         {
-            data_string += this->at_response[j];
+            memcpy(id.imei, line, len + 1);
+            return true;
         }
+        if (strncmp(line, "+ICCID: ", 8) == 0)
+        {
+            copy_at_field(line + 8, id.iccid, sizeof(id.iccid));
+            return true;
+        }
+        if (strncmp(line, "+CSPN: ", 7) == 0)
+        {
+            char display[4];
+            const char *next = copy_at_field(line + 7, id.provider, sizeof(id.provider));
+            copy_at_field(next, display, sizeof(display));
+            id.provider_display = atoi(display);
+            return true;
+        }
+        if (strncmp(line, "+CGPADDR: ", 10) == 0)
+        {
+            // Um +CGPADDR por CID: fica o primeiro com IPv4 atribuído
+            char cid[4], ipv4[sizeof(id.ipv4)], ipv6[sizeof(id.ipv6)];
+            const char *next = copy_at_field(line + 10, cid, sizeof(cid));
+            next = copy_at_field(next, ipv4, sizeof(ipv4));
+            copy_at_field(next, ipv6, sizeof(ipv6));
+            if (id.ipv4[0] == 0 && ipv4[0] && strcmp(ipv4, "0.0.0.0") != 0)
+            {
+                id.cid = atoi(cid);
+                strcpy(id.ipv4, ipv4);
+                strcpy(id.ipv6, ipv6);
+            }
+            return true;
+        }
+        return false; }, timeout);
 
-        data_string.trim();
-
-        provider_name = data_string.substring(data_string.indexOf("\"") + 1, data_string.indexOf("\"", data_string.indexOf("\"") + 1));
-
-        ESP_LOGV("GET_PROVIDER_NAME", "PROVIDER_NAME: %s", provider_name.c_str());
+    id.at_ms = millis();
+    this->identity_ = id;
+    out = id;
+    ESP_LOGV("IDENTITY", "IMEI %s ICCID %s provider %s CID %d IPv4 %s IPv6 %s", id.imei, id.iccid, id.provider, id.cid, id.ipv4, id.ipv6);
+    return ok;
+}
 
-        return provider_name;
-    }
-    return "NO SIM";
+String A7672SA::get_provider_name(uint32_t timeout)
+{
+    modem_identity id;
+    this->identity_snapshot(id, true, timeout);
+    return id.provider[0] ? String(id.provider) : String("NO SIM");
 }
 
-/*
-AT+CGSN anwser:
->
-> 860710050359929
->
-> OK
-*/
 String A7672SA::get_imei(uint32_t timeout)
 {
-    if (this->publishing)
-        return "0";
-
-    this->sendCommand("GET_IMEI", "AT+CGSN" GSM_NL);
-    if (this->wait_response(timeout))
-    {
-        String data_string = "";
-        String imei = "";
-        for (int j = 0; j < strlen(this->at_response); j++)
-        {
-            data_string += this->at_response[j];
-        }
-
-        data_string.trim();
-
-        imei = data_string.substring(0, data_string.indexOf("\n") - 1);
-
-        ESP_LOGV("GET_IMEI", "IMEI: %s", imei.c_str());
-
-        // validate IMEI
-        if (imei.length() == 15)
-            return imei;
-    }
-    return "0";
+    modem_identity id;
+    this->identity_snapshot(id, this->identity_.imei[0] == 0, timeout);
+    return id.imei[0] ? String(id.imei) : String("0");
 }
 
-/*
-AT+CICCID
-+ICCID: 89860318760238610932
-*/
 String A7672SA::get_iccid(uint32_t timeout)
 {
-    if (this->publishing)
-        return "0";
-
-    this->sendCommand("GET_ICCID", "AT+CICCID" GSM_NL);
-    if (this->wait_response(timeout))
-    {
-        String data_string = "";
-        String iccid = "";
-        for (int j = 0; j < strlen(this->at_response); j++)
-        {
-            data_string += this->at_response[j];
-        }
-
-        data_string.trim();
-
-        iccid = data_string.substring(data_string.indexOf(":") + 1, data_string.indexOf("\n") - 1);
-
-        ESP_LOGV("GET_ICCID", "ICCID: %s", iccid.c_str());
-
-        return iccid;
-    }
-    return "0";
+    modem_identity id;
+    this->identity_snapshot(id, this->identity_.iccid[0] == 0, timeout);
+    return id.iccid[0] ? String(id.iccid) : String("0");
 }
 
-/*
-AT+CGPADDR anwser:
->
-> +CGPADDR: <cid>,<PDP_addr_IPV4>,<PDP_addr_IPV6>
-> EXAMPLE:
-> +CGPADDR: 8,41.3.5.144,254.128.0.0.0.0.0.0.24.69.231.10.121.241.106.179
->
-> OK
-*/
 IPAddress A7672SA::get_local_ip(uint32_t timeout)
 {
-    if (this->publishing)
-        return IPAddress(0, 0, 0, 0);
-
-    this->sendCommand("GET_LOCAL_IP", "AT+CGPADDR" GSM_NL);
-    if (this->wait_response(timeout))
-    {
-        String data_string = "";
-        String ipv4_str = "";
-
-        for (int j = 0; j < strlen(this->at_response); j++)
-        {
-            data_string += this->at_response[j];
-        }
-
-        data_string.trim();
-
-        // Formato esperado: +CGPADDR: 8,41.3.5.144,254.128.0.0.0.0.0.0.24.69.231.10.121.241.106.179
-        // Encontra a primeira vírgula
-        int firstComma = data_string.indexOf(",");
-        if (firstComma < 0)
-            return IPAddress(0, 0, 0, 0);
-
-        // Encontra a segunda vírgula (que separa IPv4 do IPv6)
-        int secondComma = data_string.indexOf(",", firstComma + 1);
-
-        // Se não houver segunda vírgula, pegamos até o final da linha
-        if (secondComma < 0)
-        {
-            ipv4_str = data_string.substring(firstComma + 1, data_string.indexOf("\n") - 1);
-        }
-        else
-        {
-            // Caso contrário, pegamos da primeira à segunda vírgula
-            ipv4_str = data_string.substring(firstComma + 1, secondComma);
-        }
-
-        ESP_LOGV("GET_LOCAL_IP", "IPv4: %s", ipv4_str.c_str());
-
-        // get the four octets of the IPv4 address
-        int octet1 = ipv4_str.substring(0, ipv4_str.indexOf(".")).toInt();
-        ipv4_str.remove(0, ipv4_str.indexOf(".") + 1);
-        int octet2 = ipv4_str.substring(0, ipv4_str.indexOf(".")).toInt();
-        ipv4_str.remove(0, ipv4_str.indexOf(".") + 1);
-        int octet3 = ipv4_str.substring(0, ipv4_str.indexOf(".")).toInt();
-        ipv4_str.remove(0, ipv4_str.indexOf(".") + 1);
-        int octet4 = ipv4_str.toInt();
-
-        IPAddress local_ip(octet1, octet2, octet3, octet4);
-        return local_ip;
-    }
-    return IPAddress(0, 0, 0, 0);
+    modem_identity id;
+    int octet[4] = {0, 0, 0, 0};
+    this->identity_snapshot(id, true, timeout);
+    sscanf(id.ipv4, "%d.%d.%d.%d", &octet[0], &octet[1], &octet[2], &octet[3]);
+    return IPAddress(octet[0], octet[1], octet[2], octet[3]);
 }
 
 String A7672SA::get_local_ipv6(uint32_t timeout)
 {
-    if (this->publishing)
-        return "";
-
-    this->sendCommand("GET_LOCAL_IPV6", "AT+CGPADDR" GSM_NL);
-    if (this->wait_response(timeout))
-    {
-        String data_string = "";
-        String ipv6_str = "";
-
-        for (int j = 0; j < strlen(this->at_response); j++)
-        {
-            data_string += this->at_response[j];
-        }
-
-        data_string.trim();
-
-        // Formato esperado: +CGPADDR: 8,41.3.5.144,254.128.0.0.0.0.0.0.24.69.231.10.121.241.106.179
-        // Precisamos encontrar a segunda vírgula para pegar o IPv6
-        int firstComma = data_string.indexOf(",");
-        if (firstComma < 0)
-            return "";
-
-        int secondComma = data_string.indexOf(",", firstComma + 1);
-        if (secondComma < 0)
-            return ""; // Não há IPv6
-
-        // Pega do segundo separador até o final da linha
-        ipv6_str = data_string.substring(secondComma + 1, data_string.indexOf("\n") - 1);
-
-        ESP_LOGV("GET_LOCAL_IPV6", "IPv6: %s", ipv6_str.c_str());
-        return ipv6_str;
-    }
-    return "";
+    modem_identity id;
+    this->identity_snapshot(id, true, timeout);
+    return String(id.ipv6);
 }
 
 bool A7672SA::set_ca_cert(const char *ca_cert, const char *ca_name, size_t cert_size, uint32_t timeout)
 {
+    seq_scope seq(*this);
     char data[100];
     this->at_input = false;
     sprintf(data, "AT+CCERTDOWN=\"%s\",%d" GSM_NL, ca_name, cert_size);
@@ -1726,6 +2515,15 @@ bool A7672SA::set_ca_cert(const char *ca_cert, const char *ca_name, size_t cert_
 
 bool A7672SA::mqtt_connect(const char *host, uint16_t port, const char *clientId, bool clean_session, const char *username, const char *password, bool ssl, const char *ca_name, uint16_t keepalive, uint32_t timeout)
 {
+    seq_scope seq(*this);
+    memset(&this->current_operator_, 0, sizeof(this->current_operator_)); // consultada uma vez por conexão
+    keepalive = this->keepalive_select_(keepalive);
+    if (!this->csock_select_(this->mqtt_cid_, timeout))
+    {
+        ESP_LOGW("MQTT_CONNECT", "Failed to bind MQTT to cid %d", this->mqtt_cid_);
+        return false;
+    }
+
     if (ssl)
     {
         this->sendCommand("MQTT_CONNECT", "AT+CSSLCFG=\"sslversion\",0,4" GSM_NL);
@@ -1764,8 +2562,18 @@ bool A7672SA::mqtt_connect(const char *host, uint16_t port, const char *clientId
                             sprintf(data, "AT+CMQTTCONNECT=0,\"tcp://%s:%d\",%d,%d,\"%s\",\"%s\"" GSM_NL, host, port, keepalive, clean_session, username, password);
                         }
                         this->mqtt_connected = false;
+                        this->conn_update_();
+                        this->inflight_requeue_();
                         this->sendCommand("MQTT_CONNECT", data);
                         bool result = this->wait_to_connect(timeout);
+                        if (result)
+                        {
+                            this->session_keepalive_ = keepalive;
+                            this->session_start_ = millis();
+                            this->session_proven_ = false;
+                            this->mqtt_replay_inflight(timeout);
+                            this->attach_remember_();
+                        }
                         return result;
                     }
                 }
@@ -1797,8 +2605,18 @@ bool A7672SA::mqtt_connect(const char *host, uint16_t port, const char *clientId
                     sprintf(data, "AT+CMQTTCONNECT=0,\"tcp://%s:%d\",%d,%d,\"%s\",\"%s\"" GSM_NL, host, port, keepalive, clean_session, username, password);
                 }
                 this->mqtt_connected = false;
+                this->conn_update_();
+                this->inflight_requeue_();
                 this->sendCommand("MQTT_CONNECT", data);
                 bool result = this->wait_to_connect(timeout);
+                if (result)
+                {
+                    this->session_keepalive_ = keepalive;
+                    this->session_start_ = millis();
+                    this->session_proven_ = false;
+                    this->mqtt_replay_inflight(timeout);
+                    this->attach_remember_();
+                }
                 return result;
             }
         }
@@ -1808,6 +2626,8 @@ bool A7672SA::mqtt_connect(const char *host, uint16_t port, const char *clientId
 
 bool A7672SA::mqtt_disconnect(uint32_t timeout)
 {
+    this->keepalive_session_end_(false);
+    this->operator_scan_cancel();
     this->sendCommand("MQTT_DISCONNECT", "AT+CMQTTDISC=0,120" GSM_NL);
     if (this->wait_response(timeout))
     {
@@ -1825,413 +2645,2237 @@ bool A7672SA::mqtt_publish(const char *topic, uint8_t *data, size_t len, uint16_
         ESP_LOGE("MQTT_PUBLISH", "Data is null or length is zero");
         return false;
     }
+
+    if (qos > 0)
+        return this->mqtt_publish_tracked_(topic, [data](uint8_t *buffer, size_t max_len, size_t offset)
+                                           {
+                                               memcpy(buffer, data + offset, max_len);
+                                               return (int)max_len; },
+                                           len, qos, timeout);
+
     // this->publishing = true;
     if (this->publishing)
         return false;
 
+    ESP_LOGV("MQTT_PUBLISH", "LEN =  %d bytes", len);
+
+    if (!this->mqtt_publish_begin_(topic, len, qos, timeout))
+        return false;
+    this->uart_write_chunked_(data, len);
+    return this->mqtt_publish_end_(timeout);
+}
+
+bool A7672SA::mqtt_publish(const char *topic, const data_segment *segments, size_t n_segments, uint16_t qos, uint32_t timeout)
+{
+    size_t len = 0;
+    for (size_t i = 0; segments != nullptr && i < n_segments; i++)
+        len += segments[i].len;
+    if (len == 0)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Segments are null or empty");
+        return false;
+    }
+
+    if (qos > 0)
+    {
+        // um segmento por chamada; o mqtt_enqueue_reader_ continua do offset até completar len
+        return this->mqtt_publish_tracked_(topic, [segments, n_segments](uint8_t *buffer, size_t max_len, size_t offset)
+                                           {
+                                               size_t start = 0;
+                                               for (size_t i = 0; i < n_segments; i++)
+                                               {
+                                                   if (offset < start + segments[i].len)
+                                                   {
+                                                       size_t take = start + segments[i].len - offset;
+                                                       if (take > max_len)
+                                                           take = max_len;
+                                                       memcpy(buffer, segments[i].data + (offset - start), take);
+                                                       return (int)take;
+                                                   }
+                                                   start += segments[i].len;
+                                               }
+                                               return 0; },
+                                           len, qos, timeout);
+    }
+
+    if (this->publishing)
+        return false;
+
+    if (!this->mqtt_publish_begin_(topic, len, qos, timeout))
+        return false;
+    for (size_t i = 0; i < n_segments; i++)
+        this->uart_write_chunked_(segments[i].data, segments[i].len);
+    return this->mqtt_publish_end_(timeout);
+}
+
+bool A7672SA::mqtt_publish_stream(const char *topic, size_t len, payload_reader reader, uint16_t qos, uint32_t timeout)
+{
+    if (!reader || len == 0)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Reader is null or length is zero");
+        return false;
+    }
+    if (qos > 0)
+        return this->mqtt_publish_tracked_(topic, reader, len, qos, timeout);
+    if (this->publishing)
+        return false;
+
+    if (!this->mqtt_publish_begin_(topic, len, qos, timeout))
+        return false;
+
+    bool reader_ok = this->uart_write_stream_(reader, len, nullptr, "MQTT_PUBLISH");
+    bool ok = this->mqtt_publish_end_(timeout);
+    return ok && reader_ok;
+}
+
+bool A7672SA::mqtt_publish_begin_(const char *topic, size_t len, uint16_t qos, uint32_t timeout)
+{
+    if (len > MQTT_MAX_PAYLOAD_SIZE)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Payload too large (%d > %d)", len, MQTT_MAX_PAYLOAD_SIZE);
+        return false;
+    }
+    char cmd[MQTT_PUB_CMD_SIZE];
+    size_t prefix_len = this->mqtt_render_prefix_(cmd, sizeof(cmd), topic, qos);
+    if (prefix_len == 0)
+        return false;
+    return this->mqtt_publish_begin_(cmd, this->mqtt_render_cmd_(cmd, cmd, prefix_len, len), timeout);
+}
+
+// Envia o comando AT+CMQTTPUB já renderizado e espera o prompt '>'. Se retornar true, o PUBLISH_LOCK fica tomado até mqtt_publish_end_().
+bool A7672SA::mqtt_publish_begin_(const char *cmd, size_t cmd_len, uint32_t timeout)
+{
+    this->operator_scan_cancel();
     if (!this->PUBLISH_LOCK(timeout))
     {
         ESP_LOGW("MQTT_PUBLISH", "LTE publish lock timeout");
         return false;
     }
 
-    const size_t data_size = strlen(topic) + len + 50;
-    char data_string[data_size];
-    ESP_LOGV("MQTT_PUBLISH", "LEN =  %d bytes", len);
+    if (!this->ack_wait_qos_(0, timeout))
+    {
+        ESP_LOGW("MQTT_PUBLISH", "QoS 1/2 acks still pending");
+        this->PUBLISH_UNLOCK();
+        return false;
+    }
 
     this->at_publish = false;
     this->at_input = false;
-    sprintf(data_string, "AT+CMQTTPUB=0,\"%s\",%d,%d" GSM_NL, topic, qos, len);
-    this->sendCommand("MQTT_PUBLISH_CMD", data_string);
-    bool ok = false;
-    if (this->wait_input(timeout))
+    this->sendCommand("MQTT_PUBLISH_CMD", (uint8_t *)cmd, cmd_len);
+    if (!this->wait_input(timeout))
     {
-        this->send_cmd_to_simcomm("MQTT_PUBLISH_DATA", data, len);
-        if (this->wait_publish(timeout))
-        {
-            ok = true;
-        }
+        this->PUBLISH_UNLOCK();
+        return false;
     }
 
-    // this->publishing = false;
+    this->inflight_lock_();
+    this->ack_push_(MQTT_ACK_SYNC, 0);
+    this->inflight_unlock_();
+    return true;
+}
 
-    this->PUBLISH_UNLOCK();
-    return ok;
+// "AT+CMQTTPUB=0,"<topic>",<qos>," em out; retorna o tamanho ou 0 se o tópico não couber
+size_t A7672SA::mqtt_render_prefix_(char *out, size_t out_size, const char *topic, uint16_t qos)
+{
+    if (topic == nullptr || strlen(topic) > MQTT_TOPIC_MAX_LEN)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Topic is null or too long");
+        return 0;
+    }
+    int n = snprintf(out, out_size, "AT+CMQTTPUB=0,\"%s\",%d,", topic, qos);
+    return (n > 0 && (size_t)n < out_size) ? n : 0;
 }
 
-bool A7672SA::mqtt_subscribe_topics(const char *topic[10], int n_topics, uint16_t qos, uint32_t timeout)
+// Acrescenta "<len>\r\n" ao prefixo; out deve ter MQTT_PUB_CMD_SIZE bytes (pode ser o próprio prefix)
+size_t A7672SA::mqtt_render_cmd_(char *out, const char *prefix, size_t prefix_len, size_t len)
 {
-    if (this->publishing)
-        return false;
+    if (out != prefix)
+        memcpy(out, prefix, prefix_len);
+    char digits[10];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + (len % 10);
+        len /= 10;
+    } while (len > 0 && n < (int)sizeof(digits));
+    size_t pos = prefix_len;
+    while (n > 0)
+        out[pos++] = digits[--n];
+    out[pos++] = '\r';
+    out[pos++] = '\n';
+    out[pos] = '\0';
+    return pos;
+}
 
-    for (int i = 0; i < n_topics; i++)
+mqtt_topic_handle A7672SA::mqtt_register_topic(const char *topic, uint16_t qos)
+{
+    if (qos > 2)
+        qos = 2;
+    char prefix[MQTT_PUB_CMD_SIZE];
+    size_t prefix_len = this->mqtt_render_prefix_(prefix, sizeof(prefix), topic, qos);
+    if (prefix_len == 0)
+        return -1;
+
+    for (int i = 0; i < MQTT_MAX_TOPIC_HANDLES; i++)
     {
-        const size_t data_size = strlen(topic[i]) + 50;
-        char data_string[data_size];
-        this->at_input = false;
-        sprintf(data_string, "AT+CMQTTSUBTOPIC=0,%d,%d" GSM_NL, strlen(topic[i]), qos);
-        this->sendCommand("MQTT_SUBSCRIBE", data_string);
-        if (this->wait_input(timeout))
+        mqtt_topic_entry &entry = this->topic_handles_[i];
+        if (entry.prefix != NULL)
+            continue;
+        entry.prefix = (char *)malloc(prefix_len + 1);
+        if (entry.prefix == NULL)
+            return -1;
+        memcpy(entry.prefix, prefix, prefix_len + 1);
+        entry.prefix_len = prefix_len;
+        entry.qos = qos;
+        ESP_LOGV("MQTT_TOPIC", "Registered handle %d: %s", i, topic);
+        return i;
+    }
+    ESP_LOGW("MQTT_TOPIC", "No free topic handle (max %d)", MQTT_MAX_TOPIC_HANDLES);
+    return -1;
+}
+
+void A7672SA::mqtt_unregister_topic(mqtt_topic_handle handle)
+{
+    if (handle < 0 || handle >= MQTT_MAX_TOPIC_HANDLES)
+        return;
+    // mensagens em voo que usam o handle precisam do prefixo até serem confirmadas
+    if (this->inflight_used_() > 0)
+    {
+        this->inflight_lock_();
+        bool in_use = false;
+        for (int i = 0; i < MQTT_INFLIGHT_MAX; i++)
+            in_use |= this->inflight_[i].state != INFLIGHT_FREE && this->inflight_[i].handle == handle;
+        this->inflight_unlock_();
+        if (in_use)
         {
-            int tx_bytes = uart_write_bytes(UART_NUM_1, topic[i], strlen(topic[i]));
-            ESP_LOGV("MQTT_SUBSCRIBE", "Wrote %d bytes", tx_bytes);
-            // this->sendCommand("MQTT_SUBSCRIBE", topic[i]);
-            this->wait_response(timeout);
+            ESP_LOGW("MQTT_TOPIC", "Handle %d still has messages in flight", handle);
+            return;
         }
     }
-    this->sendCommand("MQTT_SUBSCRIBE", "AT+CMQTTSUB=0" GSM_NL);
-    return this->wait_response(timeout);
+    free(this->topic_handles_[handle].prefix);
+    this->topic_handles_[handle].prefix = NULL;
+    this->topic_handles_[handle].prefix_len = 0;
 }
 
-bool A7672SA::mqtt_subscribe(const char *topic, uint16_t qos, uint32_t timeout)
+bool A7672SA::mqtt_publish(mqtt_topic_handle handle, const uint8_t *data, size_t len, uint32_t timeout)
 {
+    if (handle < 0 || handle >= MQTT_MAX_TOPIC_HANDLES || this->topic_handles_[handle].prefix == NULL)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Invalid topic handle %d", handle);
+        return false;
+    }
+    if (data == nullptr || len == 0 || len > MQTT_MAX_PAYLOAD_SIZE)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Data is null or length is invalid");
+        return false;
+    }
+
+    const mqtt_topic_entry &entry = this->topic_handles_[handle];
+    if (entry.qos > 0)
+    {
+        volatile int8_t outcome = -1;
+        uint16_t msg_id = this->mqtt_enqueue_(nullptr, handle, data, len, entry.qos, timeout, &outcome);
+        return msg_id != 0 && this->mqtt_wait_outcome_(msg_id, &outcome, timeout);
+    }
+
     if (this->publishing)
         return false;
 
-    const size_t data_size = strlen(topic) + 50;
-    char data_string[data_size];
-    sprintf(data_string, "AT+CMQTTSUB=0,\"%s\",%d" GSM_NL, topic, qos);
-    this->sendCommand("MQTT_SUBSCRIBE", data_string);
-    return this->wait_response(timeout);
+    char cmd[MQTT_PUB_CMD_SIZE];
+    size_t cmd_len = this->mqtt_render_cmd_(cmd, entry.prefix, entry.prefix_len, len);
+    if (!this->mqtt_publish_begin_(cmd, cmd_len, timeout))
+        return false;
+    this->uart_write_chunked_(data, len);
+    return this->mqtt_publish_end_(timeout);
 }
 
-bool A7672SA::mqtt_is_connected()
+bool A7672SA::mqtt_publish_end_(uint32_t timeout)
 {
-    return this->mqtt_connected;
-}
+    this->at_input = false;
+    this->at_ok = false;
+    this->at_error = false;
+    this->http_response = false;
 
-bool A7672SA::is_ready()
-{
-    return this->at_ready;
+    bool ok = this->wait_publish_ack_([this]()
+                                      { return this->at_publish || this->at_error; }, timeout, "MQTT PUBLISH");
+    ok = ok && !this->at_error;
+    this->at_publish = false;
+    this->PUBLISH_UNLOCK();
+
+    if (ok)
+        this->keepalive_check_proven_();
+    return ok;
 }
 
-bool A7672SA::mqtt_release_client(uint32_t timeout)
+// Espera a confirmação de uma publicação; se ela atrasar mais que stall_probe_ms_, sonda a sessão para detectar conexão meio-aberta
+bool A7672SA::wait_publish_ack_(std::function<bool()> done, uint32_t timeout, const char *operation_name)
 {
-    this->sendCommand("MQTT_RELEASE_CLIENT", "AT+CMQTTREL=0" GSM_NL);
-    return this->wait_response(timeout);
+    uint32_t start = millis();
+    uint32_t first = (this->stall_probe_ms_ > 0 && this->stall_probe_ms_ < timeout) ? this->stall_probe_ms_ : timeout;
+    if (wait_for_condition(first, done, operation_name))
+        return true;
+    if (first >= timeout || !this->mqtt_connected)
+        return false;
+
+    if (!this->mqtt_probe_session_())
+        return false;
+
+    uint32_t elapsed = millis() - start;
+    return elapsed < timeout && wait_for_condition(timeout - elapsed, done, operation_name);
 }
 
 /*
-AT+CPING=<dest_addr>,<dest_addr_type>[,<num_pings>[,<data_packet_size>[,<interval_time>[,<wait_time>[,<TTL>]]]]]
-EXAMPLE:
-AT+CPING="www.baidu.com",1,4,64,1000,10000,255
+Um UNSUBSCRIBE passa pela mesma conexão TCP que a publicação atrasada: se o UNSUBACK volta, a sessão está viva
+(só lenta); se não volta no prazo, a conexão está meio-aberta (ex.: NAT descartou o mapeamento) e é derrubada agora,
+em vez de esperar 1.5 x keepalive pelo broker.
 */
-bool A7672SA::ping(const char *host, uint32_t timeout)
+bool A7672SA::mqtt_probe_session_()
 {
-    if (this->publishing)
-        return false;
+    // A sonda cancelaria um AT+COPS=? em curso; sem ela a sessão é tratada como viva
+    if (this->cops_scanning_)
+        return true;
 
-    if (!this->ps_ready())
+    this->probe_err_ = -1;
+    this->sendCommand("MQTT_PROBE", "AT+CMQTTUNSUB=0,\"" MQTT_PROBE_TOPIC "\",0" GSM_NL);
+    if (wait_for_condition(this->probe_deadline_ms_, [this]()
+                           { return this->probe_err_ >= 0; }, "MQTT PROBE"))
     {
-        if (!this->wait_network(15000))
-        {
-            ESP_LOGE("PING", "PS não pronto (sem registro em dados)");
-            return false;
-        }
+        if (this->probe_err_ == 0)
+            return true;
+        ESP_LOGW("MQTT_PROBE", "Unsubscribe failed (err=%d), session lost", this->probe_err_);
     }
+    else
+    {
+        ESP_LOGW("MQTT_PROBE", "No answer in %d ms, half-open session", this->probe_deadline_ms_);
+    }
+    this->mqtt_connected = false;
+    this->conn_update_();
+    this->inflight_requeue_();
+    this->keepalive_session_end_(true);
+    mqtt_status status = A7672SA_MQTT_DISCONNECTED;
+    if (this->on_mqtt_status_ != NULL)
+        this->on_mqtt_status_(status);
+    this->mqtt_disconnect();
+    return false;
+}
 
-    char data[128];
-    sprintf(data, "AT+CPING=\"%s\",1" GSM_NL, host);
-
-    this->sendCommand("PING", data);
-    return this->wait_response(timeout);
+void A7672SA::mqtt_set_stall_probe(uint32_t stall_ms, uint32_t deadline_ms)
+{
+    this->stall_probe_ms_ = stall_ms;
+    this->probe_deadline_ms_ = deadline_ms;
 }
 
-uint32_t A7672SA::http_request(const char *url, HTTP_METHOD method, bool save_to_fs, bool ssl, const char *ca_name,
-                               const char *user_data, size_t user_data_size, uint32_t con_timeout, uint32_t recv_timeout, const char *content,
-                               const char *accept, uint8_t read_mode, const char *data_post, size_t size, uint32_t timeout)
+void A7672SA::mqtt_set_adaptive_keepalive(bool enable, uint16_t min_s, uint16_t max_s)
 {
-    this->sendCommand("HTTP_INIT", "AT+HTTPINIT" GSM_NL);
-    if (this->wait_response(timeout))
-    {
-        char cmd[100];
-        sprintf(cmd, "AT+HTTPPARA=\"URL\",\"%s\"" GSM_NL, url);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
+    this->adaptive_keepalive_ = enable;
+    this->ka_min_ = min_s;
+    this->ka_max_ = max_s < min_s ? min_s : max_s;
+}
 
-        if (ssl)
-        {
-            this->sendCommand("HTTP_SSL", "AT+CSSLCFG=\"sslversion\",0,4" GSM_NL);
-            if (this->wait_response(timeout))
-                this->sendCommand("HTTP_SSL", "AT+CSSLCFG=\"authmode\",0,1" GSM_NL);
-            if (this->wait_response(timeout))
-                this->sendCommand("HTTP_SSL", "AT+CSSLCFG=\"enableSNI\",0,0" GSM_NL);
-            if (this->wait_response(timeout))
-            {
-                sprintf(cmd, "AT+CSSLCFG=\"cacert\",0,\"%s\"" GSM_NL, ca_name);
-                this->sendCommand("HTTP_SSL", cmd);
-                this->wait_response(timeout);
-                this->sendCommand("HTTP_SSL", "AT+HTTPPARA=\"SSLCFG\",0" GSM_NL);
-                this->wait_response(timeout);
-            }
-        }
+uint16_t A7672SA::keepalive_select_(uint16_t requested)
+{
+    if (!this->adaptive_keepalive_)
+        return requested;
+
+    // Chave da rede: operadora numérica + tecnologia de acesso (NVS aceita chaves de até 15 caracteres);
+    // o mqtt_connect limpou current_operator_ e o attach_remember_ reaproveita esta resposta
+    this->sendCommand("MQTT_KEEPALIVE", "AT+COPS=3,2;+COPS?" GSM_NL);
+    this->wait_response(2000);
+    if (this->current_operator_.numeric_code[0] != '\0')
+        snprintf(this->ka_key_, sizeof(this->ka_key_), "ka%.7s_%d", this->current_operator_.numeric_code, this->current_operator_.access_tech);
+    else
+        snprintf(this->ka_key_, sizeof(this->ka_key_), "ka_default");
 
-        sprintf(cmd, "AT+HTTPPARA=\"CONNECTTO\",%d" GSM_NL, con_timeout);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
-        sprintf(cmd, "AT+HTTPPARA=\"RECVTO\",%d" GSM_NL, recv_timeout);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
-        sprintf(cmd, "AT+HTTPPARA=\"CONTENT\",\"%s\"" GSM_NL, content);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
-        sprintf(cmd, "AT+HTTPPARA=\"ACCEPT\",\"%s\"" GSM_NL, accept);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
+    uint16_t start = requested < this->ka_min_ ? this->ka_min_ : (requested > this->ka_max_ ? this->ka_max_ : requested);
+    this->ka_good_ = start;
+    this->ka_ceiling_ = this->ka_max_ + 1;
 
-        if (user_data_size > 0)
+    nvs_handle_t handle;
+    if (nvs_open(A7672SA_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        uint32_t packed = 0;
+        if (nvs_get_u32(handle, this->ka_key_, &packed) == ESP_OK)
         {
-            char data_[user_data_size + 40];
-            sprintf(data_, "AT+HTTPPARA=\"USERDATA\",\"%s\"" GSM_NL, user_data);
-            this->sendCommand("HTTP_REQUEST", data_);
-            this->wait_response(timeout);
+            this->ka_good_ = packed & 0xFFFF;
+            this->ka_ceiling_ = packed >> 16;
         }
+        nvs_close(handle);
+    }
 
-        sprintf(cmd, "AT+HTTPPARA=\"READMODE\",%d" GSM_NL, read_mode);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        if (this->wait_response(timeout))
-        {
-            if (method == HTTP_METHOD::POST)
-            {
-                ESP_LOGV("HTTP_REQUEST", "Sending HTTP POST request");
-                this->at_input = false;
-                sprintf(cmd, "AT+HTTPDATA=%d,%d" GSM_NL, size, timeout);
-                this->sendCommand("HTTP_REQUEST", cmd);
-                if (this->wait_input(timeout))
-                {
-                    this->at_ok = false;
-                    this->send_cmd_to_simcomm("HTTP_REQUEST", (byte *)data_post, size);
-                    if (this->wait_response(timeout))
-                    {
-                        return this->http_response_data.http_status_code;
-                    }
-                }
-            }
+    // Tenta 50% acima do valor comprovado enquanto não encostar no teto conhecido
+    uint32_t candidate = this->ka_good_ * 3 / 2;
+    if (candidate > this->ka_max_)
+        candidate = this->ka_max_;
+    if (candidate >= this->ka_ceiling_)
+        candidate = (this->ka_good_ + this->ka_ceiling_) / 2;
+    if (candidate <= this->ka_good_ + this->ka_good_ / 10)
+        candidate = this->ka_good_; // convergiu
+
+    ESP_LOGI("MQTT_KEEPALIVE", "%s: good=%d ceiling=%d -> %d s", this->ka_key_, this->ka_good_, this->ka_ceiling_, candidate);
+    return candidate;
+}
 
-            ESP_LOGV("HTTP_REQUEST", "Sending HTTP request, http_response:%d", this->http_response);
-            // this->http_response = false;
-            sprintf(cmd, "AT+HTTPACTION=%d" GSM_NL, method);
-            this->sendCommand("HTTP_REQUEST", cmd);
-            if (this->wait_http_response(recv_timeout * 1000))
-            {
-                // this->http_response = false;
-                this->sendCommand("HTTP_REQUEST", "AT+HTTPHEAD" GSM_NL);
-                this->wait_http_response(timeout);
+// A sessão sobreviveu a dois ciclos completos de keepalive: o valor passa pelo NAT da rede.
+// Não olha mqtt_connected: no fim da sessão a flag já foi limpa, e a idade é o que conta
+void A7672SA::keepalive_check_proven_()
+{
+    if (!this->adaptive_keepalive_ || this->session_proven_ || this->session_keepalive_ == 0)
+        return;
+    if (millis() - this->session_start_ < 2000UL * this->session_keepalive_)
+        return;
 
-                if (save_to_fs)
-                {
-                    this->http_save_response(ssl);
-                    this->wait_response(timeout);
-                }
+    this->session_proven_ = true;
+    if (this->session_keepalive_ > this->ka_good_)
+    {
+        this->ka_good_ = this->session_keepalive_;
+        this->keepalive_store_();
+    }
+}
 
-                return this->http_response_data.http_status_code;
-            }
+void A7672SA::keepalive_session_end_(bool lost)
+{
+    if (!this->adaptive_keepalive_ || this->session_keepalive_ == 0)
+        return;
+
+    this->keepalive_check_proven_();
+    if (lost && !this->session_proven_)
+    {
+        if (this->session_keepalive_ > this->ka_good_)
+        {
+            // o valor em teste não passou pelo NAT: vira o novo teto
+            this->ka_ceiling_ = this->session_keepalive_;
+        }
+        else if (this->ka_good_ > this->ka_min_)
+        {
+            // caiu até com o valor comprovado: recua um pouco (pode ser só cobertura ruim)
+            this->ka_good_ = this->ka_good_ * 3 / 4 < this->ka_min_ ? this->ka_min_ : this->ka_good_ * 3 / 4;
         }
+        this->keepalive_store_();
     }
-    return 0;
+    this->session_keepalive_ = 0;
 }
 
-uint32_t A7672SA::http_request_file(const char *url, HTTP_METHOD method, const char *filename, bool ssl, const char *ca_name,
-                                    const char *user_data, size_t user_data_size, uint32_t con_timeout, uint32_t recv_timeout,
-                                    const char *content, const char *accept, uint8_t read_mode, const char *data_post, size_t size, uint32_t timeout)
+void A7672SA::keepalive_store_()
 {
-    char cmd[100];
-    sprintf(cmd, "AT+FSOPEN=C:/%s,0" GSM_NL, filename);
-    this->sendCommand("FS", cmd);
-    this->wait_response(timeout);
-    this->sendCommand("FS", "AT+FSCLOSE=1" GSM_NL);
-    this->wait_response(timeout);
-    this->sendCommand("HTTP_INIT", "AT+HTTPINIT" GSM_NL);
-    if (this->wait_response(timeout))
+    nvs_handle_t handle;
+    if (nvs_open(A7672SA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
     {
-        sprintf(cmd, "AT+HTTPPARA=\"URL\",\"%s\"" GSM_NL, url);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
+        ESP_LOGW("MQTT_KEEPALIVE", "Failed to open NVS");
+        return;
+    }
+    uint32_t packed = ((uint32_t)this->ka_ceiling_ << 16) | this->ka_good_;
+    if (nvs_set_u32(handle, this->ka_key_, packed) == ESP_OK)
+        nvs_commit(handle);
+    nvs_close(handle);
+    ESP_LOGI("MQTT_KEEPALIVE", "%s: good=%d ceiling=%d", this->ka_key_, this->ka_good_, this->ka_ceiling_);
+}
+
+// Escreve em blocos e espera cada um sair da FIFO, para não atropelar o modem com payloads grandes
+size_t A7672SA::uart_write_chunked_(const uint8_t *data, size_t len)
+{
+    size_t written = 0;
+    while (written < len && uart_is_driver_installed(UART_NUM_1))
+    {
+        size_t n = len - written < UART_TX_CHUNK_SIZE ? len - written : UART_TX_CHUNK_SIZE;
+        int tx = uart_write_bytes(UART_NUM_1, data + written, n);
+        if (tx <= 0)
+            break;
+        written += tx;
+        uart_wait_tx_done(UART_NUM_1, pdMS_TO_TICKS(100));
+    }
+#ifdef DEBUG_LTE
+    ESP_LOGV("UART_WRITE", "Wrote %d bytes of %d requested", written, len);
+#endif
+    return written;
+}
+
+// Escreve len bytes lidos de reader em blocos de UART_TX_CHUNK_SIZE (depois de um prompt '>'/DOWNLOAD)
+bool A7672SA::uart_write_stream_(payload_reader reader, size_t len, uint32_t *chunks, const char *name)
+{
+    uint8_t chunk[UART_TX_CHUNK_SIZE];
+    size_t offset = 0;
+    bool reader_ok = true;
+    while (offset < len)
+    {
+        size_t want = len - offset < sizeof(chunk) ? len - offset : sizeof(chunk);
+        int got = reader_ok ? reader(chunk, want, offset) : 0;
+        if (got <= 0)
+        {
+            // O modem espera exatamente len bytes: completa com zeros para não engolir os próximos comandos AT
+            if (reader_ok)
+                ESP_LOGE(name, "Reader failed at offset %d of %d", offset, len);
+            reader_ok = false;
+            memset(chunk, 0, want);
+            got = want;
+        }
+        if ((size_t)got > want)
+            got = want;
+        this->uart_write_chunked_(chunk, got);
+        offset += got;
+        if (chunks != nullptr)
+            (*chunks)++;
+    }
+    return reader_ok;
+}
+
+uint16_t A7672SA::mqtt_publish_async(const char *topic, const uint8_t *data, size_t len, uint16_t qos, uint32_t timeout)
+{
+    if (topic == nullptr || strlen(topic) > MQTT_TOPIC_MAX_LEN)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Topic is null or too long");
+        return 0;
+    }
+    if (qos == 0)
+    {
+        // QoS 0 não tem confirmação do broker, não há o que rastrear
+        if (!this->mqtt_publish(topic, (uint8_t *)data, len, 0, timeout))
+            return 0;
+        this->inflight_lock_();
+        uint16_t msg_id = this->next_msg_id_();
+        this->inflight_unlock_();
+        return msg_id;
+    }
+    return this->mqtt_enqueue_(topic, -1, data, len, qos, timeout);
+}
+
+// QoS 1/2 síncrono: a mensagem entra na tabela em voo (reenvio após NACK/reconexão) e o chamador espera o desfecho
+bool A7672SA::mqtt_publish_tracked_(const char *topic, payload_reader reader, size_t len, uint16_t qos, uint32_t timeout)
+{
+    if (topic == nullptr || strlen(topic) > MQTT_TOPIC_MAX_LEN)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Topic is null or too long");
+        return false;
+    }
+    volatile int8_t outcome = -1;
+    uint16_t msg_id = this->mqtt_enqueue_reader_(topic, -1, reader, len, qos, timeout, &outcome);
+    return msg_id != 0 && this->mqtt_wait_outcome_(msg_id, &outcome, timeout);
+}
+
+uint16_t A7672SA::mqtt_enqueue_(const char *topic, mqtt_topic_handle handle, const uint8_t *data, size_t len, uint16_t qos, uint32_t timeout,
+                               volatile int8_t *outcome)
+{
+    if (data == nullptr)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Data is null");
+        return 0;
+    }
+    return this->mqtt_enqueue_reader_(topic, handle, [data](uint8_t *buffer, size_t max_len, size_t offset)
+                                      {
+                                          memcpy(buffer, data + offset, max_len);
+                                          return (int)max_len; },
+                                      len, qos, timeout, outcome);
+}
+
+// O payload é lido de reader para a cópia da própria tabela (o chamador não precisa mantê-lo vivo)
+uint16_t A7672SA::mqtt_enqueue_reader_(const char *topic, mqtt_topic_handle handle, payload_reader reader, size_t len, uint16_t qos,
+                                      uint32_t timeout, volatile int8_t *outcome)
+{
+    if (!reader || len == 0 || len > MQTT_MAX_PAYLOAD_SIZE)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Reader is null or length is invalid (%d)", len);
+        return 0;
+    }
+    if (qos > 2)
+        qos = 2;
+
+    // Janela cheia e a mensagem mais antiga parada há mais de stall_probe_ms_: confirma se a sessão ainda existe
+    int oldest = this->inflight_oldest_(INFLIGHT_SENT);
+    if (oldest >= 0 && this->stall_probe_ms_ > 0 && this->mqtt_connected && this->inflight_used_() >= this->inflight_window_ &&
+        millis() - this->inflight_[oldest].sent_at > this->stall_probe_ms_)
+    {
+        this->mqtt_probe_session_();
+    }
+
+    if (!wait_for_condition(timeout, [this]()
+                            { return this->inflight_used_() < this->inflight_window_; }, "MQTT INFLIGHT WINDOW"))
+    {
+        ESP_LOGW("MQTT_PUBLISH", "Inflight window full (%d)", this->inflight_window_);
+        return 0;
+    }
+
+    char *topic_copy = topic != nullptr ? strdup(topic) : NULL;
+    uint8_t *payload_copy = (uint8_t *)malloc(len);
+    if ((topic != nullptr && topic_copy == NULL) || payload_copy == NULL)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "Failed to allocate inflight message (%d bytes)", len);
+        free(topic_copy);
+        free(payload_copy);
+        return 0;
+    }
+    for (size_t got = 0; got < len;)
+    {
+        int n = reader(payload_copy + got, len - got, got);
+        if (n <= 0)
+        {
+            ESP_LOGE("MQTT_PUBLISH", "Reader stopped at %d of %d bytes", got, len);
+            free(topic_copy);
+            free(payload_copy);
+            return 0;
+        }
+        got += n;
+    }
+
+    this->inflight_lock_();
+    int idx = -1;
+    for (int i = 0; i < MQTT_INFLIGHT_MAX && idx < 0; i++)
+    {
+        if (this->inflight_[i].state == INFLIGHT_FREE)
+            idx = i;
+    }
+    if (idx < 0)
+    {
+        this->inflight_unlock_();
+        free(topic_copy);
+        free(payload_copy);
+        return 0;
+    }
+    uint16_t msg_id = this->next_msg_id_();
+
+    mqtt_inflight_slot &slot = this->inflight_[idx];
+    slot.msg_id = msg_id;
+    slot.qos = qos;
+    slot.retries = 0;
+    slot.handle = handle;
+    slot.outcome = outcome;
+    slot.topic = topic_copy;
+    slot.payload = payload_copy;
+    slot.length = len;
+    slot.sent_at = 0;
+    slot.state = INFLIGHT_QUEUED;
+    this->inflight_unlock_();
+
+    // Desconectado: a mensagem fica na tabela e sai no mqtt_replay_inflight() após o próximo CONNECT
+    if (this->mqtt_connected)
+        this->mqtt_replay_inflight(timeout);
+
+    return msg_id;
+}
+
+/*
+Espera o desfecho de uma publicação QoS 1/2 síncrona. Um NACK devolve a mensagem para INFLIGHT_QUEUED e ninguém
+mais a reenviaria antes da próxima publicação, então o próprio chamador a reenvia. No timeout a mensagem continua
+na tabela para reenvio, mas o outcome (na pilha do chamador) é desligado do slot.
+*/
+bool A7672SA::mqtt_wait_outcome_(uint16_t msg_id, volatile int8_t *outcome, uint32_t timeout)
+{
+    uint32_t start = millis();
+    while (*outcome < 0)
+    {
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= timeout)
+            break;
+        bool woke = wait_publish_ack_([this, outcome]()
+                                      { return *outcome >= 0 || (this->mqtt_connected && this->inflight_oldest_(INFLIGHT_QUEUED) >= 0); },
+                                      timeout - elapsed, "MQTT PUBLISH ACK");
+        if (!woke || *outcome >= 0)
+            break;
+        elapsed = millis() - start;
+        if (elapsed >= timeout || !this->mqtt_replay_inflight(timeout - elapsed))
+            break;
+    }
+
+    this->inflight_lock_();
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        if (this->inflight_[i].outcome == outcome)
+            this->inflight_[i].outcome = nullptr;
+    }
+    this->inflight_unlock_();
+
+    if (*outcome < 0)
+        ESP_LOGW("MQTT_PUBLISH", "msg %u sem confirmação, mantida para reenvio", msg_id);
+    return *outcome == 1;
+}
+
+bool A7672SA::mqtt_replay_inflight(uint32_t timeout)
+{
+    // Envia as mensagens pendentes da mais antiga para a mais nova, preservando a ordem de publicação
+    int idx;
+    while ((idx = this->inflight_oldest_(INFLIGHT_QUEUED)) >= 0)
+    {
+        if (!this->mqtt_connected)
+            return false;
+        if (!this->mqtt_send_slot_(idx, timeout))
+        {
+            ESP_LOGW("MQTT_REPLAY", "Failed to send msg %u", this->inflight_[idx].msg_id);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool A7672SA::mqtt_send_slot_(int idx, uint32_t timeout)
+{
+    this->operator_scan_cancel();
+    if (!this->PUBLISH_LOCK(timeout))
+    {
+        ESP_LOGW("MQTT_PUBLISH", "LTE publish lock timeout");
+        return false;
+    }
+
+    mqtt_inflight_slot &slot = this->inflight_[idx];
+    char cmd[MQTT_PUB_CMD_SIZE];
+    size_t cmd_len = 0;
+    if (slot.handle >= 0 && this->topic_handles_[slot.handle].prefix != NULL)
+    {
+        const mqtt_topic_entry &entry = this->topic_handles_[slot.handle];
+        cmd_len = this->mqtt_render_cmd_(cmd, entry.prefix, entry.prefix_len, slot.length);
+    }
+    else if (slot.topic != NULL)
+    {
+        size_t prefix_len = this->mqtt_render_prefix_(cmd, sizeof(cmd), slot.topic, slot.qos);
+        cmd_len = this->mqtt_render_cmd_(cmd, cmd, prefix_len, slot.length);
+    }
+    if (cmd_len == 0)
+    {
+        ESP_LOGE("MQTT_PUBLISH", "msg %u has no topic", slot.msg_id);
+        this->PUBLISH_UNLOCK();
+        return false;
+    }
+    if (!this->ack_wait_qos_(slot.qos, timeout))
+    {
+        ESP_LOGW("MQTT_PUBLISH", "msg %u: acks of another QoS still pending", slot.msg_id);
+        this->PUBLISH_UNLOCK();
+        return false;
+    }
+
+    this->at_input = false;
+    this->sendCommand("MQTT_PUBLISH_CMD", (uint8_t *)cmd, cmd_len);
+    bool ok = false;
+    if (this->wait_input(timeout))
+    {
+        this->inflight_lock_();
+        ok = this->ack_push_((int8_t)idx, slot.qos);
+        if (ok)
+        {
+            slot.state = INFLIGHT_SENT;
+            slot.sent_at = millis();
+        }
+        this->inflight_unlock_();
+        // o modem já está esperando o payload, então ele é enviado mesmo sem espaço no fifo
+        this->uart_write_chunked_(slot.payload, slot.length);
+    }
+
+    this->PUBLISH_UNLOCK();
+    return ok;
+}
+
+void A7672SA::handle_publish_ack_(int err)
+{
+    this->inflight_lock_();
+    int8_t entry = this->ack_pop_();
+    if (entry == MQTT_ACK_SYNC)
+    {
+        this->inflight_unlock_();
+        // publicação síncrona (mqtt_publish QoS 0)
+        if (err == 0)
+            this->at_publish = true;
+        else
+            this->at_error = true;
+        return;
+    }
+
+    mqtt_inflight_slot &slot = this->inflight_[entry];
+    uint16_t msg_id = slot.msg_id;
+    bool completed = false;
+    bool delivered = false;
+    if (err == 0)
+    {
+        this->inflight_release_(entry, true);
+        completed = delivered = true;
+    }
+    else if (++slot.retries >= MQTT_INFLIGHT_MAX_RETRIES)
+    {
+        ESP_LOGW("MQTT_PUBLISH", "msg %u dropped after %d retries (err=%d)", msg_id, slot.retries, err);
+        this->inflight_release_(entry, false);
+        completed = true;
+    }
+    else
+    {
+        slot.state = INFLIGHT_QUEUED;
+    }
+    this->inflight_unlock_();
+
+    if (completed && this->on_publish_complete_ != nullptr)
+        this->on_publish_complete_(msg_id, delivered);
+}
+
+void A7672SA::mqtt_set_inflight_window(uint8_t window)
+{
+    if (window < 1)
+        window = 1;
+    if (window > MQTT_INFLIGHT_MAX)
+        window = MQTT_INFLIGHT_MAX;
+    this->inflight_window_ = window;
+}
+
+uint8_t A7672SA::mqtt_inflight_count()
+{
+    return this->inflight_used_();
+}
+
+void A7672SA::inflight_lock_()
+{
+    if (this->inflight_guard != NULL)
+        xSemaphoreTake(this->inflight_guard, portMAX_DELAY);
+}
+
+void A7672SA::inflight_unlock_()
+{
+    if (this->inflight_guard != NULL)
+        xSemaphoreGive(this->inflight_guard);
+}
+
+int A7672SA::inflight_find_(uint16_t msg_id)
+{
+    int idx = -1;
+    this->inflight_lock_();
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        if (this->inflight_[i].state != INFLIGHT_FREE && this->inflight_[i].msg_id == msg_id)
+            idx = i;
+    }
+    this->inflight_unlock_();
+    return idx;
+}
+
+int A7672SA::inflight_oldest_(mqtt_inflight_state state)
+{
+    int idx = -1;
+    this->inflight_lock_();
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        if (this->inflight_[i].state != state)
+            continue;
+        // comparação com wrap-around do id de 16 bits
+        if (idx < 0 || (int16_t)(this->inflight_[i].msg_id - this->inflight_[idx].msg_id) < 0)
+            idx = i;
+    }
+    this->inflight_unlock_();
+    return idx;
+}
+
+uint8_t A7672SA::inflight_used_()
+{
+    uint8_t used = 0;
+    this->inflight_lock_();
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        if (this->inflight_[i].state != INFLIGHT_FREE)
+            used++;
+    }
+    this->inflight_unlock_();
+    return used;
+}
+
+// chamar com inflight_guard tomado; 0 fica reservado para "falhou"
+uint16_t A7672SA::next_msg_id_()
+{
+    uint16_t msg_id = this->msg_id_seq_++;
+    if (this->msg_id_seq_ == 0)
+        this->msg_id_seq_ = 1;
+    return msg_id;
+}
+
+// chamar com inflight_guard tomado
+void A7672SA::inflight_release_(int idx, bool delivered)
+{
+    mqtt_inflight_slot &slot = this->inflight_[idx];
+    free(slot.topic);
+    free(slot.payload);
+    slot.topic = NULL;
+    slot.payload = NULL;
+    slot.length = 0;
+    if (slot.outcome != nullptr)
+        *slot.outcome = delivered ? 1 : 0;
+    slot.outcome = nullptr;
+    slot.state = INFLIGHT_FREE;
+}
+
+void A7672SA::inflight_requeue_()
+{
+    // Nova sessão: tudo que estava aguardando ack volta para a fila de reenvio (QoS 1 pode duplicar, como manda o protocolo)
+    this->inflight_lock_();
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++)
+    {
+        if (this->inflight_[i].state == INFLIGHT_SENT)
+            this->inflight_[i].state = INFLIGHT_QUEUED;
+    }
+    this->ack_head_ = 0;
+    this->ack_count_ = 0;
+    this->inflight_unlock_();
+}
+
+// chamar com inflight_guard tomado
+bool A7672SA::ack_push_(int8_t entry, uint8_t qos)
+{
+    const uint8_t capacity = sizeof(this->ack_fifo_) / sizeof(this->ack_fifo_[0]);
+    if (this->ack_count_ >= capacity)
+    {
+        ESP_LOGW("MQTT_PUBLISH", "ACK fifo full");
+        return false;
+    }
+    this->ack_fifo_[(this->ack_head_ + this->ack_count_) % capacity] = entry;
+    this->ack_count_++;
+    this->ack_qos_ = qos;
+    return true;
+}
+
+// chamar com inflight_guard tomado; fifo vazio conta como publicação síncrona (comportamento antigo)
+int8_t A7672SA::ack_pop_()
+{
+    const uint8_t capacity = sizeof(this->ack_fifo_) / sizeof(this->ack_fifo_[0]);
+    if (this->ack_count_ == 0)
+        return MQTT_ACK_SYNC;
+    int8_t entry = this->ack_fifo_[this->ack_head_];
+    this->ack_head_ = (this->ack_head_ + 1) % capacity;
+    this->ack_count_--;
+    return entry;
+}
+
+/*
+Chamar com o PUBLISH_LOCK tomado, antes do AT+CMQTTPUB. Os acks de QoS diferentes não chegam na ordem de envio,
+então uma publicação só entra no fifo quando ele está vazio ou só tem entradas do mesmo QoS.
+*/
+bool A7672SA::ack_wait_qos_(uint8_t qos, uint32_t timeout)
+{
+    return this->wait_for_condition(timeout, [this, qos]()
+                                    {
+                                        this->inflight_lock_();
+                                        bool ready = this->ack_count_ == 0 || this->ack_qos_ == qos;
+                                        this->inflight_unlock_();
+                                        return ready; },
+                                    "MQTT_ACK_QOS");
+}
+
+bool A7672SA::mqtt_subscribe_topics(const char *topic[10], int n_topics, uint16_t qos, uint32_t timeout)
+{
+    seq_scope seq(*this);
+    if (this->publishing)
+        return false;
+
+    for (int i = 0; i < n_topics; i++)
+    {
+        const size_t data_size = strlen(topic[i]) + 50;
+        char data_string[data_size];
+        this->at_input = false;
+        sprintf(data_string, "AT+CMQTTSUBTOPIC=0,%d,%d" GSM_NL, strlen(topic[i]), qos);
+        this->sendCommand("MQTT_SUBSCRIBE", data_string);
+        if (this->wait_input(timeout))
+        {
+            int tx_bytes = uart_write_bytes(UART_NUM_1, topic[i], strlen(topic[i]));
+            ESP_LOGV("MQTT_SUBSCRIBE", "Wrote %d bytes", tx_bytes);
+            // this->sendCommand("MQTT_SUBSCRIBE", topic[i]);
+            this->wait_response(timeout);
+        }
+    }
+    this->sendCommand("MQTT_SUBSCRIBE", "AT+CMQTTSUB=0" GSM_NL);
+    return this->wait_response(timeout);
+}
+
+bool A7672SA::mqtt_subscribe(const char *topic, uint16_t qos, uint32_t timeout)
+{
+    if (this->publishing)
+        return false;
+
+    const size_t data_size = strlen(topic) + 50;
+    char data_string[data_size];
+    sprintf(data_string, "AT+CMQTTSUB=0,\"%s\",%d" GSM_NL, topic, qos);
+    this->operator_scan_cancel();
+    this->sendCommand("MQTT_SUBSCRIBE", data_string);
+    return this->wait_response(timeout);
+}
+
+bool A7672SA::mqtt_is_connected()
+{
+    return this->mqtt_connected;
+}
+
+bool A7672SA::is_ready()
+{
+    return this->at_ready;
+}
+
+bool A7672SA::mqtt_release_client(uint32_t timeout)
+{
+    this->sendCommand("MQTT_RELEASE_CLIENT", "AT+CMQTTREL=0" GSM_NL);
+    return this->wait_response(timeout);
+}
+
+/*
+AT+CPING=<dest_addr>,<dest_addr_type>[,<num_pings>[,<data_packet_size>[,<interval_time>[,<wait_time>[,<TTL>]]]]]
+EXAMPLE:
+AT+CPING="www.baidu.com",1,4,64,1000,10000,255
+*/
+bool A7672SA::ping(const char *host, uint32_t timeout)
+{
+    if (this->publishing)
+        return false;
+
+    this->operator_scan_cancel();
+    if (!this->ps_ready())
+    {
+        if (!this->wait_network(15000))
+        {
+            ESP_LOGE("PING", "PS não pronto (sem registro em dados)");
+            return false;
+        }
+    }
+
+    char data[128];
+    sprintf(data, "AT+CPING=\"%s\",1" GSM_NL, host);
+
+    this->sendCommand("PING", data);
+    return this->wait_response(timeout);
+}
+
+uint32_t A7672SA::http_request(const char *url, HTTP_METHOD method, bool save_to_fs, bool ssl, const char *ca_name,
+                               const char *user_data, size_t user_data_size, uint32_t con_timeout, uint32_t recv_timeout, const char *content,
+                               const char *accept, uint8_t read_mode, const char *data_post, size_t size, uint32_t timeout)
+{
+    if (!this->http_scratch_.build(url, method, ssl, ca_name, user_data_size > 0 ? user_data : "", con_timeout, recv_timeout, content, accept, read_mode))
+        return 0;
+    data_segment body = {(const uint8_t *)data_post, size};
+    return this->http_request(this->http_scratch_, &body, 1, save_to_fs, timeout);
+}
+
+uint32_t A7672SA::http_post(const char *url, const data_segment *body, size_t n_segments, bool ssl, const char *ca_name,
+                            const char *user_data, size_t user_data_size, const char *content, uint32_t timeout)
+{
+    if (!this->http_scratch_.build(url, HTTP_METHOD::POST, ssl, ca_name, user_data_size > 0 ? user_data : "", 120, 120, content))
+        return 0;
+    return this->http_request(this->http_scratch_, body, n_segments, false, timeout);
+}
+
+// Abre a entrada do corpo com AT+HTTPDATA; o prazo do modem (em segundos) cobre o tempo de UART do corpo inteiro
+bool A7672SA::http_data_begin_(size_t size, uint32_t timeout)
+{
+    uint32_t seconds = timeout / 1000 + (uint32_t)((uint64_t)size * 10 / this->baud_rate_) + 1;
+    if (seconds > 1000)
+        seconds = 1000;
+
+    char cmd[48];
+    this->at_input = false;
+    sprintf(cmd, "AT+HTTPDATA=%d,%d" GSM_NL, size, seconds);
+    this->sendCommand("HTTP_REQUEST", cmd);
+    if (!this->wait_input(timeout))
+        return false;
+    this->at_ok = false;
+    return true;
+}
+
+bool A7672SA::http_send_body_(const data_segment *body, size_t n_segments, uint32_t timeout)
+{
+    size_t size = 0;
+    for (size_t i = 0; body != nullptr && i < n_segments; i++)
+        size += body[i].len;
+
+    if (!this->http_data_begin_(size, timeout))
+        return false;
+    for (size_t i = 0; i < n_segments; i++)
+        this->uart_write_chunked_(body[i].data, body[i].len);
+    return this->wait_response(timeout);
+}
+
+// Dispara a requisição (HTTPACTION/HTTPPOSTFILE), espera o resultado e lê os cabeçalhos. Retorna o status HTTP ou 0.
+uint32_t A7672SA::http_action_(const char *cmd, uint32_t recv_timeout, uint32_t timeout)
+{
+    this->sendCommand("HTTP_REQUEST", cmd);
+    if (!this->wait_http_response(recv_timeout * 1000))
+        return 0;
+
+    // 304 Not Modified não tem corpo: nada a ler nem salvar
+    this->http_header_count_ = 0;
+    if (this->http_response_data.http_status_code == 304)
+        return 304;
+
+    this->http_read_headers_(timeout);
+    return this->http_response_data.http_status_code;
+}
+
+// +HTTPHEAD: <n>\r\n<cabeçalhos>\r\nOK — lê o bloco inteiro e indexa (nome, valor) uma única vez
+bool A7672SA::http_read_headers_(uint32_t timeout)
+{
+    // validadores de uma resposta anterior não podem vazar para esta
+    this->http_response_data.http_etag[0] = '\0';
+    this->http_response_data.http_last_modified[0] = '\0';
+    this->http_response_data.http_range_start = 0;
+    this->http_response_data.http_range_total = 0;
+
+    int len = this->read_framed_("AT+HTTPHEAD" GSM_NL, "+HTTPHEAD: ", "OK", (uint8_t *)this->http_header_buf_, HTTP_HEADER_BUF_SIZE, timeout);
+    if (len == -3) // cabeçalhos além do buffer: indexa os que couberam
+        len = HTTP_HEADER_BUF_SIZE;
+    if (len <= 0)
+        return false;
+
+    this->http_response_data.http_header_size = len;
+    this->http_parse_headers_(len);
+
+    const char *value = this->http_header("Content-Length");
+    if (value != nullptr)
+        this->http_response_data.http_content_size = strtoul(value, NULL, 10);
+
+    value = this->http_header("ETag");
+    if (value != nullptr)
+    {
+        // W/"abc" ou "abc" -> abc
+        if (strncmp(value, "W/", 2) == 0)
+            value += 2;
+        if (*value == '"')
+            value++;
+        size_t n = strcspn(value, "\"");
+        if (n >= sizeof(this->http_response_data.http_etag))
+            n = sizeof(this->http_response_data.http_etag) - 1;
+        memcpy(this->http_response_data.http_etag, value, n);
+        this->http_response_data.http_etag[n] = '\0';
+    }
+
+    value = this->http_header("Content-Range");
+    if (value != nullptr)
+    {
+        unsigned int first = 0, last = 0, total = 0;
+        if (sscanf(value, "bytes %u-%u/%u", &first, &last, &total) >= 2)
+        {
+            this->http_response_data.http_range_start = first;
+            this->http_response_data.http_range_total = total;
+        }
+    }
+
+    value = this->http_header("Last-Modified");
+    if (value != nullptr)
+    {
+        strncpy(this->http_response_data.http_last_modified, value, sizeof(this->http_response_data.http_last_modified) - 1);
+        this->http_response_data.http_last_modified[sizeof(this->http_response_data.http_last_modified) - 1] = '\0';
+    }
+
+    ESP_LOGV("HTTP_HEADERS", "%d headers, CONTENT_LENGTH: %d, ETAG: %s", this->http_header_count_,
+             this->http_response_data.http_content_size, this->http_response_data.http_etag);
+    return true;
+}
+
+// Quebra o bloco em linhas no próprio buffer: nomes e valores viram strings terminadas em '\0' apontando para ele
+void A7672SA::http_parse_headers_(size_t len)
+{
+    this->http_header_count_ = 0;
+    char *p = this->http_header_buf_;
+    char *end = p + len;
+    *end = '\0';
+
+    while (p < end)
+    {
+        char *eol = (char *)memchr(p, '\n', end - p);
+        if (eol == nullptr)
+            eol = end;
+        char *line_end = eol;
+        while (line_end > p && (line_end[-1] == '\r' || line_end[-1] == ' ' || line_end[-1] == '\t'))
+            line_end--;
+        *line_end = '\0';
+
+        char *colon = strchr(p, ':');
+        if (colon != nullptr && strncmp(p, "HTTP/", 5) != 0)
+        {
+            if (this->http_header_count_ == HTTP_MAX_HEADERS)
+            {
+                ESP_LOGW("HTTP_HEADERS", "More than %d headers, ignoring the rest", HTTP_MAX_HEADERS);
+                break;
+            }
+            char *name_end = colon;
+            while (name_end > p && name_end[-1] == ' ')
+                name_end--;
+            *name_end = '\0';
+            char *value = colon + 1;
+            while (*value == ' ' || *value == '\t')
+                value++;
+            this->http_headers_[this->http_header_count_].name = p;
+            this->http_headers_[this->http_header_count_].value = value;
+            this->http_header_count_++;
+        }
+        p = eol + 1;
+    }
+}
+
+const char *A7672SA::http_header(const char *name) const
+{
+    for (uint8_t i = 0; i < this->http_header_count_; i++)
+    {
+        if (strcasecmp(this->http_headers_[i].name, name) == 0)
+            return this->http_headers_[i].value;
+    }
+    return nullptr;
+}
+
+bool A7672SA::http_header_at(uint8_t index, const char **name, const char **value) const
+{
+    if (index >= this->http_header_count_)
+        return false;
+    *name = this->http_headers_[index].name;
+    *value = this->http_headers_[index].value;
+    return true;
+}
+
+uint32_t A7672SA::http_request(const http_request_desc &request, const data_segment *body, size_t n_segments, bool save_to_fs, uint32_t timeout)
+{
+    seq_scope seq(*this);
+    if (request.used == 0 || !this->http_configure_(request, timeout))
+        return 0;
+
+    if (request.method == HTTP_METHOD::POST)
+    {
+        ESP_LOGV("HTTP_REQUEST", "Sending HTTP POST body");
+        if (!this->http_send_body_(body, n_segments, timeout))
+            return 0;
+    }
+
+    ESP_LOGV("HTTP_REQUEST", "Sending HTTP request, http_response:%d", this->http_response);
+    uint32_t status = this->http_action_(request.arena + request.action, request.recv_timeout, timeout);
+    if (status != 0 && status != 304 && save_to_fs)
+    {
+        this->http_save_response(request.ssl);
+        this->wait_response(timeout);
+    }
+    return status;
+}
+
+uint32_t A7672SA::http_post_stream(const char *url, size_t total, payload_reader producer, bool ssl, const char *ca_name,
+                                   const char *user_data, size_t user_data_size, uint32_t con_timeout, uint32_t recv_timeout,
+                                   const char *content, transfer_stats *stats, uint32_t timeout)
+{
+    seq_scope seq(*this);
+    if (!producer || total == 0 ||
+        !this->http_scratch_.build(url, HTTP_METHOD::POST, ssl, ca_name, user_data_size > 0 ? user_data : "", con_timeout, recv_timeout, content))
+        return 0;
+
+    transfer_stats local = {};
+    uint32_t start = millis();
+    uint32_t status = 0;
+    bool producer_ok = false;
+    bool staged = total > HTTP_DATA_MAX_SIZE;
+
+    if (staged)
+    {
+        // corpo maior que o buffer do HTTPDATA: passa primeiro pelo sistema de arquivos do modem
+        char cmd[64];
+        sprintf(cmd, "AT+CFTRANRX=\"c:/%s\",%d" GSM_NL, HTTP_UPLOAD_FILE, total);
+        this->fs_invalidate_();
+        this->at_input = false;
+        this->sendCommand("HTTP_UPLOAD", cmd);
+        if (this->wait_input(timeout))
+        {
+            this->at_ok = false;
+            producer_ok = this->uart_write_stream_(producer, total, &local.chunks, "HTTP_UPLOAD");
+            uint32_t uart_ms = (uint32_t)((uint64_t)total * 10 * 1000 / this->baud_rate_);
+            if (this->wait_response(timeout + uart_ms) && producer_ok && this->http_configure_(this->http_scratch_, timeout))
+            {
+                sprintf(cmd, "AT+HTTPPOSTFILE=\"%s\",1,%d,1" GSM_NL, HTTP_UPLOAD_FILE, this->http_scratch_.method);
+                status = this->http_action_(cmd, recv_timeout, timeout);
+            }
+        }
+        // o CFTRANRX pode ter criado o arquivo mesmo que o envio tenha falhado em qualquer passo acima
+        if (!this->fs_delete(HTTP_UPLOAD_FILE, timeout))
+            ESP_LOGW("HTTP_UPLOAD", "Could not delete %s", HTTP_UPLOAD_FILE);
+    }
+    else if (this->http_configure_(this->http_scratch_, timeout) && this->http_data_begin_(total, timeout))
+    {
+        producer_ok = this->uart_write_stream_(producer, total, &local.chunks, "HTTP_UPLOAD");
+        uint32_t uart_ms = (uint32_t)((uint64_t)total * 10 * 1000 / this->baud_rate_);
+        if (this->wait_response(timeout + uart_ms) && producer_ok)
+            status = this->http_action_("AT+HTTPACTION=1" GSM_NL, recv_timeout, timeout);
+    }
+
+    local.bytes = producer_ok ? total : 0;
+    local.elapsed_ms = millis() - start;
+    local.bytes_per_s = local.elapsed_ms ? (uint32_t)((uint64_t)local.bytes * 1000 / local.elapsed_ms) : 0;
+    ESP_LOGI("HTTP_UPLOAD", "%d bytes %s in %d ms (%d B/s), status %d", total, staged ? "via FS" : "via HTTPDATA",
+             local.elapsed_ms, local.bytes_per_s, status);
+    if (stats != nullptr)
+        *stats = local;
+    return status;
+}
+
+uint32_t A7672SA::http_request_file(const char *url, HTTP_METHOD method, const char *filename, bool ssl, const char *ca_name,
+                                    const char *user_data, size_t user_data_size, uint32_t con_timeout, uint32_t recv_timeout,
+                                    const char *content, const char *accept, uint8_t read_mode, const char *data_post, size_t size, uint32_t timeout)
+{
+    seq_scope seq(*this);
+    if (!this->http_scratch_.build(url, method, ssl, ca_name, user_data_size > 0 ? user_data : "", con_timeout, recv_timeout, content, accept, read_mode))
+        return 0;
+
+    char cmd[128];
+    if (snprintf(cmd, sizeof(cmd), "AT+HTTPPOSTFILE=\"%s\",1,%d,1" GSM_NL, filename, method) >= (int)sizeof(cmd))
+    {
+        ESP_LOGE("HTTP_REQUEST", "File name too long: %s", filename);
+        return 0;
+    }
+
+    char open_cmd[128];
+    snprintf(open_cmd, sizeof(open_cmd), "AT+FSOPEN=C:/%s,0" GSM_NL, filename);
+    this->fs_invalidate_();
+    this->sendCommand("FS", open_cmd);
+    this->wait_response(timeout);
+    this->sendCommand("FS", "AT+FSCLOSE=1" GSM_NL);
+    this->wait_response(timeout);
+    if (this->http_configure_(this->http_scratch_, timeout))
+    {
+        ESP_LOGV("HTTP_REQUEST", "Method: %d", method);
+        if (method == HTTP_METHOD::POST && size > 0)
+        {
+            // corpo em memória: vai pelo HTTPDATA e a requisição sai com HTTPACTION
+            ESP_LOGV("HTTP_REQUEST", "Sending HTTP POST body");
+            data_segment body = {(const uint8_t *)data_post, size};
+            if (!this->http_send_body_(&body, 1, timeout))
+                return 0;
+            return this->http_action_("AT+HTTPACTION=1" GSM_NL, recv_timeout, timeout);
+        }
+        ESP_LOGV("HTTP_REQUEST", "Sending HTTP GET/POSTFILE request");
+        return this->http_action_(cmd, recv_timeout, timeout);
+    }
+    return 0;
+}
+
+static uint32_t fnv1a_hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str)
+    {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1; // 0 fica reservado para "não enviado"
+}
+
+static bool http_desc_append(http_request_desc *request, uint16_t *offset, const char *fmt, ...)
+{
+    size_t room = sizeof(request->arena) - request->used;
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(request->arena + request->used, room, fmt, args);
+    va_end(args);
+    // cada linha também precisa caber no commandMessage da fila de envio
+    if (len < 0 || (size_t)len >= room || (size_t)len >= sizeof(((commandMessage *)0)->data))
+        return false;
+    *offset = request->used;
+    request->used += len + 1;
+    return true;
+}
+
+bool http_request_desc::build(const char *url, HTTP_METHOD method, bool ssl, const char *ca_name, const char *user_data,
+                              uint32_t con_timeout, uint32_t recv_timeout, const char *content, const char *accept, uint8_t read_mode)
+{
+    this->used = 0;
+    if (strlen(url) > HTTP_URL_MAX_LEN || strlen(user_data) > HTTP_USERDATA_MAX_LEN)
+    {
+        ESP_LOGE("HTTP_REQUEST", "URL (%d) or USERDATA (%d) too long", strlen(url), strlen(user_data));
+        return false;
+    }
+
+    this->method = method;
+    this->ssl = ssl;
+    this->has_user_data = user_data[0] != '\0';
+    this->recv_timeout = recv_timeout;
+    this->used = 1; // offset 0 nunca é uma linha válida
+
+    bool ok = http_desc_append(this, &this->line[HTTP_PARA_URL], "AT+HTTPPARA=\"URL\",\"%s\"" GSM_NL, url) &&
+              http_desc_append(this, &this->line[HTTP_PARA_SSL], "AT+CSSLCFG=\"cacert\",0,\"%s\"" GSM_NL, ca_name) &&
+              http_desc_append(this, &this->line[HTTP_PARA_CONNECTTO], "AT+HTTPPARA=\"CONNECTTO\",%d" GSM_NL, con_timeout) &&
+              http_desc_append(this, &this->line[HTTP_PARA_RECVTO], "AT+HTTPPARA=\"RECVTO\",%d" GSM_NL, recv_timeout) &&
+              http_desc_append(this, &this->line[HTTP_PARA_CONTENT], "AT+HTTPPARA=\"CONTENT\",\"%s\"" GSM_NL, content) &&
+              http_desc_append(this, &this->line[HTTP_PARA_ACCEPT], "AT+HTTPPARA=\"ACCEPT\",\"%s\"" GSM_NL, accept) &&
+              http_desc_append(this, &this->line[HTTP_PARA_USERDATA], "AT+HTTPPARA=\"USERDATA\",\"%s\"" GSM_NL, user_data) &&
+              http_desc_append(this, &this->line[HTTP_PARA_READMODE], "AT+HTTPPARA=\"READMODE\",%d" GSM_NL, read_mode) &&
+              http_desc_append(this, &this->action, "AT+HTTPACTION=%d" GSM_NL, method);
+    if (!ok)
+    {
+        ESP_LOGE("HTTP_REQUEST", "Request does not fit in %d bytes", sizeof(this->arena));
+        this->used = 0;
+        return false;
+    }
+
+    for (int i = 0; i < HTTP_PARA_COUNT; i++)
+        this->hash[i] = fnv1a_hash(this->line_at((http_para_slot)i));
+    return true;
+}
+
+// Envia um HTTPPARA; numa sessão aberta ele é pulado se for igual ao último aceito pelo modem
+bool A7672SA::http_para_(http_para_slot slot, const char *line, uint32_t hash, uint32_t timeout)
+{
+    if (this->http_session_ && this->http_para_hash_[slot] == hash)
+        return true;
+
+    this->sendCommand("HTTP_REQUEST", line);
+    bool ok = this->wait_response(timeout);
+    this->http_para_hash_[slot] = ok ? hash : 0; // recusado: reenvia na próxima requisição
+    if (!ok)
+        ESP_LOGW("HTTP_PARA", "Rejected: %s", line);
+    return ok;
+}
+
+bool A7672SA::http_configure_(const http_request_desc &request, uint32_t timeout)
+{
+    seq_scope seq(*this);
+    if (!this->http_session_)
+    {
+        if (!this->csock_select_(this->http_cid_, timeout))
+        {
+            ESP_LOGW("HTTP_INIT", "Failed to bind HTTP to cid %d", this->http_cid_);
+            return false;
+        }
+        this->sendCommand("HTTP_INIT", "AT+HTTPINIT" GSM_NL);
+        if (!this->wait_response(timeout))
+            return false;
+    }
+
+    // Cada passo para no primeiro erro: seguir adiante dispararia a requisição com parâmetros velhos
+    if (!this->http_para_(HTTP_PARA_URL, request.line_at(HTTP_PARA_URL), request.hash[HTTP_PARA_URL], timeout))
+        return false;
+
+    // Com sessão aberta o contexto SSL só é refeito se o certificado mudar
+    if (request.ssl && (!this->http_session_ || this->http_para_hash_[HTTP_PARA_SSL] != request.hash[HTTP_PARA_SSL]))
+    {
+        const char *ssl_lines[] = {"AT+CSSLCFG=\"sslversion\",0,4" GSM_NL, "AT+CSSLCFG=\"authmode\",0,1" GSM_NL,
+                                   "AT+CSSLCFG=\"enableSNI\",0,0" GSM_NL, request.line_at(HTTP_PARA_SSL),
+                                   "AT+HTTPPARA=\"SSLCFG\",0" GSM_NL};
+        bool ssl_ok = true;
+        for (size_t i = 0; ssl_ok && i < sizeof(ssl_lines) / sizeof(ssl_lines[0]); i++)
+        {
+            this->sendCommand("HTTP_SSL", ssl_lines[i]);
+            ssl_ok = this->wait_response(timeout);
+        }
+        this->http_para_hash_[HTTP_PARA_SSL] = ssl_ok ? request.hash[HTTP_PARA_SSL] : 0;
+        if (!ssl_ok)
+        {
+            ESP_LOGW("HTTP_SSL", "SSL context setup failed");
+            return false;
+        }
+    }
+
+    if (!this->http_para_(HTTP_PARA_CONNECTTO, request.line_at(HTTP_PARA_CONNECTTO), request.hash[HTTP_PARA_CONNECTTO], timeout) ||
+        !this->http_para_(HTTP_PARA_RECVTO, request.line_at(HTTP_PARA_RECVTO), request.hash[HTTP_PARA_RECVTO], timeout) ||
+        !this->http_para_(HTTP_PARA_CONTENT, request.line_at(HTTP_PARA_CONTENT), request.hash[HTTP_PARA_CONTENT], timeout) ||
+        !this->http_para_(HTTP_PARA_ACCEPT, request.line_at(HTTP_PARA_ACCEPT), request.hash[HTTP_PARA_ACCEPT], timeout))
+        return false;
+
+    // Numa sessão o USERDATA anterior precisa ser limpo quando a nova requisição não tem cabeçalhos extras
+    if ((request.has_user_data || this->http_session_) &&
+        !this->http_para_(HTTP_PARA_USERDATA, request.line_at(HTTP_PARA_USERDATA), request.hash[HTTP_PARA_USERDATA], timeout))
+        return false;
+
+    return this->http_para_(HTTP_PARA_READMODE, request.line_at(HTTP_PARA_READMODE), request.hash[HTTP_PARA_READMODE], timeout);
+}
+
+bool A7672SA::http_session_begin(uint32_t timeout)
+{
+    seq_scope seq(*this);
+    if (this->http_session_)
+        return true;
+
+    if (!this->csock_select_(this->http_cid_, timeout))
+    {
+        ESP_LOGW("HTTP_INIT", "Failed to bind HTTP to cid %d", this->http_cid_);
+        return false;
+    }
+    this->sendCommand("HTTP_INIT", "AT+HTTPINIT" GSM_NL);
+    if (!this->wait_response(timeout))
+    {
+        // serviço HTTP ficou aberto (http_term esquecido): reinicia uma vez
+        this->sendCommand("HTTP_TERM", "AT+HTTPTERM" GSM_NL);
+        this->wait_response(timeout);
+        this->sendCommand("HTTP_INIT", "AT+HTTPINIT" GSM_NL);
+        if (!this->wait_response(timeout))
+            return false;
+    }
+
+    memset(this->http_para_hash_, 0, sizeof(this->http_para_hash_));
+    this->http_para_hash_[HTTP_PARA_USERDATA] = fnv1a_hash("AT+HTTPPARA=\"USERDATA\",\"\"" GSM_NL); // HTTPINIT começa sem USERDATA
+    this->http_session_ = true;
+    return true;
+}
+
+bool A7672SA::http_session_end(uint32_t timeout)
+{
+    return this->http_term(timeout);
+}
+
+uint32_t A7672SA::http_response_size()
+{
+    return this->http_response_data.http_content_size;
+}
+
+uint32_t A7672SA::http_response_header_size()
+{
+    return this->http_response_data.http_header_size;
+}
+
+char *A7672SA::http_response_etag()
+{
+    return this->http_response_data.http_etag;
+}
+
+int A7672SA::fs_read(size_t read_size, uint8_t *buffer, uint32_t timeout)
+{
+    return this->fs_read_handle(1, buffer, read_size, timeout);
+}
+
+int A7672SA::fs_read_handle(int fd, uint8_t *buffer, size_t size, uint32_t timeout)
+{
+    char cmd[48];
+    sprintf(cmd, "AT+FSREAD=%d,%d" GSM_NL, fd, size);
+    // CONNECT <n>\r\n<dados>\r\nOK
+    this->operator_scan_cancel();
+    return this->read_framed_(cmd, "CONNECT ", "OK", buffer, size, timeout);
+}
+
+int A7672SA::http_read_response(uint8_t *buffer, size_t read_size, size_t offset, uint32_t timeout)
+{
+    char cmd[48];
+    sprintf(cmd, "AT+HTTPREAD=%d,%d" GSM_NL, offset, read_size);
+    // OK\r\n+HTTPREAD: <n>\r\n<dados>\r\n+HTTPREAD: 0
+    this->operator_scan_cancel();
+    return this->read_framed_(cmd, "+HTTPREAD: ", "+HTTPREAD: 0", buffer, read_size, timeout);
+}
+
+// Toma a UART para a tarefa atual, a menos que ela já esteja com o rx_guard (ex.: RX_LOCK do chamador)
+bool A7672SA::rx_acquire_()
+{
+    if (this->rx_guard == NULL || xSemaphoreGetMutexHolder(this->rx_guard) == xTaskGetCurrentTaskHandle())
+        return false;
+    this->RX_LOCK();
+    return true;
+}
+
+void A7672SA::rx_release_(bool acquired)
+{
+    if (acquired)
+        this->RX_UNLOCK();
+}
+
+// Entrega uma linha já sem \r\n ao parser, no mesmo formato que chega da UART
+void A7672SA::dispatch_line_(const char *line)
+{
+    char framed[160];
+    snprintf(framed, sizeof(framed), GSM_NL "%s" GSM_NL, line);
+    this->simcomm_dispatch(framed);
+}
+
+// Lê da UART uma linha não vazia (sem \r\n) até o prazo; linhas maiores que size são truncadas
+bool A7672SA::uart_read_line_(char *line, size_t size, uint32_t start, uint32_t timeout)
+{
+    size_t len = 0;
+    while (millis() - start < timeout)
+    {
+        uint8_t c;
+        if (uart_read_bytes(UART_NUM_1, &c, 1, pdMS_TO_TICKS(10)) <= 0 || c == '\r')
+            continue;
+        if (c != '\n' && len < size - 1)
+        {
+            line[len++] = c;
+            continue;
+        }
+        if (len == 0)
+            continue;
+        line[len] = '\0';
+        return true;
+    }
+    return false;
+}
+
+/*
+Leitura de bloco binário com tamanho no cabeçalho (+HTTPREAD: <n> / CONNECT <n>).
+Envia cmd, consome as linhas até o cabeçalho (despachando URCs e o OK ao parser), lê exatamente n bytes direto para
+dst em quantas leituras da UART forem necessárias e depois consome as linhas até trailer, despachando o que vier junto.
+Retorna n (0 = não há mais dados), -1 se o cabeçalho não chegou/ERROR, -2 se o bloco veio incompleto ou -3 se n passava
+de max_len: os primeiros max_len bytes ficam em dst e o excesso é consumido da UART e descartado.
+*/
+int A7672SA::read_framed_(const char *cmd, const char *header, const char *trailer, uint8_t *dst, size_t max_len, uint32_t timeout)
+{
+    if (!uart_is_driver_installed(UART_NUM_1))
+        return -1;
+
+    bool acquired = this->rx_acquire_();
+    this->at_error = false;
+    this->sendCommand("READ_FRAMED", cmd);
+
+    const size_t header_len = strlen(header);
+    char line[128];
+    int block_len = -1;
+    uint32_t start = millis();
+
+    // 1) cabeçalho
+    while (this->uart_read_line_(line, sizeof(line), start, timeout))
+    {
+        if (strncmp(line, header, header_len) == 0)
+        {
+            block_len = atoi(line + header_len);
+            break;
+        }
+        this->dispatch_line_(line);
+        if (this->at_error)
+            break;
+    }
+
+    if (block_len == 0 && strncmp(line, trailer, strlen(trailer)) != 0)
+    {
+        // bloco vazio (fim do arquivo): o OK que fecha a resposta não pode sobrar para o próximo comando
+        start = millis();
+        while (this->uart_read_line_(line, sizeof(line), start, 500) && strncmp(line, trailer, strlen(trailer)) != 0)
+            this->dispatch_line_(line);
+    }
+    if (block_len <= 0)
+    {
+        this->rx_release_(acquired);
+        return block_len == 0 ? 0 : -1;
+    }
+
+    // 2) n bytes direto no buffer do chamador; o prazo cresce com o tamanho do bloco (10 bits por byte)
+    size_t wanted = (size_t)block_len;
+    uint32_t data_deadline = timeout + (uint32_t)((uint64_t)wanted * 10 * 1000 / this->baud_rate_);
+    size_t got = 0;
+    start = millis();
+    while (got < wanted && millis() - start < data_deadline)
+    {
+        uint8_t discard[32];
+        uint8_t *target = got < max_len ? dst + got : discard;
+        size_t room = got < max_len ? max_len - got : sizeof(discard);
+        size_t want = wanted - got < room ? wanted - got : room;
+        int n = uart_read_bytes(UART_NUM_1, target, want, pdMS_TO_TICKS(20));
+        if (n > 0)
+            got += n;
+    }
+
+    // 3) linhas até o trailer (o que chegar junto — URCs, OK — vai para o parser)
+    start = millis();
+    while (got == wanted && this->uart_read_line_(line, sizeof(line), start, 500))
+    {
+        if (strncmp(line, trailer, strlen(trailer)) == 0)
+            break;
+        this->dispatch_line_(line);
+    }
+
+    this->rx_release_(acquired);
+
+    if (got < wanted)
+    {
+        ESP_LOGW("READ_FRAMED", "Short block: %d of %d bytes", got, wanted);
+        return -2;
+    }
+    if (wanted > max_len)
+    {
+        ESP_LOGW("READ_FRAMED", "Block of %d bytes truncated to %d", wanted, max_len);
+        return -3;
+    }
+    return wanted;
+}
+
+/*
+Envia cmd e entrega a on_line cada linha da resposta até OK/ERROR, lendo a UART direto (respostas de várias linhas
+não dependem de como chegam os blocos do rx_task). Linhas que on_line não reconhece (retorna false) vão para o parser.
+*/
+bool A7672SA::query_lines_(const char *cmd, std::function<bool(const char *line)> on_line, uint32_t timeout)
+{
+    if (!uart_is_driver_installed(UART_NUM_1))
+        return false;
+
+    bool acquired = this->rx_acquire_();
+    this->sendCommand("QUERY", cmd);
+
+    char line[160];
+    bool ok = false;
+    uint32_t start = millis();
+    while (this->uart_read_line_(line, sizeof(line), start, timeout))
+    {
+        if (strcmp(line, "OK") == 0)
+        {
+            ok = true;
+            break;
+        }
+        if (strcmp(line, "ERROR") == 0 || strncmp(line, "+CME ERROR", 10) == 0)
+            break;
+        if (!on_line(line))
+            this->dispatch_line_(line);
+    }
+
+    this->rx_release_(acquired);
+    return ok;
+}
+
+bool A7672SA::http_download(data_sink sink, size_t chunk_size, transfer_stats *stats, size_t offset, uint32_t timeout)
+{
+    size_t content_size = this->http_response_data.http_content_size;
+    if (offset >= content_size)
+    {
+        ESP_LOGW("HTTP_DOWNLOAD", "Nothing to download (offset %d, size %d)", offset, content_size);
+        return false;
+    }
+
+    return this->pipeline_transfer_([this, offset, timeout](uint8_t *buffer, size_t max_len, size_t pos)
+                                    { return this->http_read_response(buffer, max_len, offset + pos, timeout); },
+                                    content_size - offset, [sink, offset](const uint8_t *data, size_t len, size_t pos)
+                                    { return sink(data, len, offset + pos); },
+                                    chunk_size, stats, "HTTP_DOWNLOAD");
+}
+
+struct pipeline_block
+{
+    int8_t index; // -1 = fim
+    size_t len;
+    size_t offset;
+};
+
+struct pipeline_context
+{
+    data_sink *sink;
+    uint8_t *buffers[2];
+    QueueHandle_t free_queue;
+    QueueHandle_t full_queue;
+    SemaphoreHandle_t done;
+    volatile bool sink_failed;
+};
+
+void A7672SA::pipeline_sink_taskImpl(void *pvParameters)
+{
+    pipeline_context *ctx = static_cast<pipeline_context *>(pvParameters);
+    pipeline_block block;
+    while (xQueueReceive(ctx->full_queue, &block, portMAX_DELAY) == pdPASS && block.index >= 0)
+    {
+        if (!ctx->sink_failed && !(*ctx->sink)(ctx->buffers[block.index], block.len, block.offset))
+            ctx->sink_failed = true;
+        xQueueSend(ctx->free_queue, &block.index, portMAX_DELAY);
+    }
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+/*
+Transferência com buffer duplo: a tarefa chamadora lê do modem (producer) enquanto uma tarefa auxiliar entrega o
+bloco anterior ao sink, de modo que o tempo total tende a max(UART, sink) e não à soma dos dois.
+total = 0 lê até o producer retornar 0.
+*/
+bool A7672SA::pipeline_transfer_(payload_reader producer, size_t total, data_sink sink, size_t chunk_size, transfer_stats *stats, const char *name)
+{
+    if (!producer || !sink || chunk_size == 0)
+        return false;
+
+    pipeline_context ctx = {};
+    ctx.sink = &sink;
+    ctx.buffers[0] = (uint8_t *)malloc(chunk_size);
+    ctx.buffers[1] = (uint8_t *)malloc(chunk_size);
+    ctx.free_queue = xQueueCreate(2, sizeof(int8_t));
+    ctx.full_queue = xQueueCreate(2, sizeof(pipeline_block));
+    ctx.done = xSemaphoreCreateBinary();
+
+    bool ok = ctx.buffers[0] && ctx.buffers[1] && ctx.free_queue && ctx.full_queue && ctx.done;
+    if (ok)
+    {
+        for (int8_t i = 0; i < 2; i++)
+            xQueueSend(ctx.free_queue, &i, 0);
+        ok = xTaskCreate(pipeline_sink_taskImpl, "pipeline_sink", configIDLE_TASK_STACK_SIZE * 6, &ctx, uxTaskPriorityGet(NULL), NULL) == pdPASS;
+    }
+    if (!ok)
+    {
+        ESP_LOGE(name, "Failed to allocate pipeline (%d bytes x2)", chunk_size);
+        free(ctx.buffers[0]);
+        free(ctx.buffers[1]);
+        if (ctx.free_queue)
+            vQueueDelete(ctx.free_queue);
+        if (ctx.full_queue)
+            vQueueDelete(ctx.full_queue);
+        if (ctx.done)
+            vSemaphoreDelete(ctx.done);
+        return false;
+    }
+
+    transfer_stats local = {};
+    uint32_t start = millis();
+    size_t offset = 0;
+    bool failed = false;
+
+    while ((total == 0 || offset < total) && !ctx.sink_failed)
+    {
+        pipeline_block block;
+        xQueueReceive(ctx.free_queue, &block.index, portMAX_DELAY);
+
+        size_t want = (total == 0 || total - offset > chunk_size) ? chunk_size : total - offset;
+        int n = producer(ctx.buffers[block.index], want, offset);
+        for (uint32_t retry = 0; n < 0 && retry < TRANSFER_MAX_RETRIES; retry++)
+        {
+            ESP_LOGW(name, "Read failed at %d (%d), retry %d", offset, n, retry + 1);
+            local.retries++;
+            n = producer(ctx.buffers[block.index], want, offset);
+        }
+        if (n <= 0)
+        {
+            xQueueSend(ctx.free_queue, &block.index, 0);
+            failed = n < 0 || total != 0;
+            break;
+        }
+
+        block.len = n;
+        block.offset = offset;
+        xQueueSend(ctx.full_queue, &block, portMAX_DELAY);
+        offset += n;
+        local.chunks++;
+    }
+
+    pipeline_block end = {-1, 0, 0};
+    xQueueSend(ctx.full_queue, &end, portMAX_DELAY);
+    xSemaphoreTake(ctx.done, portMAX_DELAY);
+
+    local.bytes = offset;
+    local.elapsed_ms = millis() - start;
+    local.bytes_per_s = local.elapsed_ms ? (uint32_t)((uint64_t)offset * 1000 / local.elapsed_ms) : 0;
+    ESP_LOGI(name, "%d bytes in %d ms (%d B/s, %d retries)", local.bytes, local.elapsed_ms, local.bytes_per_s, local.retries);
+    if (stats != nullptr)
+        *stats = local;
+
+    free(ctx.buffers[0]);
+    free(ctx.buffers[1]);
+    vQueueDelete(ctx.free_queue);
+    vQueueDelete(ctx.full_queue);
+    vSemaphoreDelete(ctx.done);
+
+    if (ctx.sink_failed)
+        ESP_LOGE(name, "Sink aborted at %d", offset);
+    return !failed && !ctx.sink_failed;
+}
+
+bool A7672SA::nvs_load_(const char *key, void *data, size_t size)
+{
+    nvs_handle_t handle;
+    if (nvs_open(A7672SA_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
+
+    size_t stored = size;
+    bool ok = nvs_get_blob(handle, key, data, &stored) == ESP_OK && stored == size;
+    nvs_close(handle);
+    return ok;
+}
+
+bool A7672SA::nvs_store_(const char *key, const void *data, size_t size)
+{
+    nvs_handle_t handle;
+    if (nvs_open(A7672SA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return false;
+
+    bool ok = nvs_set_blob(handle, key, data, size) == ESP_OK && nvs_commit(handle) == ESP_OK;
+    nvs_close(handle);
+    return ok;
+}
+
+void A7672SA::nvs_erase_(const char *key)
+{
+    nvs_handle_t handle;
+    if (nvs_open(A7672SA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return;
+
+    if (nvs_erase_key(handle, key) == ESP_OK)
+        nvs_commit(handle);
+    nvs_close(handle);
+}
+
+bool A7672SA::http_download_checkpoint(const char *key, download_checkpoint *checkpoint)
+{
+    return this->nvs_load_(key, checkpoint, sizeof(*checkpoint));
+}
+
+void A7672SA::http_download_reset(const char *key)
+{
+    this->nvs_erase_(key);
+}
+
+static void http_cache_key(char *key, const char *url)
+{
+    sprintf(key, "hc%08x", (unsigned int)fnv1a_hash(url));
+}
+
+uint32_t A7672SA::http_get_cached(const char *url, bool ssl, const char *ca_name, const char *user_data, uint32_t timeout)
+{
+    seq_scope seq(*this);
+    char key[16];
+    http_cache_key(key, url);
+    http_cache_entry entry;
+    bool cached = this->nvs_load_(key, &entry, sizeof(entry));
+
+    char headers[400];
+    int len = snprintf(headers, sizeof(headers), "%s", user_data);
+    if (cached && entry.etag[0] != '\0')
+        len += snprintf(headers + len, sizeof(headers) - len, "%sIf-None-Match: \"%s\"", len > 0 ? HTTP_HEADER_SEP : "", entry.etag);
+    if (cached && entry.last_modified[0] != '\0' && len < (int)sizeof(headers))
+        len += snprintf(headers + len, sizeof(headers) - len, "%sIf-Modified-Since: %s", len > 0 ? HTTP_HEADER_SEP : "", entry.last_modified);
+    if (len >= (int)sizeof(headers))
+    {
+        ESP_LOGE("HTTP_CACHE", "Headers too long for %s", url);
+        return 0;
+    }
+
+    uint32_t status = this->http_request(url, HTTP_METHOD::GET, false, ssl, ca_name, headers, len, 120, 120,
+                                         "text/plain", "*/*", 0, "", 0, timeout);
+    if (status == 0)
+        return 0;
+
+    this->http_cache_counters_.requests++;
+    if (status == 304 && cached)
+    {
+        this->http_cache_counters_.hits++;
+        this->http_cache_counters_.bytes_saved += entry.content_size;
+        ESP_LOGD("HTTP_CACHE", "Hit %s (%d bytes saved, %d%% hit rate)", url, entry.content_size, this->http_cache_hit_rate());
+    }
+    else if (status == 200)
+    {
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.etag, this->http_response_data.http_etag, sizeof(entry.etag) - 1);
+        strncpy(entry.last_modified, this->http_response_data.http_last_modified, sizeof(entry.last_modified) - 1);
+        entry.content_size = this->http_response_data.http_content_size;
+        if (entry.etag[0] != '\0' || entry.last_modified[0] != '\0')
+            this->nvs_store_(key, &entry, sizeof(entry));
+        else if (cached)
+            this->nvs_erase_(key);
+    }
+    return status;
+}
+
+void A7672SA::http_cache_forget(const char *url)
+{
+    char key[16];
+    http_cache_key(key, url);
+    this->nvs_erase_(key);
+}
+
+bool A7672SA::http_download_resumable(const char *url, const char *key, data_sink sink, const uint8_t *sha256, bool ssl,
+                                      const char *ca_name, const char *user_data, size_t range_size, transfer_stats *stats, uint32_t timeout)
+{
+    if (!sink || range_size == 0 || strlen(user_data) > 256)
+        return false;
+
+    download_checkpoint cp;
+    uint32_t url_hash = fnv1a_hash(url);
+    if (this->http_download_checkpoint(key, &cp) && cp.url_hash == url_hash)
+    {
+        ESP_LOGI("HTTP_RESUME", "Resuming %s at %d of %d (etag %s)", key, cp.committed, cp.total, cp.etag);
+    }
+    else
+    {
+        memset(&cp, 0, sizeof(cp));
+        cp.url_hash = url_hash;
+        cp.sha.init();
+    }
+
+    bool own_session = !this->http_session_;
+    if (own_session && !this->http_session_begin(timeout))
+        return false;
+
+    transfer_stats total_stats = {};
+    uint32_t start = millis();
+    uint32_t saved_at = cp.committed;
+    uint8_t attempts = 0;
+    bool sink_failed = false;
+    bool complete = false;
+    size_t base = 0; // posição no arquivo do primeiro byte do corpo atual
+
+    // Os blocos chegam em ordem (tarefa do pipeline), então o hash e o offset confirmado avançam junto com o sink
+    data_sink committer = [&](const uint8_t *data, size_t len, size_t offset)
+    {
+        if (base + offset != cp.committed || !sink(data, len, base + offset))
+        {
+            sink_failed = true;
+            return false;
+        }
+        cp.sha.update(data, len);
+        cp.committed += len;
+        if (cp.committed - saved_at >= DOWNLOAD_CHECKPOINT_INTERVAL)
+        {
+            this->nvs_store_(key, &cp, sizeof(cp));
+            saved_at = cp.committed;
+        }
+        return true;
+    };
+
+    while (!sink_failed && attempts < DOWNLOAD_MAX_ATTEMPTS)
+    {
+        if (cp.total > 0 && cp.committed >= cp.total)
+        {
+            complete = true;
+            break;
+        }
+
+        size_t last = cp.committed + range_size - 1;
+        if (cp.total > 0 && last >= cp.total)
+            last = cp.total - 1;
+
+        char headers[320];
+        int headers_len = snprintf(headers, sizeof(headers), "Range: bytes=%d-%d%s%s", cp.committed, last,
+                                   user_data[0] ? HTTP_HEADER_SEP : "", user_data);
+
+        uint32_t status = this->http_request(url, HTTP_METHOD::GET, false, ssl, ca_name, headers, headers_len, 120, 120,
+                                             "text/plain", "*/*", 0, "", 0, timeout);
+        size_t body = this->http_response_data.http_content_size;
+        const char *etag = this->http_response_data.http_etag;
+
+        if (status == 416 && cp.total == 0 && cp.committed > 0) // tamanho desconhecido e já passamos do fim
+        {
+            cp.total = cp.committed;
+            continue;
+        }
 
-        if (ssl)
+        bool changed = cp.etag[0] != '\0' && etag[0] != '\0' && strcmp(cp.etag, etag) != 0;
+        if (changed || (status == 200 && cp.committed > 0) || (status == 206 && this->http_response_data.http_range_total > 0 && this->http_response_data.http_range_start != cp.committed))
         {
-            this->sendCommand("HTTP_SSL", "AT+CSSLCFG=\"sslversion\",0,4" GSM_NL);
-            if (this->wait_response(timeout))
-                this->sendCommand("HTTP_SSL", "AT+CSSLCFG=\"authmode\",0,1" GSM_NL);
-            if (this->wait_response(timeout))
-                this->sendCommand("HTTP_SSL", "AT+CSSLCFG=\"enableSNI\",0,0" GSM_NL);
-            if (this->wait_response(timeout))
-            {
-                sprintf(cmd, "AT+CSSLCFG=\"cacert\",0,\"%s\"" GSM_NL, ca_name);
-                this->sendCommand("HTTP_SSL", cmd);
-                this->wait_response(timeout);
-                this->sendCommand("HTTP_SSL", "AT+HTTPPARA=\"SSLCFG\",0" GSM_NL);
-                this->wait_response(timeout);
-            }
+            // arquivo mudou no servidor ou o Range foi ignorado: o que já foi gravado não serve mais
+            ESP_LOGW("HTTP_RESUME", "%s changed on server (status %d, etag %s), restarting from 0", key, status, etag);
+            memset(&cp, 0, sizeof(cp));
+            cp.url_hash = url_hash;
+            cp.sha.init();
+            saved_at = 0;
+            attempts++;
+            if (status != 200)
+                continue;
         }
 
-        sprintf(cmd, "AT+HTTPPARA=\"CONNECTTO\",%d" GSM_NL, con_timeout);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
-        sprintf(cmd, "AT+HTTPPARA=\"RECVTO\",%d" GSM_NL, recv_timeout);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
-        sprintf(cmd, "AT+HTTPPARA=\"CONTENT\",\"%s\"" GSM_NL, content);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
-        sprintf(cmd, "AT+HTTPPARA=\"ACCEPT\",\"%s\"" GSM_NL, accept);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        this->wait_response(timeout);
-
-        if (user_data_size > 0)
+        if (status != 200 && status != 206)
         {
-            char data_[user_data_size + 40];
-            sprintf(data_, "AT+HTTPPARA=\"USERDATA\",\"%s\"" GSM_NL, user_data);
-            this->sendCommand("HTTP_REQUEST", data_);
-            this->wait_response(timeout);
+            attempts++;
+            ESP_LOGW("HTTP_RESUME", "Range %d-%d failed (status %d), attempt %d", cp.committed, last, status, attempts);
+            if (!this->ps_ready())
+                this->wait_network(timeout);
+            else
+                vTaskDelay(pdMS_TO_TICKS(1000 * attempts));
+            continue;
         }
 
-        sprintf(cmd, "AT+HTTPPARA=\"READMODE\",%d" GSM_NL, read_mode);
-        this->sendCommand("HTTP_REQUEST", cmd);
-        if (this->wait_response(timeout))
+        if (cp.etag[0] == '\0')
+            strncpy(cp.etag, etag, sizeof(cp.etag) - 1);
+        if (status == 200)
+            cp.total = body; // servidor sem suporte a Range: o corpo é o arquivo inteiro
+        else if (this->http_response_data.http_range_total > 0)
+            cp.total = this->http_response_data.http_range_total;
+        else if (body < last - cp.committed + 1)
+            cp.total = cp.committed + body; // faixa curta: é a última
+
+        uint32_t before = cp.committed;
+        base = cp.committed;
+        transfer_stats range_stats = {};
+        this->http_download(committer, TRANSFER_CHUNK_SIZE, &range_stats, 0, timeout);
+        total_stats.bytes += range_stats.bytes;
+        total_stats.chunks += range_stats.chunks;
+        total_stats.retries += range_stats.retries;
+
+        if (cp.committed != saved_at)
         {
-            ESP_LOGV("HTTP_REQUEST", "Method: %d", method);
-            if (method == HTTP_METHOD::POST)
-            {
-                ESP_LOGV("HTTP_REQUEST", "Sending HTTP POST request");
-                this->at_input = false;
-                sprintf(cmd, "AT+HTTPDATA=%d,%d" GSM_NL, size, timeout);
-                this->sendCommand("HTTP_REQUEST", cmd);
-                if (this->wait_input(timeout))
-                {
-                    this->at_ok = false;
-                    this->send_cmd_to_simcomm("HTTP_REQUEST", (byte *)data_post, size);
-                    if (this->wait_response(timeout))
-                    {
-                        return this->http_response_data.http_status_code;
-                    }
-                }
-            }
-            ESP_LOGV("HTTP_REQUEST", "Sending HTTP GET/POSTFILE request");
-            // this->http_response = false;
-            sprintf(cmd, "AT+HTTPPOSTFILE=\"%s\",1,%d,1" GSM_NL, filename, method);
-            this->sendCommand("HTTP_REQUEST", cmd);
-            if (this->wait_http_response(recv_timeout * 1000))
-            {
-                // this->http_response = false;
-                this->sendCommand("HTTP_REQUEST", "AT+HTTPHEAD" GSM_NL);
-                this->wait_http_response(timeout);
-
-                return this->http_response_data.http_status_code;
-            }
+            this->nvs_store_(key, &cp, sizeof(cp));
+            saved_at = cp.committed;
         }
+        if (cp.committed > before)
+            attempts = 0;
+        else
+            attempts++;
     }
-    return 0;
+
+    if (own_session)
+        this->http_session_end(timeout);
+
+    total_stats.elapsed_ms = millis() - start;
+    total_stats.bytes_per_s = total_stats.elapsed_ms ? (uint32_t)((uint64_t)total_stats.bytes * 1000 / total_stats.elapsed_ms) : 0;
+    if (stats != nullptr)
+        *stats = total_stats;
+
+    if (!complete)
+    {
+        ESP_LOGE("HTTP_RESUME", "%s stopped at %d of %d, checkpoint kept", key, cp.committed, cp.total);
+        return false;
+    }
+
+    uint8_t digest[32];
+    cp.sha.final(digest);
+    this->http_download_reset(key);
+    if (sha256 != nullptr && memcmp(digest, sha256, sizeof(digest)) != 0)
+    {
+        ESP_LOGE("HTTP_RESUME", "%s SHA-256 mismatch (%d bytes)", key, cp.total);
+        return false;
+    }
+
+    ESP_LOGI("HTTP_RESUME", "%s complete: %d bytes, %d B/s", key, cp.total, total_stats.bytes_per_s);
+    return true;
 }
 
-uint32_t A7672SA::http_response_size()
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define SHA256_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_transform(uint32_t h[8], const uint8_t block[64])
 {
-    return this->http_response_data.http_content_size;
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = SHA256_ROR(w[i - 15], 7) ^ SHA256_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROR(w[i - 2], 17) ^ SHA256_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = k + (SHA256_ROR(e, 6) ^ SHA256_ROR(e, 11) ^ SHA256_ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (SHA256_ROR(a, 2) ^ SHA256_ROR(a, 13) ^ SHA256_ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += k;
 }
 
-uint32_t A7672SA::http_response_header_size()
+void sha256_state::init()
 {
-    return this->http_response_data.http_header_size;
+    static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(this->h, iv, sizeof(iv));
+    this->length = 0;
 }
 
-char *A7672SA::http_response_etag()
+void sha256_state::update(const uint8_t *data, size_t len)
 {
-    return this->http_response_data.http_etag;
+    size_t used = this->length % 64;
+    this->length += len;
+    if (used > 0)
+    {
+        size_t fill = 64 - used < len ? 64 - used : len;
+        memcpy(this->block + used, data, fill);
+        data += fill;
+        len -= fill;
+        if (used + fill < 64)
+            return;
+        sha256_transform(this->h, this->block);
+    }
+    while (len >= 64)
+    {
+        sha256_transform(this->h, data);
+        data += 64;
+        len -= 64;
+    }
+    memcpy(this->block, data, len);
 }
 
-// para que o buffer seja preenchido é necessário que que a tarefa que chama essa função pegue o mutex uart_guard
-size_t A7672SA::fs_read(size_t read_size, uint8_t *buffer, uint32_t timeout)
+void sha256_state::final(uint8_t digest[32])
 {
-    int read_len = 0;
-    int res_len = 0;
-
-    char cmd[100];
-    sprintf(cmd, "AT+FSREAD=1,%d" GSM_NL, read_size);
-
-    this->sendCommand("FS", cmd);
-    int rxBytes = 0;
-    if (uart_is_driver_installed(UART_NUM_1) && this->at_response != NULL)
-        rxBytes = uart_read_bytes(UART_NUM_1, this->at_response, this->rx_buffer_size, 250 / portTICK_RATE_MS);
-
-    if (rxBytes > 0)
+    uint64_t bits = this->length * 8;
+    size_t used = this->length % 64;
+    this->block[used++] = 0x80;
+    if (used > 56)
     {
-        this->at_response[rxBytes] = 0;
-
-        char *result = strstr(this->at_response, "CONNECT");
-        if (result == NULL)
-        {
-            return -1;
-        }
-
-        sscanf(result, "CONNECT %d%*s", &read_len);
-        if (read_len <= 0)
-        {
-            return -2;
-        }
-        // calcula o tamanho do read_len em dígitos, para obter o offset do buffer de resposta da UART
-        // não queremos o CONNECT %d\r\n
-        res_len = floor(log10(read_len)) + 1 + 12;
-        memcpy(buffer, this->at_response + res_len, read_len);
+        memset(this->block + used, 0, 64 - used);
+        sha256_transform(this->h, this->block);
+        used = 0;
+    }
+    memset(this->block + used, 0, 56 - used);
+    for (int i = 0; i < 8; i++)
+        this->block[56 + i] = (uint8_t)(bits >> (56 - i * 8));
+    sha256_transform(this->h, this->block);
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i * 4] = (uint8_t)(this->h[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(this->h[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(this->h[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)this->h[i];
     }
-
-    return read_len;
 }
 
-size_t A7672SA::http_read_response(uint8_t *buffer, size_t read_size, size_t offset, uint32_t timeout)
+void hash_stream::begin(hash_type type)
 {
-    uint32_t start = millis();
-
-    int read_len = 0;
-    int res_len = 0;
-
-    char cmd[100];
-    sprintf(cmd, "AT+HTTPREAD=%d,%d" GSM_NL, offset, read_size);
+    this->type = type;
+    this->bytes = 0;
+    this->crc = 0;
+    this->sha.init();
+}
 
-    this->sendCommand("HTTP", cmd);
-    int rxBytes = 0;
-    if (uart_is_driver_installed(UART_NUM_1) && this->at_response != NULL)
-        rxBytes = uart_read_bytes(UART_NUM_1, this->at_response, this->rx_buffer_size, pdMS_TO_TICKS(50));
+void hash_stream::update(const uint8_t *data, size_t len)
+{
+    if (this->type == HASH_CRC32)
+        this->crc = esp_rom_crc32_le(this->crc, data, len);
+    else
+        this->sha.update(data, len);
+    this->bytes += len;
+}
 
-    if (rxBytes > 0)
+size_t hash_stream::finish(uint8_t *digest)
+{
+    if (this->type == HASH_SHA256)
     {
-        this->at_response[rxBytes] = 0;
-        char *result = strstr(this->at_response, "+HTTPREAD");
-        if (result == NULL)
-        {
-            return -1;
-        }
+        this->sha.final(digest);
+        return 32;
+    }
+    digest[0] = (uint8_t)(this->crc >> 24);
+    digest[1] = (uint8_t)(this->crc >> 16);
+    digest[2] = (uint8_t)(this->crc >> 8);
+    digest[3] = (uint8_t)this->crc;
+    return 4;
+}
 
-        sscanf(result, "+HTTPREAD: %d%*s", &read_len);
-        if (read_len <= 0)
-            return -2;
+bool hash_stream::verify(const uint8_t *expected, size_t expected_len)
+{
+    uint8_t digest[32];
+    size_t len = this->finish(digest);
+    bool ok = expected_len == len && memcmp(digest, expected, len) == 0;
+    if (!ok)
+        ESP_LOGE("HASH", "%s mismatch after %d bytes", this->type == HASH_CRC32 ? "CRC-32" : "SHA-256", this->bytes);
+    return ok;
+}
 
-        // calcula o tamanho do read_len em dígitos, para obter o offset do buffer de resposta da UART
-        // não queremos o +HTTPREAD: %d\r\n
-        res_len = floor(log10(read_len)) + 1 + 20;
-        memcpy(buffer, this->at_response + res_len, read_len);
-    }
-    return read_len;
+// Só entram no hash os blocos aceitos por next (os sinks do pipeline recebem os blocos em ordem)
+data_sink hash_stream::wrap(data_sink next)
+{
+    hash_stream *self = this;
+    return [self, next](const uint8_t *data, size_t len, size_t offset)
+    {
+        if (next && !next(data, len, offset))
+            return false;
+        self->update(data, len);
+        return true;
+    };
 }
 
 void A7672SA::http_read_file(const char *filename, uint32_t timeout)
 {
     char cmd[100];
     sprintf(cmd, "AT+HTTPREADFILE=\"%s\"" GSM_NL, filename);
+    this->fs_invalidate_(); // o corpo é gravado (ou sobrescrito) em C:/
+    this->operator_scan_cancel();
     this->sendCommand("HTTP_REQUEST", cmd);
     this->wait_response(timeout);
 }
 
 void A7672SA::http_save_response(bool https)
 {
+    this->operator_scan_cancel();
     if (https)
         this->sendCommand("FS", "AT+FSCOPY=C:/https_body.dat,http_res.dat" GSM_NL); // C:/
     else
         this->sendCommand("FS", "AT+FSCOPY=C:/http_body.dat,http_res.dat" GSM_NL); // C:/
     this->wait_response();
+    this->fs_invalidate_();
 }
 
 bool A7672SA::http_term(uint32_t timeout)
 {
+    this->http_session_ = false;
+    this->operator_scan_cancel();
     this->sendCommand("HTTP_TERM", "AT+HTTPTERM" GSM_NL);
     return this->wait_response(timeout);
 }
@@ -2240,51 +4884,520 @@ bool A7672SA::fs_open(const char *filename, uint16_t mode, uint32_t timeout)
 {
     char cmd[100];
     sprintf(cmd, "AT+FSOPEN=C:/%s,%d" GSM_NL, filename, mode);
+    this->fs_invalidate_(); // conforme o modo o arquivo é criado ou truncado
+    this->operator_scan_cancel();
     this->sendCommand("FS_OPEN", cmd);
     return this->wait_response(timeout);
 }
 
 bool A7672SA::fs_close(uint32_t timeout)
 {
-    this->sendCommand("FS_CLOSE", "AT+FSCLOSE=1" GSM_NL);
+    return this->fs_close_handle(1, timeout);
+}
+
+int A7672SA::fs_open_handle(const char *filename, uint16_t mode, uint32_t timeout)
+{
+    char cmd[128];
+    if (snprintf(cmd, sizeof(cmd), "AT+FSOPEN=C:/%s,%d" GSM_NL, filename, mode) >= (int)sizeof(cmd))
+        return -1;
+
+    this->fs_opened_fd_ = -1;
+    this->fs_invalidate_();
+    this->operator_scan_cancel();
+    this->sendCommand("FS_OPEN", cmd);
+    if (!this->wait_response(timeout))
+        return -1;
+    return this->fs_opened_fd_;
+}
+
+bool A7672SA::fs_close_handle(int fd, uint32_t timeout)
+{
+    char cmd[32];
+    sprintf(cmd, "AT+FSCLOSE=%d" GSM_NL, fd);
+    this->fs_invalidate_(); // o tamanho de um arquivo escrito só fecha aqui
+    this->operator_scan_cancel();
+    this->sendCommand("FS_CLOSE", cmd);
+    return this->wait_response(timeout);
+}
+
+bool A7672SA::fs_seek_handle(int fd, size_t offset, uint32_t timeout)
+{
+    char cmd[48];
+    sprintf(cmd, "AT+FSSEEK=%d,%d,0" GSM_NL, fd, offset);
+    this->operator_scan_cancel();
+    this->sendCommand("FS_SEEK", cmd);
     return this->wait_response(timeout);
 }
 
+// AT+FSWRITE=<fd>,<n>,<timeout s> -> CONNECT, n bytes, OK (em blocos de até FS_WRITE_MAX)
+bool A7672SA::fs_write_handle(int fd, const uint8_t *data, size_t len, uint32_t timeout)
+{
+    seq_scope seq(*this);
+    this->fs_invalidate_();
+    while (len > 0)
+    {
+        size_t block = len < FS_WRITE_MAX ? len : FS_WRITE_MAX;
+        uint32_t uart_ms = (uint32_t)((uint64_t)block * 10 * 1000 / this->baud_rate_);
+
+        char cmd[48];
+        sprintf(cmd, "AT+FSWRITE=%d,%d,%d" GSM_NL, fd, block, (timeout + uart_ms) / 1000 + 1);
+        this->at_input = false;
+        this->sendCommand("FS_WRITE", cmd);
+        if (!this->wait_input(timeout))
+            return false;
+
+        this->at_ok = false;
+        this->uart_write_chunked_(data, block);
+        if (!this->wait_response(timeout + uart_ms))
+            return false;
+        data += block;
+        len -= block;
+    }
+    this->fs_invalidate_(); // uma listagem feita durante a escrita viu o tamanho parcial
+    return true;
+}
+
 bool A7672SA::fs_delete(const char *filename, uint32_t timeout)
 {
     char cmd[100];
     sprintf(cmd, "AT+FSDEL=%s" GSM_NL, filename);
+    this->fs_invalidate_();
+    this->operator_scan_cancel();
     this->sendCommand("FS_DELETE", cmd);
     return this->wait_response(timeout);
 }
 
 uint32_t A7672SA::fs_size(const char *filename, uint32_t timeout)
+{
+    if (this->fs_cache_.valid)
+    {
+        for (uint8_t i = 0; i < this->fs_cache_.count; i++)
+        {
+            if (strcmp(this->fs_cache_.files[i].name, filename) == 0)
+                return this->fs_cache_.files[i].size;
+        }
+        if (!this->fs_cache_.truncated)
+            return 0; // não existe
+    }
+    return this->fs_query_size_(filename, timeout);
+}
+
+// +FSATTRI: <tamanho>
+uint32_t A7672SA::fs_query_size_(const char *filename, uint32_t timeout)
 {
     char cmd[100];
-    sprintf(cmd, "AT+FSATTRI=C:/%s" GSM_NL, filename);
-    this->sendCommand("FS_LENGTH", cmd);
-    if (this->wait_response(timeout))
+    snprintf(cmd, sizeof(cmd), "AT+FSATTRI=C:/%s" GSM_NL, filename);
+    uint32_t size = 0;
+    this->operator_scan_cancel();
+    this->query_lines_(cmd, [&size](const char *line)
+                       { return sscanf(line, "+FSATTRI: %u", &size) == 1; }, timeout);
+    return size;
+}
+
+void A7672SA::fs_list_files(uint32_t timeout)
+{
+    const fs_listing &listing = this->fs_list(true, timeout);
+    for (uint8_t i = 0; i < listing.count; i++)
+        ESP_LOGI("FS_LIST", "%s (%d bytes)", listing.files[i].name, listing.files[i].size);
+    ESP_LOGI("FS_LIST", "%d files, %d of %d bytes used", listing.count, listing.used_bytes, listing.total_bytes);
+}
+
+const fs_listing &A7672SA::fs_list(bool refresh, uint32_t timeout)
+{
+    if (refresh || !this->fs_cache_.valid)
+        this->fs_refresh_(timeout);
+    return this->fs_cache_;
+}
+
+bool A7672SA::fs_exists(const char *filename, uint32_t timeout)
+{
+    const fs_listing &listing = this->fs_list(false, timeout);
+    for (uint8_t i = 0; i < listing.count; i++)
     {
-        // example: +FSATTRI: 8604
-        String data_string = "";
-        String length = "";
+        if (strcmp(listing.files[i].name, filename) == 0)
+            return true;
+    }
+    return listing.truncated && this->fs_query_size_(filename, timeout) > 0;
+}
+
+uint32_t A7672SA::fs_free_space(uint32_t timeout)
+{
+    const fs_listing &listing = this->fs_list(false, timeout);
+    return listing.total_bytes - listing.used_bytes;
+}
+
+/*
+AT+FSLS -> +FSLS: SUBDIRECTORIES:\r\n<dirs>\r\n+FSLS: FILES:\r\n<arquivos>\r\nOK
+AT+FSMEM -> +FSMEM: C:(<total>, <usado>)
+O tamanho de cada arquivo vem do AT+FSATTRI, uma vez por atualização.
+*/
+bool A7672SA::fs_refresh_(uint32_t timeout)
+{
+    // montada direto no cache (sem cópia na pilha); só vale de novo quando terminar
+    fs_listing &listing = this->fs_cache_;
+    memset(&listing, 0, sizeof(listing));
+    bool in_files = false;
+    this->operator_scan_cancel();
+    bool ok = this->query_lines_("AT+FSLS" GSM_NL, [&listing, &in_files](const char *line)
+                                 {
+                                     if (strncmp(line, "+FSLS:", 6) == 0)
+                                     {
+                                         in_files = strstr(line, "FILES") != nullptr && strstr(line, "SUBDIRECTORIES") == nullptr;
+                                         return true;
+                                     }
+                                     if (line[0] == '+')
+                                         return false; // URC: vai para o parser
+                                     if (!in_files)
+                                         return true; // subdiretório
+                                     if (listing.count == FS_LIST_MAX)
+                                     {
+                                         listing.truncated = true;
+                                         return true;
+                                     }
+                                     strncpy(listing.files[listing.count].name, line, sizeof(listing.files[0].name) - 1);
+                                     listing.count++;
+                                     return true;
+                                 },
+                                 timeout);
+    if (!ok)
+        return false;
+
+    for (uint8_t i = 0; i < listing.count; i++)
+        listing.files[i].size = this->fs_query_size_(listing.files[i].name, timeout);
+
+    this->query_lines_("AT+FSMEM" GSM_NL, [&listing](const char *line)
+                       { return sscanf(line, "+FSMEM: C:(%u, %u)", &listing.total_bytes, &listing.used_bytes) == 2; }, timeout);
+
+    listing.valid = true;
+    return true;
+}
+
+bool A7672SA::ota_from_fs(const char *filename, const uint8_t *sha256, size_t chunk_size, transfer_stats *stats, uint32_t timeout)
+{
+    uint32_t file_size = this->fs_size(filename, timeout);
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (file_size == 0 || partition == NULL || file_size > partition->size)
+    {
+        ESP_LOGE("OTA_FS", "Invalid image %s (%d bytes)", filename, file_size);
+        return false;
+    }
+
+    // a partição é apagada conforme a escrita avança, sobrepondo o apagamento à leitura da UART
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+    size_t image_size = OTA_WITH_SEQUENTIAL_WRITES;
+#else
+    size_t image_size = file_size;
+#endif
+    esp_ota_handle_t ota;
+    esp_err_t err = esp_ota_begin(partition, image_size, &ota);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("OTA_FS", "esp_ota_begin failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    int fd = this->fs_open_handle(filename, 2, timeout);
+    if (fd < 0)
+    {
+        esp_ota_abort(ota);
+        return false;
+    }
+
+    hash_stream hash;
+    hash.begin(HASH_SHA256);
+    size_t position = 0; // posição do ponteiro do arquivo no modem
+    bool ok = this->pipeline_transfer_([this, fd, &position, timeout](uint8_t *buffer, size_t max_len, size_t offset)
+                                       {
+                                           // releitura após falha: o FSREAD anterior pode ter avançado o ponteiro
+                                           if (offset != position)
+                                           {
+                                               if (!this->fs_seek_handle(fd, offset, timeout))
+                                                   return -1;
+                                               position = offset;
+                                           }
+                                           int n = this->fs_read_handle(fd, buffer, max_len, timeout);
+                                           if (n > 0)
+                                               position += n;
+                                           else if (n < 0) // bloco incompleto/truncado: ponteiro em posição incerta, força o FSSEEK
+                                               position = (size_t)-1;
+                                           return n;
+                                       },
+                                       file_size, hash.wrap([ota](const uint8_t *data, size_t len, size_t offset)
+                                                            { return esp_ota_write(ota, data, len) == ESP_OK; }),
+                                       chunk_size, stats, "OTA_FS");
+    this->fs_close_handle(fd, timeout);
+
+    if (ok && sha256 != nullptr)
+        ok = hash.verify(sha256, 32);
+
+    if (!ok)
+    {
+        esp_ota_abort(ota);
+        return false;
+    }
+
+    // esp_ota_end valida a imagem (cabeçalho e checksum do ESP-IDF) antes de aceitar a troca de partição
+    err = esp_ota_end(ota);
+    if (err == ESP_OK)
+        err = esp_ota_set_boot_partition(partition);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("OTA_FS", "Image rejected: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    ESP_LOGI("OTA_FS", "%s written to %s (%d bytes)", filename, partition->label, file_size);
+    return true;
+}
+
+ModemFile::ModemFile(A7672SA &modem, size_t block_size) : modem_(modem), block_size_(block_size > 0 ? block_size : FS_BLOCK_SIZE)
+{
+    // um bloco maior que um FSWRITE nunca sairia inteiro pelo caminho direto
+    if (this->block_size_ > FS_WRITE_MAX)
+        this->block_size_ = FS_WRITE_MAX;
+}
+
+ModemFile::~ModemFile()
+{
+    this->close();
+}
+
+bool ModemFile::open(const char *filename, uint16_t mode, bool read_ahead, uint32_t timeout)
+{
+    if (this->fd_ >= 0)
+        this->close();
+
+    this->timeout_ = timeout;
+    this->buffers_[0] = (uint8_t *)malloc(this->block_size_);
+    this->buffers_[1] = read_ahead ? (uint8_t *)malloc(this->block_size_) : nullptr;
+    bool ok = this->buffers_[0] && (!read_ahead || this->buffers_[1]);
+
+    if (ok && read_ahead)
+    {
+        this->prefetch_request_ = xSemaphoreCreateBinary();
+        this->prefetch_done_ = xSemaphoreCreateBinary();
+        this->prefetch_stop_ = false;
+        ok = this->prefetch_request_ && this->prefetch_done_ &&
+             xTaskCreate(prefetch_taskImpl, "fs_prefetch", configIDLE_TASK_STACK_SIZE * 4, this, uxTaskPriorityGet(NULL), &this->prefetch_task_) == pdPASS;
+        if (!ok)
+            this->prefetch_task_ = NULL;
+    }
+
+    if (ok)
+        this->fd_ = this->modem_.fs_open_handle(filename, mode, timeout);
+    if (this->fd_ < 0)
+    {
+        ESP_LOGE("FS_FILE", "Failed to open %s", filename);
+        this->close();
+        return false;
+    }
 
-        for (int j = 0; j < strlen(this->at_response); j++)
+    this->current_ = 0;
+    this->buffered_ = 0;
+    this->consumed_ = 0;
+    this->position_ = 0;
+    this->writing_ = false;
+    this->eof_ = false;
+    return true;
+}
+
+void ModemFile::prefetch_taskImpl(void *pvParameters)
+{
+    ModemFile *file = static_cast<ModemFile *>(pvParameters);
+    while (xSemaphoreTake(file->prefetch_request_, portMAX_DELAY) == pdPASS && !file->prefetch_stop_)
+    {
+        file->prefetch_result_ = file->modem_.fs_read_handle(file->fd_, file->buffers_[file->current_ ^ 1], file->block_size_, file->timeout_);
+        xSemaphoreGive(file->prefetch_done_);
+    }
+    xSemaphoreGive(file->prefetch_done_);
+    vTaskDelete(NULL);
+}
+
+// Pede à tarefa auxiliar o próximo bloco, no buffer que não está com o chamador
+void ModemFile::prefetch_start_()
+{
+    if (this->prefetch_task_ == NULL || this->prefetch_pending_)
+        return;
+    this->prefetch_pending_ = true;
+    xSemaphoreGive(this->prefetch_request_);
+}
+
+int ModemFile::prefetch_wait_()
+{
+    xSemaphoreTake(this->prefetch_done_, portMAX_DELAY);
+    this->prefetch_pending_ = false;
+    return this->prefetch_result_;
+}
+
+// Próximo bloco de leitura: vem do read-ahead quando houver, senão de um FSREAD síncrono
+int ModemFile::fill_()
+{
+    int n;
+    if (this->prefetch_pending_)
+    {
+        n = this->prefetch_wait_();
+        this->current_ ^= 1;
+    }
+    else
+    {
+        n = this->modem_.fs_read_handle(this->fd_, this->buffers_[this->current_], this->block_size_, this->timeout_);
+    }
+
+    this->consumed_ = 0;
+    this->buffered_ = n > 0 ? n : 0;
+    if (n >= 0 && (size_t)n < this->block_size_)
+        this->eof_ = true; // bloco curto: fim do arquivo
+    else if (n > 0)
+        this->prefetch_start_();
+    return n;
+}
+
+// Descarta o que foi lido à frente da posição lógica e devolve o ponteiro do modem para ela
+bool ModemFile::discard_read_()
+{
+    bool ahead = this->buffered_ > 0 || this->prefetch_pending_ || this->eof_;
+    if (this->prefetch_pending_)
+        this->prefetch_wait_();
+    this->buffered_ = 0;
+    this->consumed_ = 0;
+    this->eof_ = false;
+    return !ahead || this->modem_.fs_seek_handle(this->fd_, this->position_, this->timeout_);
+}
+
+int ModemFile::read(uint8_t *buffer, size_t len)
+{
+    if (this->fd_ < 0 || (this->writing_ && !this->flush()))
+        return -1;
+
+    size_t copied = 0;
+    while (copied < len)
+    {
+        if (this->consumed_ == (size_t)this->buffered_)
         {
-            data_string += this->at_response[j];
+            if (this->eof_)
+                break;
+            int n = this->fill_();
+            if (n < 0)
+                return copied > 0 ? (int)copied : n;
+            if (n == 0)
+                break;
         }
 
-        data_string.trim();
+        size_t take = len - copied < this->buffered_ - this->consumed_ ? len - copied : this->buffered_ - this->consumed_;
+        memcpy(buffer + copied, this->buffers_[this->current_] + this->consumed_, take);
+        if (this->hash_ != nullptr)
+            this->hash_->update(buffer + copied, take);
+        this->consumed_ += take;
+        this->position_ += take;
+        copied += take;
+    }
+    return copied;
+}
+
+size_t ModemFile::write(const uint8_t *data, size_t len)
+{
+    if (this->fd_ < 0)
+        return 0;
+    if (!this->writing_ && !this->discard_read_())
+        return 0;
+
+    size_t written = 0;
+    while (written < len)
+    {
+        this->writing_ = true;
+        size_t remaining = len - written;
 
-        length = data_string.substring(data_string.indexOf(":") + 1, data_string.indexOf("\n") - 1);
+        // blocos grandes com o buffer vazio vão direto, sem cópia
+        size_t direct = remaining < FS_WRITE_MAX ? remaining : FS_WRITE_MAX;
+        direct -= direct % this->block_size_;
+        if (this->buffered_ == 0 && direct > 0)
+        {
+            if (!this->modem_.fs_write_handle(this->fd_, data + written, direct, this->timeout_))
+                return written;
+            if (this->hash_ != nullptr)
+                this->hash_->update(data + written, direct);
+            written += direct;
+            this->position_ += direct;
+            continue;
+        }
 
-        return length.toInt();
+        size_t take = remaining < this->block_size_ - this->buffered_ ? remaining : this->block_size_ - this->buffered_;
+        memcpy(this->buffers_[this->current_] + this->buffered_, data + written, take);
+        if (this->hash_ != nullptr)
+            this->hash_->update(data + written, take);
+        this->buffered_ += take;
+        this->position_ += take;
+        written += take;
+        if ((size_t)this->buffered_ == this->block_size_ && !this->flush())
+            return written - take;
     }
-    return 0;
+    return written;
 }
 
-void A7672SA::fs_list_files(uint32_t timeout)
+bool ModemFile::flush()
 {
-    this->sendCommand("FS_LIST", "AT+FSLS" GSM_NL);
-    this->wait_response(timeout);
-}
\ No newline at end of file
+    if (!this->writing_)
+        return true;
+
+    bool ok = this->buffered_ == 0 || this->modem_.fs_write_handle(this->fd_, this->buffers_[this->current_], this->buffered_, this->timeout_);
+    this->buffered_ = 0;
+    this->writing_ = false;
+    return ok;
+}
+
+bool ModemFile::seek(size_t offset)
+{
+    if (this->fd_ < 0 || !this->flush())
+        return false;
+    if (this->prefetch_pending_)
+        this->prefetch_wait_();
+
+    this->buffered_ = 0;
+    this->consumed_ = 0;
+    this->eof_ = false;
+    if (!this->modem_.fs_seek_handle(this->fd_, offset, this->timeout_))
+        return false;
+    this->position_ = offset;
+    return true;
+}
+
+void ModemFile::attach_hash(hash_stream *hash, const uint8_t *expected, size_t expected_len)
+{
+    this->hash_ = hash;
+    this->expected_digest_ = expected;
+    this->expected_len_ = expected_len;
+}
+
+bool ModemFile::close()
+{
+    bool ok = this->fd_ < 0 || this->flush();
+    if (this->fd_ >= 0 && this->hash_ != nullptr && this->expected_digest_ != nullptr)
+        ok = this->hash_->verify(this->expected_digest_, this->expected_len_) && ok;
+    this->hash_ = nullptr;
+    this->expected_digest_ = nullptr;
+    if (this->prefetch_task_ != NULL)
+    {
+        if (this->prefetch_pending_)
+            this->prefetch_wait_();
+        this->prefetch_stop_ = true;
+        xSemaphoreGive(this->prefetch_request_);
+        xSemaphoreTake(this->prefetch_done_, portMAX_DELAY);
+        this->prefetch_task_ = NULL;
+    }
+    if (this->prefetch_request_)
+        vSemaphoreDelete(this->prefetch_request_);
+    if (this->prefetch_done_)
+        vSemaphoreDelete(this->prefetch_done_);
+    this->prefetch_request_ = NULL;
+    this->prefetch_done_ = NULL;
+
+    if (this->fd_ >= 0)
+        ok = this->modem_.fs_close_handle(this->fd_, this->timeout_) && ok;
+    this->fd_ = -1;
+
+    free(this->buffers_[0]);
+    free(this->buffers_[1]);
+    this->buffers_[0] = nullptr;
+    this->buffers_[1] = nullptr;
+    return ok;
+}
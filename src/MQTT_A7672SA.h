@@ -9,11 +9,13 @@
 #define MQTT_A7672SA_H_
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <vector>
 #include <functional>
+#include <algorithm>
 #include <string>
 
 #include "esp_system.h"
@@ -23,10 +25,15 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
+#include "freertos/event_groups.h"
 
 #include "driver/uart.h"
 #include "driver/gpio.h"
 
+#include "nvs.h"
+#include "esp_ota_ops.h"
+#include "esp_rom_crc.h"
+
 #include "Arduino.h"
 
 #include <IPAddress.h>
@@ -37,7 +44,61 @@
 
 #define UART_QUEUE_SIZE 10
 
+#define BOOT_POWER_OFF_MS 2000      // tempo com EN em nível alto para desligar o modem em begin()
+#define BOOT_AT_PROBE_MS 250        // intervalo entre os "AT" de sondagem enquanto o modem inicia
+#define BOOT_READY_TIMEOUT_MS 20000 // sondagem sem resposta por este tempo => volta ao ciclo CFUN=1/CFUN?
+#define BOOT_CMD_TIMEOUT_MS 1000    // prazo de cada comando de inicialização (ATE0, CMEE, CREG...)
+#define BOOT_CFUN_TIMEOUT_MS 9000   // AT+CFUN=1 pode levar alguns segundos
+
+#define MQTT_INFLIGHT_MAX 8         // tamanho da tabela de mensagens QoS 1/2 em voo
+#define MQTT_INFLIGHT_WINDOW 4      // janela padrão (ajustável com mqtt_set_inflight_window)
+#define MQTT_INFLIGHT_MAX_RETRIES 3 // tentativas de reenvio antes de descartar a mensagem
+#define MQTT_ACK_SYNC -1             // entrada do ack_fifo_ para publicações síncronas (sem slot)
+
+#define MQTT_TOPIC_MAX_LEN 256
+#define MQTT_PUB_CMD_SIZE (MQTT_TOPIC_MAX_LEN + 48)
+#define MQTT_MAX_PAYLOAD_SIZE 10240 // limite do AT+CMQTTPUB no A7672
+#define MQTT_MAX_TOPIC_HANDLES 8
+
+#define A7672SA_NVS_NAMESPACE "a7672sa"
+#define MQTT_KEEPALIVE_MIN 30
+#define MQTT_KEEPALIVE_MAX 1200
+#define MQTT_STALL_PROBE_MS 5000          // atraso de ack que dispara a sonda de sessão meio-aberta
+#define MQTT_PROBE_DEADLINE_MS 5000       // prazo para o broker responder a sonda
+#define MQTT_PROBE_TOPIC "a7672sa/probe" // UNSUBSCRIBE deste tópico é respondido pelo broker mesmo sem assinatura
+#define UART_TX_CHUNK_SIZE 256      // bloco de escrita na UART para payloads grandes
+
+#define TRANSFER_CHUNK_SIZE 4096  // bloco padrão dos downloads em pipeline
+#define TRANSFER_MAX_RETRIES 3    // releituras do mesmo bloco antes de abortar
+
+#define FS_BLOCK_SIZE 4096  // bloco de leitura/escrita do ModemFile
+#define FS_WRITE_MAX 10240  // maior bloco aceito por um AT+FSWRITE
+#define FS_LIST_MAX 16      // arquivos guardados na listagem em cache
+
+#define OPERATOR_LIST_MAX 12          // operadoras guardadas do AT+COPS=?
+#define OPERATOR_LIST_TTL_MS 600000   // validade da lista em cache
+#define OPERATOR_SCAN_TIMEOUT 180000  // o AT+COPS=? pode levar minutos em 2G/3G/LTE
+
+#define ATTACH_PROFILE_KEY "attach"     // chave NVS da última combinação operadora/RAT/APN que funcionou
+#define FAST_ATTACH_DEADLINE_MS 30000   // prazo da tentativa com o perfil salvo (e de cada operadora no fallback)
+
+#define RADIO_HISTORY_SIZE 16           // amostras de CSQ/CPSI guardadas no anel
+#define RADIO_SAMPLE_INTERVAL_MS 30000  // intervalo padrão do amostrador em segundo plano
+
+#define HTTP_DATA_MAX_SIZE 153600            // maior corpo aceito pelo AT+HTTPDATA
+#define HTTP_UPLOAD_FILE "http_upload.dat" // arquivo temporário dos uploads maiores que HTTP_DATA_MAX_SIZE
+#define HTTP_REQUEST_ARENA_SIZE 1536       // linhas AT pré-montadas de um http_request_desc
+#define HTTP_URL_MAX_LEN 512
+#define HTTP_USERDATA_MAX_LEN 256
+#define HTTP_HEADER_BUF_SIZE 1024          // bloco de cabeçalhos lido do HTTPHEAD (o excesso é descartado)
+#define HTTP_MAX_HEADERS 32
+#define HTTP_HEADER_SEP "\\r\\n"           // separador de cabeçalhos no USERDATA (o modem converte para CRLF)
+#define DOWNLOAD_RANGE_SIZE 131072         // bytes pedidos por requisição Range
+#define DOWNLOAD_CHECKPOINT_INTERVAL 32768 // bytes entre gravações do checkpoint na NVS
+#define DOWNLOAD_MAX_ATTEMPTS 5            // requisições seguidas sem progresso antes de desistir
+
 #define DEFAULT_CID 1
+#define PDN_MAX_CID 10 // CIDs 1..10
 
 #define GSM_NL "\r\n"
 #define GSM_NM "+"
@@ -51,6 +112,129 @@ struct mqtt_message
     size_t length;
 };
 
+enum mqtt_inflight_state
+{
+    INFLIGHT_FREE = 0,
+    INFLIGHT_QUEUED = 1, // aguardando envio (ou reenvio após reconexão)
+    INFLIGHT_SENT = 2    // entregue ao modem, aguardando +CMQTTPUB
+};
+
+// Índice de um tópico pré-registrado (mqtt_register_topic); -1 = inválido
+typedef int8_t mqtt_topic_handle;
+
+// Prefixo "AT+CMQTTPUB=0,"<topic>",<qos>," já renderizado, falta só o tamanho do payload
+struct mqtt_topic_entry
+{
+    char *prefix;
+    uint16_t prefix_len;
+    uint8_t qos;
+};
+
+struct mqtt_inflight_slot
+{
+    uint16_t msg_id;
+    uint8_t qos;
+    uint8_t retries;
+    mqtt_topic_handle handle; // quando >= 0 o comando sai do prefixo do handle (topic fica NULL)
+    mqtt_inflight_state state;
+    volatile int8_t *outcome; // publicação síncrona esperando: recebe 1 (entregue) ou 0 (descartada) na liberação
+    char *topic;
+    uint8_t *payload;
+    size_t length;
+    uint32_t sent_at;
+};
+
+/*
+Fornece o próximo trecho do payload: escreve até max_len bytes em buffer, a partir de offset.
+Retorna quantos bytes foram escritos (<= 0 aborta).
+*/
+using payload_reader = std::function<int(uint8_t *buffer, size_t max_len, size_t offset)>;
+
+/*
+Recebe um bloco de dados de uma transferência (offset = posição do bloco no conteúdo).
+Retorna false para abortar a transferência.
+*/
+using data_sink = std::function<bool(const uint8_t *data, size_t len, size_t offset)>;
+
+struct transfer_stats
+{
+    size_t bytes;
+    uint32_t elapsed_ms;
+    uint32_t chunks;
+    uint32_t retries;
+    uint32_t bytes_per_s;
+};
+
+// Trecho de um payload montado sem cópia (estilo iovec)
+struct data_segment
+{
+    const uint8_t *data;
+    size_t len;
+};
+
+struct fs_entry
+{
+    char name[48];
+    uint32_t size;
+};
+
+// Listagem de C:/ (AT+FSLS) com tamanhos (AT+FSATTRI) e espaço livre (AT+FSMEM), mantida em cache
+struct fs_listing
+{
+    fs_entry files[FS_LIST_MAX];
+    uint8_t count;
+    bool truncated; // havia mais de FS_LIST_MAX arquivos
+    bool valid;
+    uint32_t total_bytes;
+    uint32_t used_bytes;
+};
+
+// Linha do tempo da inicialização, em ms desde que o EN foi liberado (0 = marco não visto)
+struct boot_timeline
+{
+    uint32_t power_off_ms; // tempo gasto com o modem desligado antes de liberar o EN
+    uint32_t rdy;          // URC RDY / *ATREADY
+    uint32_t at_ok;        // primeiro AT respondido
+    uint32_t cfun;         // +CFUN: 1
+    uint32_t sim_ready;    // +CPIN: READY
+    uint32_t init_done;    // último comando de inicialização confirmado
+    uint32_t sms_done;
+    uint32_t pb_done;
+    uint16_t at_probes;
+};
+
+// Resultado de AT+CGSN;+CICCID;+CSPN?;+CGPADDR. Campos vazios = não reportados (ex.: sem SIM).
+struct modem_identity
+{
+    char imei[16];
+    char iccid[23];
+    char provider[24];
+    uint8_t provider_display; // segundo campo do +CSPN
+    uint8_t cid;              // CID do endereço abaixo
+    char ipv4[16];
+    char ipv6[64];
+    uint32_t at_ms; // millis() da última consulta (0 = nunca)
+};
+
+// Uma amostra de AT+CSQ;+CPSI?. Os campos LTE vêm como o modem reporta (décimos de dB no A76xx).
+struct radio_sample
+{
+    uint32_t at_ms;       // millis() da amostra
+    uint8_t csq;          // 0..31, 99 = desconhecido
+    uint8_t ber;          // 0..7, 99 = desconhecido
+    char system_mode[12]; // "LTE", "GSM", "WCDMA", "NO SERVICE"...
+    uint16_t mcc;
+    uint16_t mnc;
+    uint32_t tac; // TAC (LTE) ou LAC
+    uint32_t cell_id;
+    int16_t rsrq;
+    int16_t rsrp;
+    int16_t rssi;
+    int16_t sinr;
+
+    int rssi_dbm() const { return csq == 99 ? 0 : -113 + 2 * csq; }
+};
+
 struct commandMessage
 {
     char logName[48];
@@ -63,6 +247,78 @@ struct http_response
     size_t http_header_size;
     size_t http_content_size;
     char http_etag[33];
+    size_t http_range_start; // Content-Range: bytes <start>-<end>/<total> (respostas 206)
+    size_t http_range_total;
+    char http_last_modified[32];
+};
+
+// Cabeçalho da última resposta, apontando para dentro do buffer do HTTPHEAD (válido até a próxima requisição)
+struct http_header_field
+{
+    const char *name;
+    const char *value;
+};
+
+// Validadores da última resposta 200 de uma URL, salvos na NVS para o GET condicional
+struct http_cache_entry
+{
+    char etag[33];
+    char last_modified[32];
+    uint32_t content_size;
+};
+
+struct http_cache_counters
+{
+    uint32_t requests;
+    uint32_t hits; // respostas 304
+    uint32_t bytes_saved;
+};
+
+// SHA-256 em software com estado simples (pode ser copiado/salvo na NVS e continuado depois)
+struct sha256_state
+{
+    uint32_t h[8];
+    uint64_t length;
+    uint8_t block[64];
+
+    void init();
+    void update(const uint8_t *data, size_t len);
+    void final(uint8_t digest[32]);
+};
+
+enum hash_type
+{
+    HASH_CRC32 = 0,
+    HASH_SHA256 = 1
+};
+
+/*
+Hash incremental (CRC-32 ou SHA-256) calculado enquanto os dados passam, sem uma segunda leitura:
+wrap(sink) para http_download/pipelines, ModemFile::attach_hash para leituras e escritas no sistema de arquivos do modem.
+finish() grava o digest (CRC-32 em big-endian) e retorna seu tamanho; verify() compara com o digest esperado.
+*/
+struct hash_stream
+{
+    hash_type type;
+    size_t bytes;
+    uint32_t crc;
+    sha256_state sha;
+
+    void begin(hash_type type = HASH_SHA256);
+    void update(const uint8_t *data, size_t len);
+    size_t finish(uint8_t *digest);
+    bool verify(const uint8_t *expected, size_t expected_len);
+    data_sink wrap(data_sink next);
+};
+
+// Progresso de um download retomável, salvo na NVS (blob) sob a chave escolhida pelo chamador
+struct download_checkpoint
+{
+    uint32_t url_hash;
+    uint32_t total;     // 0 = ainda desconhecido
+    uint32_t committed; // bytes já entregues (e confirmados) pelo sink
+    char etag[33];
+    sha256_state sha; // hash dos bytes [0, committed)
 };
 
 struct NetworkOperator
@@ -74,6 +330,53 @@ struct NetworkOperator
     int access_tech;
 };
 
+// Resultado do último AT+COPS=?, em cache com validade (OPERATOR_LIST_TTL_MS)
+struct operator_list
+{
+    NetworkOperator ops[OPERATOR_LIST_MAX];
+    uint8_t count;
+    bool truncated;     // o modem reportou mais que OPERATOR_LIST_MAX operadoras
+    int serving_act;    // AcT da operadora servidora no momento da busca (-1 = desconhecido)
+    uint32_t at_ms;     // millis() da busca (0 = nunca)
+};
+
+// Estado de rede lido numa única consulta (AT+CGDCONT?;+CGAUTH?;+CNMP?;+CGATT?;+CGACT?;+CREG?;+CGREG?;+CEREG?).
+// -1 / vazio = não reportado (a linha de comando para no primeiro ERROR).
+struct net_config
+{
+    char pdp_type[8]; // do CID consultado
+    char apn[64];
+    int8_t auth_type;
+    char user[32]; // o modem não devolve a senha
+    int16_t cnmp;
+    int8_t attached;
+    int8_t active; // CGACT do CID consultado
+    int8_t creg_n;
+    int8_t cgreg_n;
+    int8_t cereg_n;
+};
+
+// Configuração e estado de um contexto PDP (um por CID)
+struct pdn_context
+{
+    char pdp_type[8];
+    char apn[64];
+    bool configured; // pdn_configure() aplicado nesta execução
+    bool active;
+    uint32_t changed_ms; // millis() da última ativação/queda
+    uint16_t drops;      // quedas desde o begin()
+};
+
+// Última operadora/RAT/APN que levou a PDN ativa + sessão MQTT, persistida na NVS. Usuário e senha do APN
+// não entram: a NVS não é cifrada por padrão
+struct attach_profile
+{
+    char numeric_code[8];
+    int8_t access_tech;
+    uint8_t network_mode; // valor do AT+CNMP
+    char apn[64];
+};
+
 enum registration_status
 {
     NOT_REGISTERED = 0,
@@ -86,6 +389,21 @@ enum registration_status
     REGISTERED_SMS_ONLY_ROAMING = 7
 };
 
+// Níveis de conectividade, do mais baixo ao mais alto. Cada nível pressupõe os anteriores.
+enum connectivity_state
+{
+    CONN_MODEM_OFF = 0,
+    CONN_AT_READY,
+    CONN_SIM_READY,
+    CONN_REGISTERED,
+    CONN_PDN_UP,
+    CONN_MQTT_UP,
+    CONN_STATE_COUNT
+};
+
+// Bit do event group de conectividade: fica setado enquanto o nível atual for >= state
+#define CONN_BIT(state) ((EventBits_t)1 << (state))
+
 enum mqtt_status // todo:
 {
     A7672SA_MQTT_CONNECTED = 0,
@@ -103,6 +421,43 @@ enum HTTP_METHOD
     PUT = 4
 };
 
+// Parâmetros HTTPPARA guardados (como hash) durante uma sessão HTTP, para só reenviar o que mudou
+enum http_para_slot
+{
+    HTTP_PARA_URL = 0,
+    HTTP_PARA_SSL,
+    HTTP_PARA_CONNECTTO,
+    HTTP_PARA_RECVTO,
+    HTTP_PARA_CONTENT,
+    HTTP_PARA_ACCEPT,
+    HTTP_PARA_USERDATA,
+    HTTP_PARA_READMODE,
+    HTTP_PARA_COUNT
+};
+
+/*
+Requisição HTTP montada uma vez: build() valida os tamanhos e renderiza as linhas AT+HTTPPARA (e o AT+HTTPACTION) num
+arena fixo, já com o hash usado para pular parâmetros repetidos numa sessão. Cada http_request(desc) só reenvia as linhas
+prontas, sem sprintf nem buffers na pilha. O descritor pode ser reutilizado enquanto url e parâmetros não mudarem.
+*/
+struct http_request_desc
+{
+    HTTP_METHOD method;
+    bool ssl;
+    bool has_user_data;
+    uint16_t recv_timeout;
+    uint16_t line[HTTP_PARA_COUNT]; // offset de cada linha no arena (em HTTP_PARA_SSL fica o AT+CSSLCFG="cacert")
+    uint32_t hash[HTTP_PARA_COUNT];
+    uint16_t action;
+    uint16_t used; // 0 = não montado
+    char arena[HTTP_REQUEST_ARENA_SIZE];
+
+    bool build(const char *url, HTTP_METHOD method = GET, bool ssl = false, const char *ca_name = "ca.pem", const char *user_data = "",
+               uint32_t con_timeout = 120, uint32_t recv_timeout = 120, const char *content = "text/plain", const char *accept = "*/*",
+               uint8_t read_mode = 0);
+    const char *line_at(http_para_slot slot) const { return arena + line[slot]; }
+};
+
 enum network_mode
 {
     AUTOMATIC = 2,
@@ -113,11 +468,14 @@ enum network_mode
 
 class A7672SA
 {
+    friend struct host_bench_access; // test/host/bench: mede a montagem dos comandos sem passar pela UART
+
 private:
     QueueHandle_t uartQueue;
     TaskHandle_t rxTaskHandle;
     TaskHandle_t txTaskHandle;
     SemaphoreHandle_t rx_guard, publish_guard;
+    SemaphoreHandle_t seq_guard_ = NULL; // troca de vários passos em curso (prompt + corpo, HTTPPARA + HTTPACTION...)
 
     gpio_num_t tx_pin;
     gpio_num_t rx_pin;
@@ -127,13 +485,24 @@ private:
     bool http_response;
     bool publishing;
 
-    struct http_response http_response_data = {0, 0, 0, ""};
+    struct http_response http_response_data = {0, 0, 0, "", 0, 0, ""};
+    http_cache_counters http_cache_counters_ = {};
 
     registration_status cs_reg_stat_ = UNKNOWN;  // CREG (CS domain)
     registration_status ps_reg_stat_ = UNKNOWN;  // CGREG (PS 2G/3G)
     registration_status eps_reg_stat_ = UNKNOWN; // CEREG (PS LTE/EPS)
 
-    bool pdn_active[11] = {false}; // suporta CIDs 1..10
+    bool pdn_active[PDN_MAX_CID + 1] = {false}; // suporta CIDs 1..10
+    pdn_context pdn_[PDN_MAX_CID + 1] = {};
+    char pdn_user_[PDN_MAX_CID + 1][32] = {};     // credenciais do último pdn_apply_ (a senha não é legível no modem)
+    char pdn_password_[PDN_MAX_CID + 1][32] = {};
+    uint8_t mqtt_cid_ = DEFAULT_CID; // contexto usado pelo serviço MQTT
+    uint8_t http_cid_ = DEFAULT_CID; // contexto usado pelo serviço HTTP
+    uint8_t csock_cid_ = 0;          // último AT+CSOCKSETPN aplicado (0 = desconhecido)
+    void pdn_set_(uint8_t cid, bool active);
+    bool pdn_apply_(uint8_t cid, const char *pdp_type, const char *apn, const char *user, const char *password,
+                    net_config &cur, uint32_t timeout);
+    bool csock_select_(uint8_t cid, uint32_t timeout);
 
     bool at_ok;
     bool at_error;
@@ -143,18 +512,166 @@ private:
     bool silent_mode = false;
     char *at_response;
     uint32_t rx_buffer_size;
-    std::vector<NetworkOperator> available_operators;
+    int32_t baud_rate_ = 115200;
     bool operators_list_updated;
+    operator_list operators_ = {};
+    portMUX_TYPE operators_lock_ = portMUX_INITIALIZER_UNLOCKED;
+    uint8_t network_mode_ = AUTOMATIC;
+    void attach_remember_();
+    bool attach_try_(const char *cops, const attach_profile &profile, const char *user, const char *password, uint32_t deadline);
+    TaskHandle_t cops_task_ = NULL;
+    volatile bool cops_scanning_ = false; // AT+COPS=? em curso no modem
+    volatile bool cops_cancel_ = false;
+    uint32_t cops_timeout_ = OPERATOR_SCAN_TIMEOUT;
+    void operator_scan_task();
+    static void operator_scan_taskImpl(void *pvParameters);
 
     void (*on_message_callback_)(mqtt_message &message);
     void (*on_mqtt_status_)(mqtt_status &status);
     void (*on_ps_reg_event_)(registration_status stat) = nullptr;
+    void (*on_publish_complete_)(uint16_t msg_id, bool delivered) = nullptr;
+    void (*on_connectivity_change_)(connectivity_state from, connectivity_state to, uint32_t at_ms) = nullptr;
+
+    // Máquina de estados de conectividade, derivada das flags que o parser já mantém
+    bool sim_ready_ = false;
+    EventGroupHandle_t conn_events_ = NULL;
+    portMUX_TYPE conn_lock_ = portMUX_INITIALIZER_UNLOCKED;
+    connectivity_state conn_state_ = CONN_MODEM_OFF;
+    uint32_t conn_since_ = 0;
+    uint32_t conn_entered_[CONN_STATE_COUNT] = {};
+    uint32_t conn_time_in_state_[CONN_STATE_COUNT] = {};
+    uint32_t conn_transitions_ = 0;
+
+    // Tabela de publicações QoS 1/2 em voo. O +CMQTTPUB não carrega o id da mensagem,
+    // então as confirmações são correlacionadas pela ordem de envio (ack_fifo_). A ordem só vale dentro de um
+    // mesmo QoS (QoS 0 confirma na hora, QoS 1/2 depois do PUBACK/PUBCOMP): o fifo guarda um QoS por vez (ack_qos_).
+    SemaphoreHandle_t inflight_guard = NULL;
+    mqtt_inflight_slot inflight_[MQTT_INFLIGHT_MAX] = {};
+    uint8_t inflight_window_ = MQTT_INFLIGHT_WINDOW;
+    uint16_t msg_id_seq_ = 1;
+    int8_t ack_fifo_[MQTT_INFLIGHT_MAX + 1] = {};
+    uint8_t ack_head_ = 0;
+    uint8_t ack_count_ = 0;
+    uint8_t ack_qos_ = 0; // QoS das entradas do fifo (vale com ack_count_ > 0)
+
+    mqtt_topic_entry topic_handles_[MQTT_MAX_TOPIC_HANDLES] = {};
+
+    // Keepalive adaptativo: o maior valor que sobreviveu ao NAT da rede (operadora + tecnologia) fica salvo na NVS
+    NetworkOperator current_operator_ = {};
+    bool adaptive_keepalive_ = false;
+    uint16_t ka_min_ = MQTT_KEEPALIVE_MIN;
+    uint16_t ka_max_ = MQTT_KEEPALIVE_MAX;
+    uint16_t ka_good_ = 0;    // maior keepalive já comprovado nesta rede
+    uint16_t ka_ceiling_ = 0; // menor keepalive que já derrubou a sessão
+    char ka_key_[16] = "";
+    uint16_t session_keepalive_ = 0;
+    uint32_t session_start_ = 0;
+    bool session_proven_ = false;
+    uint32_t stall_probe_ms_ = MQTT_STALL_PROBE_MS;
+    uint32_t probe_deadline_ms_ = MQTT_PROBE_DEADLINE_MS;
+    volatile int probe_err_ = -1; // <err> do +CMQTTUNSUB da sonda (-1 = sem resposta)
+
+    uint16_t keepalive_select_(uint16_t requested);
+    void keepalive_check_proven_();
+    void keepalive_session_end_(bool lost);
+    void keepalive_store_();
+    bool wait_publish_ack_(std::function<bool()> done, uint32_t timeout, const char *operation_name);
+    bool mqtt_probe_session_();
+
+    void inflight_lock_();
+    void inflight_unlock_();
+    int inflight_find_(uint16_t msg_id);
+    int inflight_oldest_(mqtt_inflight_state state);
+    uint8_t inflight_used_();
+    void inflight_release_(int idx, bool delivered);
+    uint16_t next_msg_id_();
+    void inflight_requeue_();
+    bool ack_push_(int8_t entry, uint8_t qos);
+    int8_t ack_pop_();
+    bool ack_wait_qos_(uint8_t qos, uint32_t timeout);
+    void handle_publish_ack_(int err);
+    bool mqtt_send_slot_(int idx, uint32_t timeout);
+    uint16_t mqtt_enqueue_(const char *topic, mqtt_topic_handle handle, const uint8_t *data, size_t len, uint16_t qos, uint32_t timeout,
+                           volatile int8_t *outcome = nullptr);
+    uint16_t mqtt_enqueue_reader_(const char *topic, mqtt_topic_handle handle, payload_reader reader, size_t len, uint16_t qos, uint32_t timeout,
+                                  volatile int8_t *outcome = nullptr);
+    bool mqtt_wait_outcome_(uint16_t msg_id, volatile int8_t *outcome, uint32_t timeout);
+    bool mqtt_publish_tracked_(const char *topic, payload_reader reader, size_t len, uint16_t qos, uint32_t timeout);
+    size_t mqtt_render_prefix_(char *out, size_t out_size, const char *topic, uint16_t qos);
+    size_t mqtt_render_cmd_(char *out, const char *prefix, size_t prefix_len, size_t len);
+    bool mqtt_publish_begin_(const char *topic, size_t len, uint16_t qos, uint32_t timeout);
+    bool mqtt_publish_begin_(const char *cmd, size_t cmd_len, uint32_t timeout);
+    bool mqtt_publish_end_(uint32_t timeout);
+    size_t uart_write_chunked_(const uint8_t *data, size_t len);
+    bool uart_write_stream_(payload_reader reader, size_t len, uint32_t *chunks, const char *name);
+    volatile int fs_opened_fd_ = -1; // último +FSOPEN: <fd>
+    fs_listing fs_cache_ = {};
+
+    void fs_invalidate_() { fs_cache_.valid = false; }
+    bool fs_refresh_(uint32_t timeout);
+    uint32_t fs_query_size_(const char *filename, uint32_t timeout);
+
+    bool http_session_ = false; // HTTPINIT mantido entre requisições (http_session_begin)
+    uint32_t http_para_hash_[HTTP_PARA_COUNT] = {};
+
+    bool nvs_load_(const char *key, void *data, size_t size);
+    bool nvs_store_(const char *key, const void *data, size_t size);
+    void nvs_erase_(const char *key);
+
+    http_request_desc http_scratch_ = {}; // descritor das chamadas http_request(url, ...) de parâmetros soltos
+
+    bool http_para_(http_para_slot slot, const char *line, uint32_t hash, uint32_t timeout);
+    bool http_configure_(const http_request_desc &request, uint32_t timeout);
+    bool http_data_begin_(size_t size, uint32_t timeout);
+    bool http_send_body_(const data_segment *body, size_t n_segments, uint32_t timeout);
+    uint32_t http_action_(const char *cmd, uint32_t recv_timeout, uint32_t timeout);
+    bool http_read_headers_(uint32_t timeout);
+    void http_parse_headers_(size_t len);
+    char http_header_buf_[HTTP_HEADER_BUF_SIZE + 1] = {};
+    http_header_field http_headers_[HTTP_MAX_HEADERS] = {};
+    uint8_t http_header_count_ = 0;
 
     void on_ps_lost_();
+    connectivity_state conn_level_() const;
+    void conn_update_();
     void apply_creg_(registration_status st);
     void apply_cgreg_(registration_status st);
     void apply_cereg_(registration_status st);
 
+    // Histórico de rádio publicado com seqlock: leitores copiam sem travar e repetem se o
+    // escritor (amostrador ou signal_quality) mexeu no anel durante a cópia.
+    radio_sample radio_history_[RADIO_HISTORY_SIZE] = {};
+    volatile uint32_t radio_seq_ = 0;
+    uint8_t radio_head_ = 0; // próxima posição a escrever
+    uint8_t radio_count_ = 0;
+    portMUX_TYPE radio_lock_ = portMUX_INITIALIZER_UNLOCKED; // serializa escritores
+    TaskHandle_t radio_task_ = NULL;
+    volatile bool radio_run_ = false;
+    uint32_t radio_interval_ms_ = RADIO_SAMPLE_INTERVAL_MS;
+
+    bool radio_sample_now_(uint32_t timeout);
+    void radio_publish_(const radio_sample &sample);
+    bool radio_idle_() const;
+    void radio_task();
+    static void radio_taskImpl(void *pvParameters);
+
+    // IMEI/ICCID ficam em cache; URCs de SIM e de reset do modem só derrubam o ICCID (o IMEI é do módulo)
+    modem_identity identity_ = {};
+    void identity_invalidate_(bool sim_only = false)
+    {
+        if (!sim_only)
+            identity_.imei[0] = 0;
+        identity_.iccid[0] = 0;
+    }
+
+    boot_timeline boot_ = {};
+    uint32_t boot_start_ = 0;
+    bool boot_tracking_ = false;
+    void boot_mark_(uint32_t &milestone);
+    void boot_scan_(const char *data);
+    bool boot_cmd_(const char *name, const char *cmd, uint32_t timeout = BOOT_CMD_TIMEOUT_MS);
+    bool boot_wait_ready_();
+
     void rx_task();
     static void rx_taskImpl(void *pvParameters);
     void tx_task();
@@ -166,6 +683,17 @@ private:
     bool receiveCommand(commandMessage *message);
 
     void simcomm_response_parser(const char *data);
+    void simcomm_dispatch(const char *data);
+    void dispatch_line_(const char *line);
+
+    bool rx_acquire_();
+    void rx_release_(bool acquired);
+    bool pipeline_transfer_(payload_reader producer, size_t total, data_sink sink, size_t chunk_size, transfer_stats *stats, const char *name);
+    static void pipeline_sink_taskImpl(void *pvParameters);
+
+    bool uart_read_line_(char *line, size_t size, uint32_t start, uint32_t timeout);
+    int read_framed_(const char *cmd, const char *header, const char *trailer, uint8_t *dst, size_t max_len, uint32_t timeout);
+    bool query_lines_(const char *cmd, std::function<bool(const char *line)> on_line, uint32_t timeout);
     char **simcom_split_messages(const char *data, int *n_messages);
 
 public:
@@ -177,6 +705,8 @@ public:
     void RX_UNLOCK();
     bool PUBLISH_LOCK(uint32_t timeout = portMAX_DELAY);
     void PUBLISH_UNLOCK();
+    bool SEQ_LOCK(uint32_t timeout = portMAX_DELAY);
+    void SEQ_UNLOCK();
     void REINIT_UART(uint32_t resize = 1024, bool at_ready = true);
     void DEINIT_UART();
 
@@ -195,6 +725,31 @@ public:
         on_ps_reg_event_ = callback;
     }
 
+    /** Chamado quando uma publicação QoS 1/2 é confirmada (delivered=true) ou descartada após MQTT_INFLIGHT_MAX_RETRIES */
+    void on_publish_complete(void (*callback)(uint16_t msg_id, bool delivered))
+    {
+        on_publish_complete_ = callback;
+    }
+
+    /** Chamado a cada mudança de nível de conectividade (at_ms = millis() da transição) */
+    void on_connectivity_change(void (*callback)(connectivity_state from, connectivity_state to, uint32_t at_ms))
+    {
+        on_connectivity_change_ = callback;
+    }
+
+    connectivity_state connectivity() const { return conn_state_; }
+    /** Event group com um CONN_BIT() por nível; permite bloquear em xEventGroupWaitBits sem polling */
+    EventGroupHandle_t connectivity_events() const { return conn_events_; }
+    /** Bloqueia até o nível de conectividade chegar a state (ou passar dele) */
+    bool wait_for_state(connectivity_state state, uint32_t timeout = portMAX_DELAY);
+    /** Tempo acumulado (ms) no estado, incluindo a permanência atual */
+    uint32_t time_in_state(connectivity_state state);
+    /** millis() da última entrada no estado (0 se nunca entrou) */
+    uint32_t state_entered_at(connectivity_state state) const { return state < CONN_STATE_COUNT ? conn_entered_[state] : 0; }
+    uint32_t state_since() const { return conn_since_; }
+    uint32_t connectivity_transitions() const { return conn_transitions_; }
+    static const char *connectivity_name(connectivity_state state);
+
     bool ps_ready() const
     { // Dados prontos
         return (eps_reg_stat_ == REGISTERED_HOME || eps_reg_stat_ == REGISTERED_ROAMING) ||
@@ -212,7 +767,25 @@ public:
 
     void handle_cgreg_stat_(registration_status st);
 
-    bool is_pdn_active(int cid = 1) const { return (cid >= 0 && cid < 11) ? pdn_active[cid] : false; }
+    bool is_pdn_active(int cid = 1) const { return (cid >= 0 && cid <= PDN_MAX_CID) ? pdn_active[cid] : false; }
+
+    /**
+     * Configura o contexto cid (AT+CGDCONT/AT+CGAUTH) aplicando só o que difere do modem. Permite, por exemplo,
+     * um APN privado para o broker de controle e um público para HTTP em CIDs separados.
+     */
+    bool pdn_configure(uint8_t cid, const char *apn, const char *user = "", const char *password = "",
+                       const char *pdp_type = "IPV4V6", uint32_t timeout = 2000);
+    bool pdn_activate(uint8_t cid, uint32_t timeout = 10000);
+    bool pdn_deactivate(uint8_t cid, uint32_t timeout = 10000);
+    pdn_context pdn_state(uint8_t cid) const;
+    /**
+     * Liga o serviço MQTT/HTTP a um contexto (AT+CSOCKSETPN antes do CMQTTSTART/HTTPINIT). A queda de um PDN
+     * só derruba a sessão MQTT se for o CID ligado a ela. Vale a partir do próximo mqtt_connect()/sessão HTTP.
+     */
+    bool mqtt_bind_pdn(uint8_t cid);
+    bool http_bind_pdn(uint8_t cid);
+    uint8_t mqtt_pdn() const { return mqtt_cid_; }
+    uint8_t http_pdn() const { return http_cid_; }
 
     /** Set silent mode - se marcado como true, ao religar a uart não enviao os comandos de URC*/
     void set_silent_mode(bool mode) { silent_mode = mode; }
@@ -232,21 +805,66 @@ public:
     bool begin();
     bool stop();
     bool is_ready();
+    /** Marcos da última inicialização (RDY, AT, CFUN, SIM, init, SMS/PB DONE) em ms desde a liberação do EN */
+    const boot_timeline &boot_report() const { return boot_; }
     bool restart(uint32_t timeout = 1000);
     bool test_at(uint32_t timeout = 1000);
     bool sim_ready(uint32_t timeout = 1000);
+    /** CSQ (0..31, 99 = desconhecido). Com o amostrador ativo, ou durante uma publicação, devolve a última amostra sem ir ao modem */
     int signal_quality(uint32_t timeout = 1000);
 
+    /** Inicia a task de baixa prioridade que lê AT+CSQ;+CPSI? a cada interval_ms, só nas brechas em que a UART está ociosa */
+    bool radio_sampler_start(uint32_t interval_ms = RADIO_SAMPLE_INTERVAL_MS, UBaseType_t priority = tskIDLE_PRIORITY + 1);
+    void radio_sampler_stop(uint32_t timeout = 3000);
+    bool radio_sampler_running() const { return radio_task_ != NULL; }
+    /** Cópia da amostra mais recente; false se ainda não houve nenhuma. Não bloqueia */
+    bool radio_snapshot(radio_sample &out) const;
+    /** Copia até max amostras, da mais recente para a mais antiga; retorna quantas */
+    size_t radio_history(radio_sample *out, size_t max) const;
+
     bool ping(const char *host = "www.google.com", uint32_t timeout = 2000);
 
+    /** Só envia AT+CNMP (que força novo attach) se o modo salvo no modem for diferente */
     bool set_network_mode(network_mode mode, uint32_t timeout = 1000);
+    /** Lista em cache se ainda válida; senão faz a busca e espera até timeout */
     std::vector<NetworkOperator> get_operator_list(uint32_t timeout = 60000);
 
+    /**
+     * Busca de operadoras (AT+COPS=?) numa task de baixa prioridade. Os métodos da API que falam com o
+     * modem cancelam a busca antes de enviar o primeiro comando; o sendCommand em si não cancela, e as
+     * tarefas internas (amostrador de rádio, sonda da sessão MQTT) só pulam a vez enquanto ela dura.
+     */
+    bool operator_scan_start(uint32_t timeout = OPERATOR_SCAN_TIMEOUT, UBaseType_t priority = tskIDLE_PRIORITY + 1);
+    void operator_scan_cancel(uint32_t timeout = 1000);
+    bool operator_scan_running() const { return cops_task_ != NULL; }
+    /** Cópia da última lista; false se não há lista ou ela passou de ttl_ms */
+    bool operator_list_cached(operator_list &out, uint32_t ttl_ms = OPERATOR_LIST_TTL_MS);
+
+    /** Lê a configuração de rede atual do modem numa única linha de comando */
+    bool net_config_read(net_config &out, uint32_t timeout = 2000, uint8_t cid = DEFAULT_CID);
     bool set_operator(bool automatic, NetworkOperator op, uint32_t timeout = 1000);
+    /**
+     * Registra e ativa a PDN tentando primeiro a operadora/RAT/APN da última sessão MQTT bem-sucedida
+     * (AT+COPS=4, com fallback automático do próprio modem) por até deadline ms. Se falhar, busca as
+     * operadoras e tenta cada uma em ordem (atual, LTE, UTRAN, GSM), terminando no modo automático.
+     * apn = nullptr usa o APN salvo. Usuário e senha nunca são salvos: vêm desta chamada ou, se vazios e o
+     * APN for o mesmo, do último set_apn/pdn_configure desta instância.
+     */
+    bool fast_attach(const char *apn = nullptr, const char *user = "", const char *password = "",
+                     uint32_t deadline = FAST_ATTACH_DEADLINE_MS, uint32_t scan_timeout = OPERATOR_SCAN_TIMEOUT);
+    bool attach_profile_load(attach_profile &out);
+    void attach_profile_forget();
+    /** Lê o estado atual numa consulta e aplica só o que difere (URCs de registro, CGDCONT, CGAUTH, CGATT, CGACT) */
     bool set_apn(const char *apn, const char *user, const char *password, uint32_t timeout = 1000);
     bool set_ntp_server(const char *ntp_server, int time_zone, uint32_t timeout = 1000);
 
     time_t get_ntp_time(uint32_t timeout = 1000);
+    /**
+     * IMEI, ICCID, operadora e endereços numa única linha de comando. IMEI/ICCID vêm do cache quando
+     * disponíveis; durante uma publicação (ou com refresh=false) devolve o último snapshot sem ir ao modem.
+     * Retorna false se a consulta não terminou em OK (ex.: sem SIM, os campos seguintes ficam vazios).
+     */
+    bool identity_snapshot(modem_identity &out, bool refresh = true, uint32_t timeout = 2000);
     String get_provider_name(uint32_t timeout = 1000);
     String get_imei(uint32_t timeout = 1000);
     String get_iccid(uint32_t timeout = 1000);
@@ -258,6 +876,43 @@ public:
     bool mqtt_disconnect(uint32_t timeout = 1000);
     bool mqtt_release_client(uint32_t timeout = 1000);
     bool mqtt_publish(const char *topic, uint8_t *data, size_t len, uint16_t qos = 0, uint32_t timeout = 3000);
+    /**
+     * Publica o payload formado pelos segmentos, escritos direto na UART após o '>' (sem montar um buffer contíguo).
+     * Com QoS 1/2 os segmentos são copiados para a tabela em voo, como no mqtt_publish com buffer.
+     */
+    bool mqtt_publish(const char *topic, const data_segment *segments, size_t n_segments, uint16_t qos = 0, uint32_t timeout = 3000);
+    /*
+    Publica sem esperar a confirmação do broker. Para QoS 1/2 a mensagem é copiada para a tabela em voo,
+    enviada assim que houver espaço na janela e reenviada após uma reconexão enquanto não for confirmada.
+    Retorna o id da mensagem (usado em on_publish_complete) ou 0 em caso de falha.
+    */
+    uint16_t mqtt_publish_async(const char *topic, const uint8_t *data, size_t len, uint16_t qos = 1, uint32_t timeout = 3000);
+    /*
+    Publica um payload de até MQTT_MAX_PAYLOAD_SIZE bytes lido do callback reader em blocos de UART_TX_CHUNK_SIZE,
+    com uso de pilha constante. Com QoS 1/2 o payload é lido inteiro para a tabela em voo (reenvio após NACK ou
+    reconexão) e a chamada espera a confirmação do broker.
+    */
+    bool mqtt_publish_stream(const char *topic, size_t len, payload_reader reader, uint16_t qos = 0, uint32_t timeout = 3000);
+    bool mqtt_replay_inflight(uint32_t timeout = 3000);
+
+    /*
+    Keepalive adaptativo: mqtt_connect passa a usar o maior keepalive comprovado para a rede atual (chave operadora + AcT),
+    testando valores maiores a cada sessão até encontrar o limite do NAT. O parâmetro keepalive de mqtt_connect vira o valor inicial.
+    */
+    void mqtt_set_adaptive_keepalive(bool enable, uint16_t min_s = MQTT_KEEPALIVE_MIN, uint16_t max_s = MQTT_KEEPALIVE_MAX);
+    /** Se um ack atrasar stall_ms, sonda o broker; sem resposta em deadline_ms a sessão é dada como meio-aberta. stall_ms = 0 desliga. */
+    void mqtt_set_stall_probe(uint32_t stall_ms = MQTT_STALL_PROBE_MS, uint32_t deadline_ms = MQTT_PROBE_DEADLINE_MS);
+    uint16_t mqtt_keepalive() const { return session_keepalive_; }
+
+    /*
+    Registra um tópico usado com frequência: o prefixo do AT+CMQTTPUB é renderizado uma única vez e a publicação
+    por handle só acrescenta o tamanho do payload (sem strlen/sprintf no caminho quente). Retorna -1 se não houver espaço.
+    */
+    mqtt_topic_handle mqtt_register_topic(const char *topic, uint16_t qos = 0);
+    void mqtt_unregister_topic(mqtt_topic_handle handle);
+    bool mqtt_publish(mqtt_topic_handle handle, const uint8_t *data, size_t len, uint32_t timeout = 3000);
+    void mqtt_set_inflight_window(uint8_t window);
+    uint8_t mqtt_inflight_count();
     bool mqtt_subscribe_topics(const char *topic[10], int n_topics = 10, uint16_t qos = 0, uint32_t timeout = 1000);
     bool mqtt_subscribe(const char *topic, uint16_t qos, uint32_t timeout = 1000);
     bool mqtt_is_connected();
@@ -283,14 +938,77 @@ public:
                           const char *user_data = "", size_t user_data_size = 0, uint32_t con_timeout = 120, uint32_t recv_timeout = 120,
                           const char *content = "text/plain", const char *accept = "*/*", uint8_t read_mode = 0, const char *data_post = "", size_t size = 0, uint32_t timeout = 30000);
 
+    /** Executa uma requisição pré-montada com http_request_desc::build (body só é usado em POST) */
+    uint32_t http_request(const http_request_desc &request, const data_segment *body = nullptr, size_t n_segments = 0,
+                          bool save_to_fs = false, uint32_t timeout = 30000);
+
     uint32_t http_request_file(const char *url, HTTP_METHOD method, const char *filename, bool ssl = false, const char *ca_name = "ca.pem",
                                const char *user_data = "", size_t user_data_size = 0, uint32_t con_timeout = 120, uint32_t recv_timeout = 120,
                                const char *content = "text/plain", const char *accept = "*/*", uint8_t read_mode = 0, const char *data_post = "", size_t size = 0, uint32_t timeout = 30000);
+    /** POST com corpo formado pelos segmentos, escritos direto na UART após o DOWNLOAD do AT+HTTPDATA */
+    uint32_t http_post(const char *url, const data_segment *body, size_t n_segments, bool ssl = false, const char *ca_name = "ca.pem",
+                       const char *user_data = "", size_t user_data_size = 0, const char *content = "text/plain", uint32_t timeout = 30000);
+    /*
+    POST de total bytes lidos do callback producer em blocos de UART_TX_CHUNK_SIZE (uso de RAM constante). Até
+    HTTP_DATA_MAX_SIZE o corpo vai direto pelo HTTPDATA; acima disso é gravado em HTTP_UPLOAD_FILE no modem (CFTRANRX)
+    e enviado com HTTPPOSTFILE, sendo apagado ao final com ou sem sucesso. Retorna o status HTTP (0 em falha); stats
+    (opcional) recebe bytes, tempo e vazão.
+    */
+    uint32_t http_post_stream(const char *url, size_t total, payload_reader producer, bool ssl = false, const char *ca_name = "ca.pem",
+                              const char *user_data = "", size_t user_data_size = 0, uint32_t con_timeout = 120, uint32_t recv_timeout = 120,
+                              const char *content = "application/octet-stream", transfer_stats *stats = nullptr, uint32_t timeout = 30000);
+    /*
+    Sessão HTTP persistente: o HTTPINIT fica ativo entre chamadas de http_request/http_request_file/http_post e cada
+    requisição só reenvia os HTTPPARA que mudaram em relação à anterior. Encerrar com http_session_end (ou http_term).
+    */
+    bool http_session_begin(uint32_t timeout = 1000);
+    bool http_session_end(uint32_t timeout = 1000);
+    bool http_session_active() const { return http_session_; }
     void http_read_file(const char *filename, uint32_t timeout = 1000);
     bool http_term(uint32_t timeout = 1000);
     void http_save_response(bool https = false);
-    size_t http_read_response(uint8_t *buffer, size_t read_size, size_t offset = 0, uint32_t timeout = 1000);
+    /*
+    http_read_response/fs_read leem exatamente o bloco anunciado em +HTTPREAD: <n> / CONNECT <n> direto para buffer,
+    em quantas leituras da UART forem necessárias (read_size não é mais limitado por rx_buffer_size). Tomam a UART
+    sozinhas; um RX_LOCK feito pelo chamador continua aceito. Retornam n, 0 no fim dos dados ou < 0 em erro (-3 quando
+    o modem anunciou mais que read_size: só read_size bytes ficam em buffer e o restante do bloco é descartado).
+    */
+    int http_read_response(uint8_t *buffer, size_t read_size, size_t offset = 0, uint32_t timeout = 1000);
+    /*
+    Baixa o corpo da última resposta HTTP (a partir de offset) em blocos de chunk_size via HTTPREAD e entrega cada bloco a sink.
+    Usa dois buffers: enquanto sink processa um bloco (gravação em flash, hash...) numa tarefa auxiliar, o próximo já está sendo
+    lido do modem. Blocos com falha são relidos até TRANSFER_MAX_RETRIES vezes. stats (opcional) recebe bytes, tempo e vazão.
+    */
+    bool http_download(data_sink sink, size_t chunk_size = TRANSFER_CHUNK_SIZE, transfer_stats *stats = nullptr, size_t offset = 0, uint32_t timeout = 5000);
+    /*
+    Download retomável (ex.: OTA): baixa url em requisições Range de range_size bytes e entrega cada bloco a sink com o
+    offset absoluto no arquivo. O progresso (offset confirmado, ETag, tamanho e SHA-256 parcial) fica na NVS sob key
+    (máx. 15 caracteres), então uma queda de conexão ou um reboot retoma de onde parou; se o ETag mudar, recomeça do zero.
+    sink deve ter persistido o bloco ao retornar true. No fim confere o tamanho e, se sha256 for informado, o hash.
+    user_data são cabeçalhos extras (separados por HTTP_HEADER_SEP), enviados junto com o Range.
+    */
+    bool http_download_resumable(const char *url, const char *key, data_sink sink, const uint8_t *sha256 = nullptr, bool ssl = false,
+                                 const char *ca_name = "ca.pem", const char *user_data = "", size_t range_size = DOWNLOAD_RANGE_SIZE,
+                                 transfer_stats *stats = nullptr, uint32_t timeout = 30000);
+    bool http_download_checkpoint(const char *key, download_checkpoint *checkpoint);
+    /*
+    GET condicional: envia If-None-Match/If-Modified-Since com os validadores salvos para url (NVS) junto com user_data.
+    Retorna 304 quando o conteúdo não mudou (nenhum HTTPREAD é necessário) ou 200 com o novo corpo pronto para
+    http_read_response/http_download, atualizando os validadores. 0 em caso de falha.
+    */
+    uint32_t http_get_cached(const char *url, bool ssl = false, const char *ca_name = "ca.pem", const char *user_data = "", uint32_t timeout = 30000);
+    void http_cache_forget(const char *url);
+    http_cache_counters http_cache_stats() const { return http_cache_counters_; }
+    uint8_t http_cache_hit_rate() const { return http_cache_counters_.requests ? http_cache_counters_.hits * 100 / http_cache_counters_.requests : 0; }
+    void http_download_reset(const char *key);
     uint32_t http_response_size();
+    /*
+    Cabeçalhos da última resposta (lidos inteiros do HTTPHEAD e indexados uma vez). A busca por nome ignora maiúsculas,
+    não acessa o modem nem aloca memória; os ponteiros valem até a próxima requisição HTTP. nullptr se não existir.
+    */
+    const char *http_header(const char *name) const;
+    uint8_t http_header_count() const { return http_header_count_; }
+    bool http_header_at(uint8_t index, const char **name, const char **value) const;
     uint32_t http_response_header_size();
     char *http_response_etag();
 
@@ -308,7 +1026,95 @@ public:
     uint32_t fs_size(const char *filename, uint32_t timeout = 1000);
     bool fs_delete(const char *filename, uint32_t timeout = 1000);
     void fs_list_files(uint32_t timeout = 1000);
-    size_t fs_read(size_t read_size, uint8_t *buffer, uint32_t timeout = 1000);
+    /*
+    Listagem em cache: montada no primeiro uso (ou com refresh=true) e invalidada por fs_open, fs_delete, FSWRITE e pelos
+    caminhos HTTP que gravam arquivos. fs_exists e fs_size respondem da memória enquanto a listagem for válida.
+    */
+    const fs_listing &fs_list(bool refresh = false, uint32_t timeout = 5000);
+    bool fs_exists(const char *filename, uint32_t timeout = 5000);
+    uint32_t fs_free_space(uint32_t timeout = 5000);
+    int fs_read(size_t read_size, uint8_t *buffer, uint32_t timeout = 1000);
+
+    /*
+    Acesso por handle (vários arquivos abertos ao mesmo tempo). fs_open_handle retorna o fd informado pelo modem ou -1;
+    fs_read_handle segue o contrato de fs_read (n, 0 no fim, < 0 em erro). Veja ModemFile para leitura/escrita com buffer.
+    */
+    int fs_open_handle(const char *filename, uint16_t mode = 2, uint32_t timeout = 1000);
+    bool fs_close_handle(int fd, uint32_t timeout = 1000);
+    int fs_read_handle(int fd, uint8_t *buffer, size_t size, uint32_t timeout = 1000);
+    bool fs_write_handle(int fd, const uint8_t *data, size_t len, uint32_t timeout = 5000);
+    bool fs_seek_handle(int fd, size_t offset, uint32_t timeout = 1000);
+
+    /*
+    Atualiza o firmware a partir de um arquivo no sistema de arquivos do modem (ex.: salvo com http_request(save_to_fs=true)).
+    Lê o próximo bloco com FSREAD enquanto o anterior é gravado na partição OTA por outra tarefa, calcula o SHA-256 do que
+    foi gravado e, se sha256 for informado, só troca a partição de boot se o hash conferir. Em qualquer falha a OTA é abortada
+    e o arquivo fechado. Retorna true com a nova partição marcada para o próximo boot (o reinício fica com o chamador).
+    */
+    bool ota_from_fs(const char *filename, const uint8_t *sha256 = nullptr, size_t chunk_size = TRANSFER_CHUNK_SIZE,
+                     transfer_stats *stats = nullptr, uint32_t timeout = 5000);
+};
+
+/*
+Arquivo do modem com buffer, sobre FSOPEN/FSREAD/FSWRITE/FSSEEK:
+- leitura com read-ahead: enquanto o chamador consome um bloco, uma tarefa auxiliar já lê o próximo do modem;
+- escrita agrupada: escritas pequenas são juntadas em blocos de block_size antes de cada FSWRITE.
+Cada instância tem seu próprio fd, então vários arquivos podem ficar abertos. Não usar com RX_LOCK tomado pelo chamador.
+*/
+class ModemFile
+{
+private:
+    A7672SA &modem_;
+    size_t block_size_;
+    int fd_ = -1;
+    uint32_t timeout_ = 1000;
+
+    uint8_t *buffers_[2] = {nullptr, nullptr};
+    uint8_t current_ = 0;     // buffer de leitura em uso (o outro recebe o read-ahead)
+    int buffered_ = 0;        // bytes válidos no buffer atual (leitura) ou acumulados (escrita)
+    size_t consumed_ = 0;     // bytes do buffer atual já entregues ao chamador
+    size_t position_ = 0;     // posição lógica do chamador no arquivo
+    bool writing_ = false;    // buffers_[current_] guarda escrita pendente
+    bool eof_ = false;
+    hash_stream *hash_ = nullptr;
+    const uint8_t *expected_digest_ = nullptr;
+    size_t expected_len_ = 0;
+
+    TaskHandle_t prefetch_task_ = NULL;
+    SemaphoreHandle_t prefetch_request_ = NULL;
+    SemaphoreHandle_t prefetch_done_ = NULL;
+    volatile bool prefetch_pending_ = false;
+    volatile bool prefetch_stop_ = false;
+    volatile int prefetch_result_ = 0;
+
+    static void prefetch_taskImpl(void *pvParameters);
+    void prefetch_start_();
+    int prefetch_wait_();
+    int fill_();
+    bool discard_read_();
+
+public:
+    ModemFile(A7672SA &modem, size_t block_size = FS_BLOCK_SIZE);
+    ~ModemFile();
+    ModemFile(const ModemFile &) = delete;
+    ModemFile &operator=(const ModemFile &) = delete;
+
+    bool open(const char *filename, uint16_t mode = 2, bool read_ahead = true, uint32_t timeout = 1000);
+    int read(uint8_t *buffer, size_t len);
+    size_t write(const uint8_t *data, size_t len);
+    bool flush();
+    bool seek(size_t offset);
+    /** close() retorna false se o digest esperado não conferir */
+    bool close();
+
+    /*
+    Acopla um hash aos bytes entregues por read() e aceitos por write(). Se expected for informado, close() finaliza o
+    hash e compara. Um seek descarta a garantia de hash sequencial, então deve ser feito antes de acoplar.
+    */
+    void attach_hash(hash_stream *hash, const uint8_t *expected = nullptr, size_t expected_len = 0);
+
+    size_t position() const { return position_; }
+    bool is_open() const { return fd_ >= 0; }
 };
 
 #endif // MQTT_A7672SA_H_
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+Tempo até o modem ficar pronto contra um modem simulado com latência de boot configurável. Cada latência roda num
+processo próprio (a tabela de respostas do parser fica presa à primeira instância de A7672SA).
+    bench_boot [boot_ms ...]          padrão: 300 1000 2500 4000 8000
+    bench_boot --one <boot_ms>        uma inicialização, uma linha de resultado
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "check.h"
+#include "host_modem.h"
+
+static int boot_once(uint32_t boot_ms)
+{
+    sim_config config;
+    config.boot_ms = boot_ms;
+    host_modem host(config);
+    uint64_t start = host_micros();
+    CHECK(host.start(BOOT_READY_TIMEOUT_MS + boot_ms + 5000));
+    uint32_t wall_ms = (uint32_t)((host_micros() - start) / 1000);
+
+    // Marcos em ms desde a liberação do EN (o begin() mantém o EN alto por BOOT_POWER_OFF_MS antes)
+    const boot_timeline &boot = host.modem.boot_report();
+    printf("%7u | %5u | %5u | %5u | %5u | %5u | %6u | %5u | %7u | %5u | %5u | %6u\n", boot_ms, boot.rdy, boot.at_ok, boot.at_probes, boot.cfun,
+           boot.sim_ready, boot.init_done, boot.init_done - boot.rdy, boot.power_off_ms, boot.sms_done, boot.pb_done, wall_ms);
+    host_exit(0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--one") == 0)
+        return boot_once(atoi(argv[2]));
+
+    std::string latencies;
+    for (int i = 1; i < argc; i++)
+        latencies += std::string(" ") + argv[i];
+    if (latencies.empty())
+        latencies = " 300 1000 2500 4000 8000";
+
+    printf("modem boot latency (EN released -> RDY) vs. library milestones, ms since EN release\n");
+    printf("boot_ms |   RDY |    AT | probe |  CFUN |   SIM |  ready | RDY->r | EN high |   SMS |    PB | begin->ready\n");
+    fflush(stdout);
+    char *list = strdup(latencies.c_str());
+    for (char *tok = strtok(list, " "); tok != NULL; tok = strtok(NULL, " "))
+    {
+        std::string cmd = std::string(argv[0]) + " --one " + tok;
+        if (system(cmd.c_str()) != 0)
+        {
+            fprintf(stderr, "boot with %s ms failed\n", tok);
+            free(list);
+            return 1;
+        }
+    }
+    free(list);
+    return 0;
+}
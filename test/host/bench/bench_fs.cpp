@@ -0,0 +1,110 @@
+/*
+Vazão sequencial do sistema de arquivos do modem simulado (UART a 115200 ritmada): escrita em pedaços pequenos direto
+com fs_write_handle contra ModemFile (junta em blocos de FS_BLOCK_SIZE), e leitura com fs_read_handle contra ModemFile
+sem e com read-ahead, com o chamador gastando process_ms por bloco (gravação em flash, parse...).
+    bench_fs [KiB] [pedaço de escrita em bytes] [process_ms por bloco de leitura]
+*/
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "host_modem.h"
+
+static uint32_t line_rate()
+{
+    return host_uart_baud() / 10; // 8N1: 10 bits por byte
+}
+
+static void report(const char *name, size_t bytes, uint64_t elapsed_us)
+{
+    double bytes_per_s = bytes * 1e6 / elapsed_us;
+    printf("%-34s %7.2f KiB/s | %5.1f%% of UART line rate | %6.0f ms\n", name, bytes_per_s / 1024, 100.0 * bytes_per_s / line_rate(),
+           elapsed_us / 1000.0);
+}
+
+static void process(uint32_t process_ms)
+{
+    if (process_ms > 0)
+        vTaskDelay(pdMS_TO_TICKS(process_ms));
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (argc > 1 ? atoi(argv[1]) : 16) * 1024;
+    size_t piece = argc > 2 ? atoi(argv[2]) : 256;
+    uint32_t process_ms = argc > 3 ? atoi(argv[3]) : 150;
+
+    host_modem host;
+    CHECK(host.start());
+    A7672SA &modem = host.modem;
+
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; i++)
+        content[i] = (char)(i * 31 + (i >> 8));
+    const uint8_t *data = (const uint8_t *)content.data();
+
+    printf("%u KiB, writes of %u bytes, reads processing %u ms per %d-byte block, UART %u baud\n", (unsigned)(size / 1024), (unsigned)piece,
+           process_ms, FS_BLOCK_SIZE, host_uart_baud());
+
+    // Escrita
+    uint64_t start = host_micros();
+    int fd = modem.fs_open_handle("direct.bin", 1);
+    CHECK(fd > 0);
+    for (size_t off = 0; off < size; off += piece)
+        CHECK(modem.fs_write_handle(fd, data + off, size - off < piece ? size - off : piece));
+    CHECK(modem.fs_close_handle(fd));
+    report("write fs_write_handle", size, host_micros() - start);
+    CHECK(host.sim.file("direct.bin") == content);
+
+    start = host_micros();
+    {
+        ModemFile file(modem);
+        CHECK(file.open("stream.bin", 1, false));
+        for (size_t off = 0; off < size; off += piece)
+        {
+            size_t len = size - off < piece ? size - off : piece;
+            CHECK(file.write(data + off, len) == len);
+        }
+        CHECK(file.close());
+    }
+    report("write ModemFile", size, host_micros() - start);
+    CHECK(host.sim.file("stream.bin") == content);
+
+    // Leitura, com o chamador processando cada bloco
+    std::vector<uint8_t> buffer(FS_BLOCK_SIZE);
+    start = host_micros();
+    fd = modem.fs_open_handle("stream.bin", 2);
+    CHECK(fd > 0);
+    std::string got;
+    int n;
+    while ((n = modem.fs_read_handle(fd, buffer.data(), buffer.size())) > 0)
+    {
+        got.append((const char *)buffer.data(), n);
+        process(process_ms);
+    }
+    CHECK_EQ(n, 0);
+    CHECK(modem.fs_close_handle(fd));
+    report("read fs_read_handle", size, host_micros() - start);
+    CHECK(got == content);
+
+    for (int read_ahead = 0; read_ahead < 2; read_ahead++)
+    {
+        got.clear();
+        start = host_micros();
+        {
+            ModemFile file(modem);
+            CHECK(file.open("stream.bin", 2, read_ahead != 0));
+            while ((n = file.read(buffer.data(), buffer.size())) > 0)
+            {
+                got.append((const char *)buffer.data(), n);
+                process(process_ms);
+            }
+            CHECK_EQ(n, 0);
+            CHECK(file.close());
+        }
+        report(read_ahead ? "read ModemFile (read-ahead)" : "read ModemFile (no read-ahead)", size, host_micros() - start);
+        CHECK(got == content);
+    }
+    host_exit(0);
+}
@@ -0,0 +1,174 @@
+/*
+Requisições por minuto contra um servidor HTTP local (127.0.0.1), alternando entre três endpoints do mesmo host:
+sem sessão (HTTPINIT + todos os HTTPPARA + HTTPTERM a cada requisição), com sessão (http_session_begin) e com sessão e
+descritores pré-montados (http_request_desc). O modem simulado repassa cada HTTPACTION ao servidor por um socket.
+    bench_http [requisições por modo]
+*/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "host_modem.h"
+
+static const char *const endpoints[] = {"/api/v1/status", "/api/v1/config", "/api/v1/commands"};
+static const int n_endpoints = sizeof(endpoints) / sizeof(endpoints[0]);
+
+// Servidor HTTP/1.0 mínimo: uma conexão por requisição, corpo JSON com o caminho pedido
+class local_http_server
+{
+public:
+    local_http_server()
+    {
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK(fd_ >= 0);
+        int one = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        CHECK(bind(fd_, (sockaddr *)&addr, sizeof(addr)) == 0);
+        CHECK(listen(fd_, 16) == 0);
+        socklen_t len = sizeof(addr);
+        CHECK(getsockname(fd_, (sockaddr *)&addr, &len) == 0);
+        port_ = ntohs(addr.sin_port);
+        std::thread([this]()
+                    { serve_(); })
+            .detach();
+    }
+
+    uint16_t port() const { return port_; }
+    uint32_t served() const { return served_; }
+
+    // Cliente usado pelo modem simulado: GET url (http://127.0.0.1:<porta>/caminho)
+    sim_http_result get(const std::string &url)
+    {
+        size_t path_at = url.find('/', url.find("//") + 2);
+        std::string path = path_at == std::string::npos ? "/" : url.substr(path_at);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port_);
+        if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            return sim_http_result{0, "", ""};
+        }
+        std::string request = "GET " + path + " HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n";
+        CHECK(write(fd, request.data(), request.size()) == (ssize_t)request.size());
+        std::string response;
+        char buf[1024];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+            response.append(buf, n);
+        close(fd);
+
+        sim_http_result result = {0, "", ""};
+        size_t head_end = response.find("\r\n\r\n");
+        if (head_end == std::string::npos || sscanf(response.c_str(), "HTTP/1.%*d %d", &result.status) != 1)
+            return result;
+        size_t first_line = response.find("\r\n");
+        result.headers = response.substr(first_line + 2, head_end - first_line);
+        result.body = response.substr(head_end + 4);
+        return result;
+    }
+
+private:
+    int fd_;
+    uint16_t port_;
+    std::atomic<uint32_t> served_{0};
+
+    void serve_()
+    {
+        for (;;)
+        {
+            int client = accept(fd_, nullptr, nullptr);
+            if (client < 0)
+                continue;
+            std::string request;
+            char buf[512];
+            ssize_t n;
+            while (request.find("\r\n\r\n") == std::string::npos && (n = read(client, buf, sizeof(buf))) > 0)
+                request.append(buf, n);
+            char path[128] = "/";
+            sscanf(request.c_str(), "GET %127s", path);
+            std::string body = "{\"path\":\"" + std::string(path) + "\",\"seq\":" + std::to_string(served_++) + ",\"ok\":true}";
+            std::string response = "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+                                   "\r\nConnection: close\r\n\r\n" + body;
+            ssize_t written = write(client, response.data(), response.size());
+            (void)written;
+            close(client);
+        }
+    }
+};
+
+static bool read_body(A7672SA &modem, const char *endpoint)
+{
+    uint8_t body[256];
+    int n = modem.http_read_response(body, sizeof(body) - 1);
+    if (n <= 0)
+        return false;
+    body[n] = '\0';
+    return strstr((const char *)body, endpoint) != nullptr;
+}
+
+template <typename Request>
+static void run_mode(const char *name, A7672SA &modem, host_modem &host, int count, Request request)
+{
+    size_t commands_before = host.sim.commands().size();
+    uint64_t start = host_micros();
+    for (int i = 0; i < count; i++)
+    {
+        int e = i % n_endpoints;
+        CHECK(request(e) == 200);
+        CHECK(read_body(modem, endpoints[e]));
+        if (!modem.http_session_active())
+            CHECK(modem.http_term());
+    }
+    double elapsed_ms = (host_micros() - start) / 1000.0;
+    size_t commands = host.sim.commands().size() - commands_before;
+    printf("%-26s %7.1f req/min | %6.1f ms/req | %4.1f AT commands/req\n", name, count * 60000.0 / elapsed_ms, elapsed_ms / count,
+           (double)commands / count);
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 30;
+    local_http_server server;
+    sim_config config;
+    config.reply_ms = 5;
+    host_modem host(config);
+    host.sim.set_http_backend([&server](int, const std::string &url, const std::string &)
+                              { return server.get(url); });
+    CHECK(host.start());
+    A7672SA &modem = host.modem;
+
+    std::string urls[n_endpoints];
+    http_request_desc descs[n_endpoints];
+    for (int e = 0; e < n_endpoints; e++)
+    {
+        urls[e] = "http://127.0.0.1:" + std::to_string(server.port()) + endpoints[e];
+        CHECK(descs[e].build(urls[e].c_str(), GET, false, "ca.pem", "", 120, 120, "application/json", "application/json"));
+    }
+
+    printf("%d GETs per mode over %d endpoints, local server on port %u\n", count, n_endpoints, server.port());
+    run_mode("no session (HTTPTERM each)", modem, host, count, [&](int e)
+             { return modem.http_request(urls[e].c_str(), GET, false, false, "ca.pem", "", 0, 120, 120, "application/json", "application/json"); });
+
+    CHECK(modem.http_session_begin());
+    run_mode("session", modem, host, count, [&](int e)
+             { return modem.http_request(urls[e].c_str(), GET, false, false, "ca.pem", "", 0, 120, 120, "application/json", "application/json"); });
+    run_mode("session + request_desc", modem, host, count, [&](int e)
+             { return modem.http_request(descs[e]); });
+    CHECK(modem.http_session_end());
+
+    CHECK_EQ(server.served(), 3 * count);
+    host_exit(0);
+}
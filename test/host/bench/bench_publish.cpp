@@ -0,0 +1,112 @@
+/*
+Custo de CPU por publicação: tópico em string (strlen + snprintf do AT+CMQTTPUB a cada chamada) contra handle registrado
+(prefixo pronto, só o tamanho do payload é acrescentado). Mede a thread que publica e a soma com as tarefas do modem, e depois só a montagem do comando em laço.
+    bench_publish [publicações por modo]
+*/
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "check.h"
+#include "host_modem.h"
+
+struct publish_cost
+{
+    std::vector<uint64_t> caller_ns;
+    uint64_t total_ns;
+    uint64_t wall_us;
+};
+
+// Só a montagem do AT+CMQTTPUB, como cada caminho faz a cada publicação
+struct host_bench_access
+{
+    static size_t render_topic(A7672SA &modem, char *cmd, const char *topic, size_t len)
+    {
+        size_t prefix_len = modem.mqtt_render_prefix_(cmd, MQTT_PUB_CMD_SIZE, topic, 0);
+        return modem.mqtt_render_cmd_(cmd, cmd, prefix_len, len);
+    }
+    static size_t render_handle(A7672SA &modem, char *cmd, mqtt_topic_handle handle, size_t len)
+    {
+        const mqtt_topic_entry &entry = modem.topic_handles_[handle];
+        return modem.mqtt_render_cmd_(cmd, entry.prefix, entry.prefix_len, len);
+    }
+};
+
+template <typename Render>
+static double render_ns(int count, Render render)
+{
+    volatile size_t sink = 0;
+    uint64_t start = host_thread_cpu_ns();
+    for (int i = 0; i < count; i++)
+        sink = sink + render(i);
+    return (double)(host_thread_cpu_ns() - start) / count;
+}
+
+template <typename Publish>
+static publish_cost measure(int count, Publish publish)
+{
+    publish_cost cost;
+    cost.caller_ns.reserve(count);
+    uint64_t wall_start = host_micros();
+    uint64_t total_start = host_thread_cpu_ns() + host_tasks_cpu_ns();
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t start = host_thread_cpu_ns();
+        CHECK(publish(i));
+        cost.caller_ns.push_back(host_thread_cpu_ns() - start);
+    }
+    cost.total_ns = host_thread_cpu_ns() + host_tasks_cpu_ns() - total_start;
+    cost.wall_us = host_micros() - wall_start;
+    return cost;
+}
+
+static void report(const char *name, publish_cost &cost)
+{
+    std::sort(cost.caller_ns.begin(), cost.caller_ns.end());
+    size_t n = cost.caller_ns.size();
+    uint64_t sum = 0;
+    for (uint64_t ns : cost.caller_ns)
+        sum += ns;
+    printf("%-22s caller: mean %6.1f us  p50 %6.1f us  p90 %6.1f us | caller+tasks %7.1f us/publish | %6.1f ms/publish\n", name,
+           sum / 1000.0 / n, cost.caller_ns[n / 2] / 1000.0, cost.caller_ns[n * 9 / 10] / 1000.0, cost.total_ns / 1000.0 / n,
+           cost.wall_us / 1000.0 / n);
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 100;
+    sim_config config;
+    config.ack_ms[0] = 1;
+    host_modem host(config);
+    CHECK(host.start());
+    CHECK(host.modem.mqtt_connect("broker.local", 1883, "bench"));
+
+    const char topic[] = "devices/a7672sa-0001/telemetry/sensors";
+    uint8_t payload[64];
+    memset(payload, 'x', sizeof(payload));
+    mqtt_topic_handle handle = host.modem.mqtt_register_topic(topic, 0);
+    CHECK(handle >= 0);
+
+    printf("%d QoS 0 publishes of %u bytes per mode, topic \"%s\"\n", count, (unsigned)sizeof(payload), topic);
+    for (int round = 0; round < 2; round++) // a primeira rodada também aquece caches e alocador
+    {
+        publish_cost by_topic = measure(count, [&](int)
+                                        { return host.modem.mqtt_publish(topic, payload, sizeof(payload), 0); });
+        publish_cost by_handle = measure(count, [&](int)
+                                         { return host.modem.mqtt_publish(handle, payload, sizeof(payload)); });
+        if (round == 0)
+            continue;
+        report("mqtt_publish(topic)", by_topic);
+        report("mqtt_publish(handle)", by_handle);
+    }
+
+    // De ponta a ponta a espera pelo prompt e pelo ack domina; a diferença entre os caminhos está na montagem do comando
+    const int renders = 1000000;
+    char cmd[MQTT_PUB_CMD_SIZE];
+    double topic_ns = render_ns(renders, [&](int i)
+                                { return host_bench_access::render_topic(host.modem, cmd, topic, 1 + (i & 1023)); });
+    double handle_ns = render_ns(renders, [&](int i)
+                                 { return host_bench_access::render_handle(host.modem, cmd, handle, 1 + (i & 1023)); });
+    printf("command render         topic %6.1f ns | handle %6.1f ns | %.1fx\n", topic_ns, handle_ns, topic_ns / handle_ns);
+    host_exit(0);
+}
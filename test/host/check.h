@@ -0,0 +1,88 @@
+/*
+Casos de teste do host: cada arquivo registra casos com HOST_CASE e o main roda o caso pedido na linha de comando
+(um processo por caso no ctest: a tabela de respostas do parser fica presa à primeira instância de A7672SA).
+Uma falha encerra o processo na hora, sem esperar pelas tarefas do modem.
+*/
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "host_shim.h"
+
+struct host_case
+{
+    const char *name;
+    void (*run)();
+};
+
+inline std::vector<host_case> &host_cases()
+{
+    static std::vector<host_case> cases;
+    return cases;
+}
+
+struct host_case_registrar
+{
+    host_case_registrar(const char *name, void (*run)()) { host_cases().push_back({name, run}); }
+};
+
+#define HOST_CASE(name)                                              \
+    static void name();                                              \
+    static host_case_registrar name##_registrar_(#name, name);        \
+    static void name()
+
+#define CHECK(cond)                                                                  \
+    do                                                                               \
+    {                                                                                \
+        if (!(cond))                                                                 \
+        {                                                                            \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            host_exit(1);                                                            \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                            \
+    do                                                                                                            \
+    {                                                                                                             \
+        long long a_ = (long long)(a), b_ = (long long)(b);                                                       \
+        if (a_ != b_)                                                                                             \
+        {                                                                                                         \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+            host_exit(1);                                                                                         \
+        }                                                                                                         \
+    } while (0)
+
+#define CHECK_STR(a, b)                                                                                       \
+    do                                                                                                        \
+    {                                                                                                         \
+        std::string a_ = (a), b_ = (b); /* cópia: a pode ser c_str() de um temporário */                      \
+        if (a_ != b_)                                                                                         \
+        {                                                                                                     \
+            fprintf(stderr, "%s:%d: CHECK_STR(%s, %s) failed: \"%s\" != \"%s\"\n", __FILE__, __LINE__, #a, #b, a_.c_str(), b_.c_str()); \
+            host_exit(1);                                                                                     \
+        }                                                                                                     \
+    } while (0)
+
+// Roda o caso argv[1] (sem argumento lista os casos)
+inline int host_run_case(int argc, char **argv)
+{
+    for (const host_case &c : host_cases())
+    {
+        if (argc < 2)
+        {
+            printf("%s\n", c.name);
+        }
+        else if (strcmp(argv[1], c.name) == 0)
+        {
+            c.run();
+            printf("%s: ok\n", c.name);
+            host_exit(0);
+        }
+    }
+    if (argc < 2)
+        return 0;
+    fprintf(stderr, "unknown case %s\n", argv[1]);
+    return 2;
+}
@@ -0,0 +1,25 @@
+// Modem simulado + A7672SA ligado a ele, pronto depois de start() (boot completo e comandos de inicialização enviados)
+#pragma once
+#include "MQTT_A7672SA.h"
+#include "modem_sim.h"
+
+struct host_modem
+{
+    modem_sim sim; // antes do modem: os hooks da UART precisam existir quando o driver é instalado
+    A7672SA modem;
+
+    explicit host_modem(const sim_config &config = sim_config())
+        : sim(config), modem(GPIO_NUM_17, GPIO_NUM_16, GPIO_NUM_5, 115200, 1024)
+    {
+    }
+
+    bool start(uint32_t timeout = 15000)
+    {
+        if (!modem.begin())
+            return false;
+        uint32_t start = millis();
+        while (modem.boot_report().init_done == 0 && millis() - start < timeout)
+            vTaskDelay(pdMS_TO_TICKS(10));
+        return modem.boot_report().init_done != 0;
+    }
+};
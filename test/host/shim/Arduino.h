@@ -0,0 +1,50 @@
+// Subconjunto do Arduino usado pela biblioteca: millis() e String sobre std::string
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+
+unsigned long millis();
+
+class String
+{
+private:
+    std::string s_;
+
+public:
+    String(const char *c = "") : s_(c ? c : "") {}
+    String(const std::string &s) : s_(s) {}
+    explicit String(int v) : s_(std::to_string(v)) {}
+
+    String &operator+=(char c)
+    {
+        s_ += c;
+        return *this;
+    }
+    String &operator+=(const String &o)
+    {
+        s_ += o.s_;
+        return *this;
+    }
+    String operator+(const String &o) const { return String(s_ + o.s_); }
+    bool operator==(const char *o) const { return s_ == o; }
+    bool operator==(const String &o) const { return s_ == o.s_; }
+    bool operator!=(const char *o) const { return s_ != o; }
+
+    int indexOf(char c, int from = 0) const;
+    int indexOf(const char *str, int from = 0) const;
+    int lastIndexOf(char c) const;
+    int lastIndexOf(const char *str) const;
+    String substring(int from, int to = -1) const;
+    bool startsWith(const char *prefix) const;
+    bool endsWith(const char *suffix) const;
+    void remove(unsigned index, unsigned count);
+    void trim();
+    long toInt() const;
+
+    const char *c_str() const { return s_.c_str(); }
+    unsigned length() const { return s_.size(); }
+};
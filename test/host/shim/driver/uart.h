@@ -0,0 +1,56 @@
+#pragma once
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef enum
+{
+    UART_NUM_0,
+    UART_NUM_1,
+    UART_NUM_2
+} uart_port_t;
+typedef enum
+{
+    UART_DATA_8_BITS = 3
+} uart_word_length_t;
+typedef enum
+{
+    UART_PARITY_DISABLE
+} uart_parity_t;
+typedef enum
+{
+    UART_STOP_BITS_1 = 1
+} uart_stop_bits_t;
+typedef enum
+{
+    UART_HW_FLOWCTRL_DISABLE
+} uart_hw_flowcontrol_t;
+typedef enum
+{
+    UART_SCLK_APB
+} uart_sclk_t;
+
+typedef struct
+{
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+#define UART_PIN_NO_CHANGE (-1)
+
+// Só a UART_NUM_1 é modelada: o outro lado do fio é o simulador (veja host_shim.h)
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int flags);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+bool uart_is_driver_installed(uart_port_t port);
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks);
+int uart_write_bytes(uart_port_t port, const void *src, size_t size);
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks);
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size);
+esp_err_t uart_flush_input(uart_port_t port);
+esp_err_t uart_driver_delete(uart_port_t port);
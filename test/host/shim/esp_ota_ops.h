@@ -0,0 +1,20 @@
+#pragma once
+#include "esp_system.h"
+
+typedef uint32_t esp_ota_handle_t;
+typedef struct
+{
+    uint32_t address;
+    uint32_t size;
+    const char *label;
+} esp_partition_t;
+
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+
+// Partição OTA em memória (host_ota_image() em host_shim.h devolve o que foi gravado)
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// CRC-32 IEEE encadeável, como a da ROM do ESP32 (crc = 0 no primeiro bloco)
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+
+#define ESP_ERROR_CHECK(x)                                        \
+    do                                                            \
+    {                                                             \
+        esp_err_t err_rc_ = (x);                                  \
+        if (err_rc_ != ESP_OK)                                    \
+            host_error_check_failed(err_rc_, __FILE__, __LINE__); \
+    } while (0)
+
+void host_error_check_failed(esp_err_t err, const char *file, int line);
+const char *esp_err_to_name(esp_err_t err);
+int64_t esp_timer_get_time(void);
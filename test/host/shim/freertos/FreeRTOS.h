@@ -0,0 +1,32 @@
+// FreeRTOS mínimo para compilar a biblioteca no host (ticks = ms; tarefas = std::thread, veja shim.cpp)
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define portMAX_DELAY 0xffffffffUL
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portTICK_PERIOD_MS 1
+#define portTICK_RATE_MS 1
+#define pdMS_TO_TICKS(x) ((TickType_t)(x))
+#define configIDLE_TASK_STACK_SIZE 1536
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY 0
+
+// Seção crítica do ESP32 (spinlock + interrupções); no host vira um spinlock entre threads
+typedef struct
+{
+    volatile int locked;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void host_mux_enter(portMUX_TYPE *mux);
+void host_mux_exit(portMUX_TYPE *mux);
+#define portENTER_CRITICAL(mux) host_mux_enter(mux)
+#define portEXIT_CRITICAL(mux) host_mux_exit(mux)
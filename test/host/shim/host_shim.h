@@ -0,0 +1,44 @@
+/*
+Ligações do shim com o teste: o lado "modem" da UART_NUM_1 e o pino EN. O simulador (sim/modem_sim.h) usa estas
+funções; um teste só as chama diretamente para cenários que o simulador não cobre.
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+
+#include "freertos/task.h"
+
+/*
+Recebe o que a biblioteca escreveu na UART. due_us é o instante (host_micros) em que o último byte termina de sair
+pelo fio na taxa configurada; o modem não pode responder antes disso.
+*/
+using host_uart_tx_hook = std::function<void(const uint8_t *data, size_t len, uint64_t due_us)>;
+using host_gpio_hook = std::function<void(int pin, uint32_t level)>;
+
+void host_uart_set_tx_hook(host_uart_tx_hook hook);
+void host_gpio_set_hook(host_gpio_hook hook);
+
+// Coloca bytes na FIFO de recepção a partir de at_us (ou agora), ritmados pela taxa da UART se host_uart_set_paced(true)
+void host_uart_feed(const void *data, size_t len, uint64_t at_us = 0);
+void host_uart_set_paced(bool paced);
+uint32_t host_uart_baud();
+// Bytes ainda não lidos pela biblioteca (inclui os que estão "no fio")
+size_t host_uart_pending();
+
+uint64_t host_micros();
+// Tempo de CPU da thread atual em ns (CLOCK_THREAD_CPUTIME_ID)
+uint64_t host_thread_cpu_ns();
+// Soma do tempo de CPU de todas as tarefas criadas com xTaskCreate (as que já terminaram incluídas)
+uint64_t host_tasks_cpu_ns();
+
+// Nome da tarefa (xTaskCreate) ou "main"/"thread" para threads que não vieram do shim
+const char *host_task_name(TaskHandle_t task);
+
+// Imagem gravada pelo último esp_ota_begin/write e se esp_ota_set_boot_partition foi chamado
+const std::string &host_ota_image();
+bool host_ota_boot_set();
+
+// Encerra o processo sem destruir estáticos com as tarefas do modem ainda rodando
+void host_exit(int code);
@@ -0,0 +1,1142 @@
+/*
+Implementação no host das APIs do ESP-IDF/FreeRTOS/Arduino usadas pela biblioteca.
+
+Tarefas são std::thread. vTaskDelete(NULL) encerra a tarefa atual com uma exceção capturada no ponto de entrada;
+vTaskDelete(outra) marca a tarefa e ela termina no próximo ponto de bloqueio (vTaskDelay, semáforos, filas, event
+groups, uart_read_bytes), que esperam em fatias de 10 ms. A UART_NUM_1 tem uma FIFO de recepção alimentada pelo
+simulador com o ritmo da taxa configurada; o que a biblioteca escreve vai para o tx hook.
+*/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_ota_ops.h"
+#include "nvs.h"
+#include "driver/uart.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "host_shim.h"
+
+using host_clock = std::chrono::steady_clock;
+
+static const host_clock::time_point host_epoch = host_clock::now();
+static const auto WAIT_SLICE = std::chrono::milliseconds(10);
+
+uint64_t host_micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(host_clock::now() - host_epoch).count();
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(uint32_t)(host_micros() / 1000);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)host_micros();
+}
+
+static uint64_t cpu_clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t host_thread_cpu_ns()
+{
+    return cpu_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void host_exit(int code)
+{
+    fflush(stdout);
+    fflush(stderr);
+    _exit(code);
+}
+
+// ---------------------------------------------------------------- tarefas
+
+struct host_task_exit
+{
+};
+
+struct host_task
+{
+    std::string name;
+    UBaseType_t priority;
+    bool shim_task; // criada por xTaskCreate (as demais são threads do teste)
+    pthread_t thread;
+    std::atomic<bool> kill{false};
+    std::atomic<bool> done{false};
+};
+
+static thread_local host_task *current_task_ = nullptr;
+static std::mutex tasks_mutex_;
+static std::vector<host_task *> tasks_;
+static uint64_t tasks_finished_cpu_ns_ = 0;
+
+static host_task *self_task()
+{
+    if (current_task_ == nullptr)
+    {
+        host_task *t = new host_task(); // vive até o fim do processo: o handle pode ser comparado depois
+        static std::atomic<int> foreign{0};
+        t->name = foreign++ == 0 ? "main" : "thread";
+        t->priority = 1;
+        t->shim_task = false;
+        t->thread = pthread_self();
+        current_task_ = t;
+    }
+    return current_task_;
+}
+
+// Ponto de cancelamento: uma tarefa apagada por outra termina aqui
+static void kill_point()
+{
+    if (current_task_ != nullptr && current_task_->kill.load())
+        throw host_task_exit();
+}
+
+static bool forever(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY;
+}
+
+static host_clock::time_point deadline_after(TickType_t ticks)
+{
+    return host_clock::now() + std::chrono::milliseconds(forever(ticks) ? 0 : ticks);
+}
+
+/*
+Espera pred() em fatias de WAIT_SLICE (ou até wake_at, se antes), checando cancelamento entre elas.
+Retorna o valor final de pred(). lock deve estar com o mutex de cv.
+*/
+template <typename Pred>
+static bool wait_until(std::unique_lock<std::mutex> &lock, std::condition_variable &cv, TickType_t ticks, Pred pred)
+{
+    host_clock::time_point deadline = deadline_after(ticks);
+    while (!pred())
+    {
+        kill_point();
+        host_clock::time_point now = host_clock::now();
+        if (!forever(ticks) && now >= deadline)
+            return false;
+        host_clock::time_point slice = now + WAIT_SLICE;
+        cv.wait_until(lock, forever(ticks) || slice < deadline ? slice : deadline);
+    }
+    return true;
+}
+
+static void task_entry(host_task *task, TaskFunction_t fn, void *arg)
+{
+    current_task_ = task;
+    try
+    {
+        fn(arg);
+    }
+    catch (const host_task_exit &)
+    {
+    }
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    tasks_finished_cpu_ns_ += host_thread_cpu_ns();
+    task->done = true;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    (void)stack;
+    host_task *task = new host_task();
+    task->name = name ? name : "";
+    task->priority = priority;
+    task->shim_task = true;
+    // o handle precisa estar gravado antes da tarefa rodar (a biblioteca compara com ele logo no início)
+    if (handle != nullptr)
+        *handle = task;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        tasks_.push_back(task);
+    }
+    std::thread thread(task_entry, task, fn, arg);
+    task->thread = thread.native_handle();
+    thread.detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                                   TaskHandle_t *handle, BaseType_t core)
+{
+    (void)core;
+    return xTaskCreate(fn, name, stack, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    host_task *task = static_cast<host_task *>(handle);
+    if (task == nullptr || task == current_task_)
+        throw host_task_exit();
+
+    task->kill = true;
+    host_clock::time_point deadline = host_clock::now() + std::chrono::seconds(2);
+    while (!task->done.load() && host_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (!task->done.load())
+        fprintf(stderr, "[shim] task %s did not stop within 2 s\n", task->name.c_str());
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    kill_point();
+    host_clock::time_point deadline = deadline_after(ticks);
+    while (host_clock::now() < deadline)
+    {
+        host_clock::time_point slice = host_clock::now() + WAIT_SLICE;
+        std::this_thread::sleep_until(slice < deadline ? slice : deadline);
+        kill_point();
+    }
+    if (ticks == 0)
+        sched_yield();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return self_task();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)millis();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle)
+{
+    host_task *task = handle != nullptr ? static_cast<host_task *>(handle) : self_task();
+    return task->priority;
+}
+
+const char *host_task_name(TaskHandle_t handle)
+{
+    return handle != nullptr ? static_cast<host_task *>(handle)->name.c_str() : "";
+}
+
+uint64_t host_tasks_cpu_ns()
+{
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    uint64_t total = tasks_finished_cpu_ns_;
+    for (host_task *task : tasks_)
+    {
+        clockid_t clock;
+        if (!task->done.load() && pthread_getcpuclockid(task->thread, &clock) == 0)
+            total += cpu_clock_ns(clock);
+    }
+    return total;
+}
+
+// ---------------------------------------------------------------- seções críticas
+
+void host_mux_enter(portMUX_TYPE *mux)
+{
+    while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE) != 0)
+        sched_yield();
+}
+
+void host_mux_exit(portMUX_TYPE *mux)
+{
+    __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------------- semáforos
+
+enum host_sem_type
+{
+    SEM_MUTEX,
+    SEM_RECURSIVE,
+    SEM_BINARY
+};
+
+struct host_sem
+{
+    host_sem_type type;
+    std::mutex m;
+    std::condition_variable cv;
+    int count = 0;              // binário
+    host_task *holder = nullptr; // mutexes
+    int depth = 0;              // recursivo
+};
+
+static SemaphoreHandle_t sem_create(host_sem_type type)
+{
+    host_sem *sem = new host_sem();
+    sem->type = type;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_create(SEM_MUTEX);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return sem_create(SEM_RECURSIVE);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_create(SEM_BINARY);
+}
+
+static BaseType_t sem_take(host_sem *sem, TickType_t ticks, bool recursive)
+{
+    host_task *self = self_task();
+    std::unique_lock<std::mutex> lock(sem->m);
+    if (recursive && sem->holder == self)
+    {
+        sem->depth++;
+        return pdPASS;
+    }
+    bool ok = wait_until(lock, sem->cv, ticks, [sem]()
+                         { return sem->type == SEM_BINARY ? sem->count > 0 : sem->holder == nullptr; });
+    if (!ok)
+        return pdFAIL;
+    if (sem->type == SEM_BINARY)
+    {
+        sem->count = 0;
+    }
+    else
+    {
+        sem->holder = self;
+        sem->depth = 1;
+    }
+    return pdPASS;
+}
+
+static BaseType_t sem_give(host_sem *sem, bool recursive)
+{
+    std::lock_guard<std::mutex> lock(sem->m);
+    if (sem->type == SEM_BINARY)
+    {
+        if (sem->count > 0)
+            return pdFAIL;
+        sem->count = 1;
+    }
+    else
+    {
+        if (sem->holder != self_task())
+            return pdFAIL;
+        if (recursive && --sem->depth > 0)
+            return pdPASS;
+        sem->holder = nullptr;
+        sem->depth = 0;
+    }
+    sem->cv.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return sem_take(static_cast<host_sem *>(sem), ticks, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return sem_give(static_cast<host_sem *>(sem), false);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return sem_take(static_cast<host_sem *>(sem), ticks, true);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+    return sem_give(static_cast<host_sem *>(sem), true);
+}
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t handle)
+{
+    host_sem *sem = static_cast<host_sem *>(handle);
+    std::lock_guard<std::mutex> lock(sem->m);
+    return sem->holder;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    // Uma tarefa apagada pode ter ficado com a referência: o objeto é mantido, como memória "vazada" no alvo
+    (void)sem;
+}
+
+// ---------------------------------------------------------------- filas
+
+struct host_queue
+{
+    size_t length;
+    size_t item_size;
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue *queue = new host_queue();
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t ticks)
+{
+    host_queue *queue = static_cast<host_queue *>(handle);
+    std::unique_lock<std::mutex> lock(queue->m);
+    if (!wait_until(lock, queue->cv, ticks, [queue]()
+                    { return queue->items.size() < queue->length; }))
+        return pdFAIL;
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t ticks)
+{
+    host_queue *queue = static_cast<host_queue *>(handle);
+    std::unique_lock<std::mutex> lock(queue->m);
+    if (!wait_until(lock, queue->cv, ticks, [queue]()
+                    { return !queue->items.empty(); }))
+        return pdFAIL;
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle)
+{
+    host_queue *queue = static_cast<host_queue *>(handle);
+    std::lock_guard<std::mutex> lock(queue->m);
+    return queue->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t handle)
+{
+    host_queue *queue = static_cast<host_queue *>(handle);
+    std::lock_guard<std::mutex> lock(queue->m);
+    queue->items.clear();
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    (void)queue; // idem vSemaphoreDelete
+}
+
+// ---------------------------------------------------------------- event groups
+
+struct host_event_group
+{
+    std::mutex m;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return new host_event_group();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    (void)group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t handle, EventBits_t bits)
+{
+    host_event_group *group = static_cast<host_event_group *>(handle);
+    std::lock_guard<std::mutex> lock(group->m);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t handle, EventBits_t bits)
+{
+    host_event_group *group = static_cast<host_event_group *>(handle);
+    std::lock_guard<std::mutex> lock(group->m);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t handle)
+{
+    host_event_group *group = static_cast<host_event_group *>(handle);
+    std::lock_guard<std::mutex> lock(group->m);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t handle, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_all, TickType_t ticks)
+{
+    host_event_group *group = static_cast<host_event_group *>(handle);
+    std::unique_lock<std::mutex> lock(group->m);
+    bool ok = wait_until(lock, group->cv, ticks, [group, bits, wait_all]()
+                         { return wait_all ? (group->bits & bits) == bits : (group->bits & bits) != 0; });
+    EventBits_t result = group->bits;
+    if (ok && clear_on_exit)
+        group->bits &= ~bits;
+    return result;
+}
+
+// ---------------------------------------------------------------- UART_NUM_1
+
+struct rx_chunk
+{
+    uint64_t avail_us; // instante em que o último byte do pedaço chega
+    std::string bytes;
+};
+
+static std::mutex uart_mutex_;
+static std::condition_variable uart_cv_;
+static bool uart_installed_ = false;
+static uint32_t uart_baud_ = 115200;
+static bool uart_paced_ = true;
+static std::deque<rx_chunk> uart_rx_;
+static size_t uart_rx_offset_ = 0; // já lido do primeiro pedaço
+static uint64_t uart_rx_wire_us_ = 0;
+static uint64_t uart_tx_busy_us_ = 0;
+
+static std::mutex uart_tx_mutex_; // serializa as escritas, como a FIFO de TX
+static host_uart_tx_hook uart_tx_hook_;
+static host_gpio_hook gpio_hook_;
+
+// Os bytes chegam ao buffer do driver em rajadas de até UART_FULL_THRESH (120) ou no timeout de ociosidade
+static const size_t RX_WIRE_CHUNK = 120;
+
+static uint64_t wire_us(size_t bytes)
+{
+    return uart_paced_ ? (uint64_t)bytes * 10 * 1000000 / uart_baud_ : 0;
+}
+
+void host_uart_set_tx_hook(host_uart_tx_hook hook)
+{
+    std::lock_guard<std::mutex> lock(uart_tx_mutex_);
+    uart_tx_hook_ = hook;
+}
+
+void host_gpio_set_hook(host_gpio_hook hook)
+{
+    gpio_hook_ = hook;
+}
+
+void host_uart_set_paced(bool paced)
+{
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    uart_paced_ = paced;
+}
+
+uint32_t host_uart_baud()
+{
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    return uart_baud_;
+}
+
+void host_uart_feed(const void *data, size_t len, uint64_t at_us)
+{
+    const char *bytes = static_cast<const char *>(data);
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    if (!uart_installed_)
+        return; // sem driver os bytes se perdem, como no alvo
+    uint64_t now = host_micros();
+    uint64_t t = at_us > now ? at_us : now;
+    if (t < uart_rx_wire_us_)
+        t = uart_rx_wire_us_;
+    for (size_t off = 0; off < len; off += RX_WIRE_CHUNK)
+    {
+        size_t n = len - off < RX_WIRE_CHUNK ? len - off : RX_WIRE_CHUNK;
+        t += wire_us(n);
+        uart_rx_.push_back({t, std::string(bytes + off, n)});
+    }
+    uart_rx_wire_us_ = t;
+    uart_cv_.notify_all();
+}
+
+size_t host_uart_pending()
+{
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    size_t total = 0;
+    for (const rx_chunk &chunk : uart_rx_)
+        total += chunk.bytes.size();
+    return total - uart_rx_offset_;
+}
+
+// Bytes que já chegaram (chamar com uart_mutex_)
+static size_t rx_available(uint64_t now, uint64_t *next_us)
+{
+    size_t total = 0;
+    *next_us = 0;
+    for (const rx_chunk &chunk : uart_rx_)
+    {
+        if (chunk.avail_us > now)
+        {
+            *next_us = chunk.avail_us;
+            break;
+        }
+        total += chunk.bytes.size();
+    }
+    return total - (uart_rx_.empty() ? 0 : uart_rx_offset_);
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int flags)
+{
+    (void)rx_buffer_size;
+    (void)tx_buffer_size;
+    (void)queue_size;
+    (void)queue;
+    (void)flags;
+    if (port != UART_NUM_1)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    if (uart_installed_)
+        return ESP_FAIL;
+    uart_installed_ = true;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    if (port != UART_NUM_1 || config == nullptr || config->baud_rate <= 0)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    uart_baud_ = config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    (void)tx;
+    (void)rx;
+    (void)rts;
+    (void)cts;
+    return port == UART_NUM_1 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+bool uart_is_driver_installed(uart_port_t port)
+{
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    return port == UART_NUM_1 && uart_installed_;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+    if (port != UART_NUM_1)
+        return -1;
+    uint8_t *out = static_cast<uint8_t *>(buf);
+    std::unique_lock<std::mutex> lock(uart_mutex_);
+    host_clock::time_point deadline = deadline_after(ticks);
+
+    // Como no ESP-IDF: espera length bytes ou o prazo, e devolve o que houver
+    while (true)
+    {
+        if (!uart_installed_)
+            return -1;
+        uint64_t next_us;
+        size_t avail = rx_available(host_micros(), &next_us);
+        host_clock::time_point now = host_clock::now();
+        if (avail >= length || (!forever(ticks) && now >= deadline))
+            break;
+        kill_point();
+        host_clock::time_point wake = now + WAIT_SLICE;
+        if (next_us != 0)
+        {
+            host_clock::time_point arrival = host_epoch + std::chrono::microseconds(next_us);
+            if (arrival < wake)
+                wake = arrival;
+        }
+        if (!forever(ticks) && deadline < wake)
+            wake = deadline;
+        uart_cv_.wait_until(lock, wake);
+    }
+
+    uint64_t now_us = host_micros();
+    size_t copied = 0;
+    while (copied < length && !uart_rx_.empty() && uart_rx_.front().avail_us <= now_us)
+    {
+        rx_chunk &chunk = uart_rx_.front();
+        size_t n = chunk.bytes.size() - uart_rx_offset_;
+        if (n > length - copied)
+            n = length - copied;
+        memcpy(out + copied, chunk.bytes.data() + uart_rx_offset_, n);
+        copied += n;
+        uart_rx_offset_ += n;
+        if (uart_rx_offset_ == chunk.bytes.size())
+        {
+            uart_rx_.pop_front();
+            uart_rx_offset_ = 0;
+        }
+    }
+    return (int)copied;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    if (port != UART_NUM_1)
+        return -1;
+    uint64_t due;
+    {
+        std::lock_guard<std::mutex> lock(uart_mutex_);
+        if (!uart_installed_)
+            return -1;
+        uint64_t now = host_micros();
+        if (uart_tx_busy_us_ < now)
+            uart_tx_busy_us_ = now;
+        uart_tx_busy_us_ += wire_us(size);
+        due = uart_tx_busy_us_;
+    }
+    std::lock_guard<std::mutex> lock(uart_tx_mutex_);
+    if (uart_tx_hook_)
+        uart_tx_hook_(static_cast<const uint8_t *>(src), size, due);
+    return (int)size;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks)
+{
+    if (port != UART_NUM_1)
+        return ESP_ERR_INVALID_ARG;
+    uint64_t busy;
+    {
+        std::lock_guard<std::mutex> lock(uart_mutex_);
+        busy = uart_tx_busy_us_;
+    }
+    uint64_t now = host_micros();
+    if (busy <= now)
+        return ESP_OK;
+    uint64_t wait = busy - now;
+    if (!forever(ticks) && wait > (uint64_t)ticks * 1000)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+        return ESP_FAIL;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    if (port != UART_NUM_1)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    uint64_t next_us;
+    *size = rx_available(host_micros(), &next_us);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    if (port != UART_NUM_1)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    uint64_t now = host_micros();
+    while (!uart_rx_.empty() && uart_rx_.front().avail_us <= now)
+        uart_rx_.pop_front();
+    uart_rx_offset_ = 0;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+    if (port != UART_NUM_1)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(uart_mutex_);
+    if (!uart_installed_)
+        return ESP_FAIL;
+    uart_installed_ = false;
+    uart_rx_.clear();
+    uart_rx_offset_ = 0;
+    uart_cv_.notify_all();
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------- GPIO
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+    (void)pin;
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    if (gpio_hook_)
+        gpio_hook_(pin, level);
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------- NVS
+
+struct nvs_open_handle
+{
+    std::string ns;
+    nvs_open_mode_t mode;
+};
+
+static std::mutex nvs_mutex_;
+static std::map<std::string, bool> nvs_namespaces_;
+static std::map<std::string, uint32_t> nvs_u32_;
+static std::map<std::string, std::vector<uint8_t>> nvs_blobs_;
+static std::map<nvs_handle_t, nvs_open_handle> nvs_handles_;
+static nvs_handle_t nvs_next_handle_ = 1;
+
+#define ESP_ERR_NVS_INVALID_HANDLE 0x1107
+#define ESP_ERR_NVS_READ_ONLY 0x1104
+
+static bool nvs_key(nvs_handle_t handle, const char *key, std::string *full, bool write)
+{
+    auto it = nvs_handles_.find(handle);
+    if (it == nvs_handles_.end() || (write && it->second.mode == NVS_READONLY))
+        return false;
+    *full = it->second.ns + "/" + key;
+    return true;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    if (mode == NVS_READONLY && nvs_namespaces_.count(name) == 0)
+        return ESP_ERR_NVS_NOT_FOUND;
+    nvs_namespaces_[name] = true;
+    *handle = nvs_next_handle_++;
+    nvs_handles_[*handle] = {name, mode};
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    nvs_handles_.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    return nvs_handles_.count(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *value)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    std::string full;
+    if (!nvs_key(handle, key, &full, false))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    auto it = nvs_u32_.find(full);
+    if (it == nvs_u32_.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    *value = it->second;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    std::string full;
+    if (!nvs_key(handle, key, &full, true))
+        return ESP_ERR_NVS_READ_ONLY;
+    nvs_u32_[full] = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    std::string full;
+    if (!nvs_key(handle, key, &full, false))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    auto it = nvs_blobs_.find(full);
+    if (it == nvs_blobs_.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (value == nullptr)
+    {
+        *length = it->second.size();
+        return ESP_OK;
+    }
+    if (*length < it->second.size())
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(value, it->second.data(), it->second.size());
+    *length = it->second.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    std::string full;
+    if (!nvs_key(handle, key, &full, true))
+        return ESP_ERR_NVS_READ_ONLY;
+    const uint8_t *bytes = static_cast<const uint8_t *>(value);
+    nvs_blobs_[full] = std::vector<uint8_t>(bytes, bytes + length);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::lock_guard<std::mutex> lock(nvs_mutex_);
+    std::string full;
+    if (!nvs_key(handle, key, &full, true))
+        return ESP_ERR_NVS_READ_ONLY;
+    size_t erased = nvs_u32_.erase(full) + nvs_blobs_.erase(full);
+    return erased ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+// ---------------------------------------------------------------- OTA
+
+static const esp_partition_t ota_partition_ = {0x110000, 0x180000, "ota_1"};
+static std::string ota_image_;
+static bool ota_open_ = false;
+static bool ota_boot_set_ = false;
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start)
+{
+    (void)start;
+    return &ota_partition_;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *handle)
+{
+    if (partition != &ota_partition_ || (image_size != OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size))
+        return ESP_ERR_INVALID_ARG;
+    ota_image_.clear();
+    ota_open_ = true;
+    ota_boot_set_ = false;
+    *handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (handle != 1 || !ota_open_)
+        return ESP_ERR_INVALID_ARG;
+    if (ota_image_.size() + size > ota_partition_.size)
+        return ESP_ERR_INVALID_SIZE;
+    ota_image_.append(static_cast<const char *>(data), size);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (handle != 1 || !ota_open_)
+        return ESP_ERR_INVALID_ARG;
+    ota_open_ = false;
+    return ota_image_.empty() ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    if (handle != 1)
+        return ESP_ERR_INVALID_ARG;
+    ota_open_ = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    if (partition != &ota_partition_)
+        return ESP_ERR_INVALID_ARG;
+    ota_boot_set_ = true;
+    return ESP_OK;
+}
+
+const std::string &host_ota_image()
+{
+    return ota_image_;
+}
+
+bool host_ota_boot_set()
+{
+    return ota_boot_set_;
+}
+
+// ---------------------------------------------------------------- CRC, erros e log
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+const char *esp_err_to_name(esp_err_t err)
+{
+    switch (err)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void host_error_check_failed(esp_err_t err, const char *file, int line)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %s (%d) at %s:%d\n", esp_err_to_name(err), err, file, line);
+    abort();
+}
+
+static int log_level()
+{
+    static int level = -1;
+    if (level < 0)
+    {
+        const char *env = getenv("A7672SA_HOST_LOG");
+        level = env != nullptr ? atoi(env) : 0;
+    }
+    return level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    (void)level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    if ((int)level > log_level())
+        return;
+    static const char letters[] = "NEWIDV";
+    static std::mutex log_mutex;
+    std::lock_guard<std::mutex> lock(log_mutex);
+    fprintf(stderr, "%c (%lu) %s: ", letters[level], millis(), tag);
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+// ---------------------------------------------------------------- String
+
+int String::indexOf(char c, int from) const
+{
+    if (from < 0 || (size_t)from >= s_.size())
+        return -1;
+    size_t pos = s_.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const char *str, int from) const
+{
+    if (from < 0 || (size_t)from > s_.size())
+        return -1;
+    size_t pos = s_.find(str, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const
+{
+    size_t pos = s_.rfind(c);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const char *str) const
+{
+    size_t pos = s_.rfind(str);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+// Como no Arduino: índices fora da faixa são ajustados e from > to é trocado
+String String::substring(int from, int to) const
+{
+    int size = (int)s_.size();
+    if (to < 0 || to > size)
+        to = size;
+    if (from < 0)
+        from = 0;
+    if (from > to)
+    {
+        int t = from;
+        from = to;
+        to = t;
+    }
+    if (from >= size)
+        return String("");
+    return String(s_.substr(from, to - from));
+}
+
+bool String::startsWith(const char *prefix) const
+{
+    return s_.compare(0, strlen(prefix), prefix) == 0;
+}
+
+bool String::endsWith(const char *suffix) const
+{
+    size_t n = strlen(suffix);
+    return s_.size() >= n && s_.compare(s_.size() - n, n, suffix) == 0;
+}
+
+void String::remove(unsigned index, unsigned count)
+{
+    if (index < s_.size())
+        s_.erase(index, count);
+}
+
+void String::trim()
+{
+    size_t begin = s_.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+    {
+        s_.clear();
+        return;
+    }
+    size_t end = s_.find_last_not_of(" \t\r\n");
+    s_ = s_.substr(begin, end - begin + 1);
+}
+
+long String::toInt() const
+{
+    return strtol(s_.c_str(), NULL, 10);
+}
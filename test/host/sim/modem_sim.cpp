@@ -0,0 +1,545 @@
+#include "modem_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "host_shim.h"
+
+enum
+{
+    TAG_SCAN = -1 // lista do AT+COPS=? (cancelada por qualquer byte recebido)
+};
+
+static const char OK_REPLY[] = "\r\nOK\r\n";
+static const char ERROR_REPLY[] = "\r\nERROR\r\n";
+
+static bool starts_with(const std::string &s, const char *prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// "C:/nome" ou "nome" -> "nome"
+static std::string fs_name(const std::string &s)
+{
+    return starts_with(s, "C:/") || starts_with(s, "c:/") ? s.substr(3) : s;
+}
+
+modem_sim::modem_sim(const sim_config &config) : config_(config)
+{
+    operators_ = "(2,\"VIVO\",\"VIVO\",\"72406\",7),(1,\"TIM BRASIL\",\"TIM\",\"72402\",7),,(0,1,2,3,4),(0,1,2)";
+    host_uart_set_paced(config_.paced);
+    host_uart_set_tx_hook([this](const uint8_t *data, size_t len, uint64_t due_us)
+                          { this->on_tx_(data, len, due_us); });
+    host_gpio_set_hook([this](int pin, uint32_t level)
+                       { this->on_gpio_(pin, level); });
+    scheduler_ = std::thread(&modem_sim::run_scheduler_, this);
+}
+
+modem_sim::~modem_sim()
+{
+    host_uart_set_tx_hook(nullptr);
+    host_gpio_set_hook(nullptr);
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_);
+        quit_ = true;
+    }
+    cv_.notify_all();
+    scheduler_.join();
+}
+
+void modem_sim::on(const std::string &prefix, handler h)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    handlers_.emplace_back(prefix, h);
+}
+
+void modem_sim::set_http_backend(http_backend backend)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    http_backend_ = backend;
+}
+
+void modem_sim::reply(const std::string &bytes, uint32_t delay_ms, int tag)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    uint64_t now = host_micros();
+    uint64_t base = now_us_ > now ? now_us_ : now;
+    queue_.push_back({base + (uint64_t)(config_.reply_ms + delay_ms) * 1000, seq_++, bytes, tag});
+    cv_.notify_all();
+}
+
+void modem_sim::urc(const std::string &bytes, uint32_t delay_ms)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    queue_.push_back({host_micros() + (uint64_t)delay_ms * 1000, seq_++, bytes, 0});
+    cv_.notify_all();
+}
+
+void modem_sim::cancel(int tag)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    queue_.erase(std::remove_if(queue_.begin(), queue_.end(), [tag](const pending &p)
+                                { return p.tag == tag; }),
+                 queue_.end());
+}
+
+void modem_sim::expect_raw(size_t n, raw_handler done)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    if (n == 0)
+    {
+        done(*this, std::string());
+        return;
+    }
+    raw_left_ = n;
+    raw_.clear();
+    raw_done_ = done;
+}
+
+bool modem_sim::powered()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    return powered_;
+}
+
+uint64_t modem_sim::boot_started_us()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    return boot_started_us_;
+}
+
+std::vector<sim_publish> modem_sim::publishes()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    return publishes_;
+}
+
+std::vector<std::string> modem_sim::commands()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    return commands_;
+}
+
+size_t modem_sim::command_count(const std::string &prefix)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    size_t n = 0;
+    for (const std::string &cmd : commands_)
+        n += starts_with(cmd, prefix.c_str());
+    return n;
+}
+
+std::string modem_sim::file(const std::string &name)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    auto it = files_.find(name);
+    return it != files_.end() ? it->second : std::string();
+}
+
+void modem_sim::set_file(const std::string &name, const std::string &data)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    files_[name] = data;
+}
+
+void modem_sim::set_operators(const std::string &cops_list)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    operators_ = cops_list;
+}
+
+// Entrega cada resposta à UART no seu instante, em ordem de (instante, agendamento)
+void modem_sim::run_scheduler_()
+{
+    std::unique_lock<std::recursive_mutex> lock(m_);
+    while (!quit_)
+    {
+        if (queue_.empty())
+        {
+            cv_.wait(lock);
+            continue;
+        }
+        auto next = std::min_element(queue_.begin(), queue_.end(), [](const pending &a, const pending &b)
+                                     { return a.due != b.due ? a.due < b.due : a.seq < b.seq; });
+        uint64_t now = host_micros();
+        if (next->due > now)
+        {
+            cv_.wait_for(lock, std::chrono::microseconds(next->due - now));
+            continue;
+        }
+        pending p = *next;
+        queue_.erase(next);
+        if (p.tag == TAG_SCAN)
+            scanning_ = false;
+        lock.unlock();
+        host_uart_feed(p.bytes.data(), p.bytes.size(), p.due);
+        lock.lock();
+    }
+}
+
+void modem_sim::on_gpio_(int pin, uint32_t level)
+{
+    (void)pin; // o único pino que a biblioteca controla é o EN
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    if (level != 0)
+    {
+        powered_ = false;
+        queue_.clear();
+        line_.clear();
+        raw_left_ = 0;
+        raw_done_ = nullptr;
+        scanning_ = false;
+        echo_ = true;
+        http_init_ = false;
+        fds_.clear();
+        return;
+    }
+    if (powered_)
+        return;
+
+    powered_ = true;
+    now_us_ = 0;
+    boot_started_us_ = host_micros();
+    boot_at_us_ = boot_started_us_ + (uint64_t)config_.boot_ms * 1000;
+    urc("\r\nRDY\r\n", config_.boot_ms);
+    urc("\r\n+CPIN: READY\r\n", config_.boot_ms + config_.sim_ms);
+    urc("\r\nSMS DONE\r\n", config_.boot_ms + config_.sms_ms);
+    urc("\r\nPB DONE\r\n", config_.boot_ms + config_.pb_ms);
+}
+
+void modem_sim::on_tx_(const uint8_t *data, size_t len, uint64_t due_us)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_);
+    if (!powered_ || due_us < boot_at_us_)
+        return; // desligado ou ainda iniciando: os bytes se perdem
+    now_us_ = due_us;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = (char)data[i];
+        bool terminator = c == '\n' && last_ == '\r'; // o "\n" que fecha o comando anterior
+        last_ = c;
+        if (raw_left_ > 0 && !(terminator && raw_.empty()))
+        {
+            raw_ += c;
+            if (--raw_left_ == 0)
+            {
+                raw_handler done = raw_done_;
+                std::string payload;
+                payload.swap(raw_);
+                raw_done_ = nullptr;
+                done(*this, payload);
+            }
+            continue;
+        }
+        if (scanning_ && !terminator)
+        {
+            // Qualquer caractere aborta o AT+COPS=? (27.007), e o modem encerra com ERROR
+            scanning_ = false;
+            cancel(TAG_SCAN);
+            reply(ERROR_REPLY);
+            if (c == '\r' || c == '\n')
+                continue;
+        }
+        if (c == '\r')
+        {
+            if (line_.empty())
+                continue;
+            std::string cmd;
+            cmd.swap(line_);
+            if (echo_)
+                reply(cmd + "\r");
+            command_(cmd);
+        }
+        else if (c != '\n')
+        {
+            line_ += c;
+        }
+    }
+}
+
+void modem_sim::command_(const std::string &cmd)
+{
+    commands_.push_back(cmd);
+
+    const std::pair<std::string, handler> *best = nullptr;
+    for (const auto &h : handlers_)
+    {
+        if (starts_with(cmd, h.first.c_str()) && (best == nullptr || h.first.size() >= best->first.size()))
+            best = &h;
+    }
+    if (best != nullptr)
+        best->second(*this, cmd);
+    else
+        builtin_(cmd);
+}
+
+void modem_sim::ok_()
+{
+    reply(OK_REPLY);
+}
+
+void modem_sim::error_()
+{
+    reply(ERROR_REPLY);
+}
+
+void modem_sim::builtin_(const std::string &cmd)
+{
+    char buf[320];
+    if (cmd == "ATE0" || cmd == "ATE1")
+    {
+        echo_ = cmd == "ATE1";
+        ok_();
+    }
+    else if (cmd == "AT+CFUN?")
+    {
+        reply("\r\n+CFUN: 1\r\n\r\nOK\r\n");
+    }
+    else if (cmd == "AT+CPIN?")
+    {
+        reply("\r\n+CPIN: READY\r\n\r\nOK\r\n");
+    }
+    else if (cmd == "AT+COPS=?")
+    {
+        scanning_ = true;
+        reply("\r\n+COPS: " + operators_ + "\r\n\r\nOK\r\n", config_.scan_ms, TAG_SCAN);
+    }
+    else if (starts_with(cmd, "AT+COPS=3,2;+COPS?") || cmd == "AT+COPS?")
+    {
+        reply("\r\n+COPS: 0,2,\"72405\",7\r\n\r\nOK\r\n");
+    }
+    else if (cmd == "AT+CSQ;+CPSI?")
+    {
+        // Todos os campos saem do mesmo contador: um leitor que misture duas amostras percebe
+        uint32_t k = ++radio_seq_;
+        snprintf(buf, sizeof(buf),
+                 "\r\n+CSQ: %u,%u\r\n\r\n+CPSI: LTE,Online,724-05,0x%X,%u,301,EUTRAN-BAND3,1650,5,5,%d,%d,%d,%u\r\n\r\nOK\r\n",
+                 k % 32, k % 8, k, k, -(int)(k % 200), -(int)(k % 1000), -(int)(k % 700), k % 30);
+        reply(buf);
+    }
+    else if (starts_with(cmd, "AT+CMQTTCONNECT="))
+    {
+        ok_();
+        reply("\r\n+CMQTTCONNECT: 0,0\r\n", config_.connect_ms);
+    }
+    else if (starts_with(cmd, "AT+CMQTTPUB="))
+    {
+        mqtt_publish_(cmd);
+    }
+    else if (starts_with(cmd, "AT+CMQTTUNSUB="))
+    {
+        ok_();
+        reply("\r\n+CMQTTUNSUB: 0,0\r\n", config_.ack_ms[1]);
+    }
+    else if (starts_with(cmd, "AT+FS"))
+    {
+        fs_command_(cmd);
+    }
+    else if (starts_with(cmd, "AT+HTTP"))
+    {
+        http_command_(cmd);
+    }
+    else
+    {
+        ok_(); // AT, CMEE, CREG, CSOCKSETPN, CMQTTSTART/ACCQ/CFG/DISC/REL/STOP, CSSLCFG...
+    }
+}
+
+// AT+CMQTTPUB=0,"<tópico>",<qos>,<len> -> '>' -> payload -> OK -> +CMQTTPUB: 0,0 depois do ack do broker
+void modem_sim::mqtt_publish_(const std::string &cmd)
+{
+    size_t q1 = cmd.find('"');
+    size_t q2 = q1 == std::string::npos ? q1 : cmd.find('"', q1 + 1);
+    int qos = -1;
+    unsigned len = 0;
+    if (q2 == std::string::npos || sscanf(cmd.c_str() + q2 + 1, ",%d,%u", &qos, &len) != 2 || qos < 0 || qos > 2 || len == 0)
+    {
+        error_();
+        return;
+    }
+    std::string topic = cmd.substr(q1 + 1, q2 - q1 - 1);
+    reply("\r\n>");
+    expect_raw(len, [topic, qos](modem_sim &sim, const std::string &payload)
+               {
+                   sim.ok_();
+                   sim.reply("\r\n+CMQTTPUB: 0,0\r\n", sim.config_.ack_ms[qos]);
+                   sim.publishes_.push_back({topic, qos, payload, sim.queue_.back().due}); });
+}
+
+void modem_sim::fs_command_(const std::string &cmd)
+{
+    char buf[160];
+    int fd = -1;
+    unsigned a = 0, b = 0;
+
+    if (starts_with(cmd, "AT+FSOPEN="))
+    {
+        size_t comma = cmd.rfind(',');
+        if (comma == std::string::npos)
+            return error_();
+        std::string name = fs_name(cmd.substr(10, comma - 10));
+        int mode = atoi(cmd.c_str() + comma + 1);
+        bool exists = files_.count(name) != 0;
+        if (mode == 2 && !exists)
+            return error_();
+        if (mode == 1 || !exists)
+            files_[name].clear();
+        fd = next_fd_++;
+        fds_[fd] = {name, 0};
+        snprintf(buf, sizeof(buf), "\r\n+FSOPEN: %d\r\n\r\nOK\r\n", fd);
+        reply(buf);
+    }
+    else if (sscanf(cmd.c_str(), "AT+FSREAD=%d,%u", &fd, &a) == 2)
+    {
+        auto it = fds_.find(fd);
+        if (it == fds_.end())
+            return error_();
+        const std::string &data = files_[it->second.name];
+        size_t pos = it->second.pos < data.size() ? it->second.pos : data.size();
+        std::string block = data.substr(pos, a);
+        it->second.pos = pos + block.size();
+        snprintf(buf, sizeof(buf), "\r\nCONNECT %u\r\n", (unsigned)block.size());
+        reply(buf + block + "\r\nOK\r\n");
+    }
+    else if (sscanf(cmd.c_str(), "AT+FSWRITE=%d,%u,%u", &fd, &a, &b) >= 2)
+    {
+        if (fds_.count(fd) == 0 || a == 0 || a > 10240)
+            return error_();
+        reply("\r\nCONNECT\r\n");
+        expect_raw(a, [fd](modem_sim &sim, const std::string &data)
+                   {
+                       auto it = sim.fds_.find(fd);
+                       if (it == sim.fds_.end())
+                           return sim.error_();
+                       std::string &file = sim.files_[it->second.name];
+                       if (file.size() < it->second.pos)
+                           file.resize(it->second.pos);
+                       file.replace(it->second.pos, data.size(), data);
+                       it->second.pos += data.size();
+                       sim.ok_(); });
+    }
+    else if (sscanf(cmd.c_str(), "AT+FSSEEK=%d,%u", &fd, &a) == 2)
+    {
+        auto it = fds_.find(fd);
+        if (it == fds_.end())
+            return error_();
+        it->second.pos = a;
+        ok_();
+    }
+    else if (sscanf(cmd.c_str(), "AT+FSCLOSE=%d", &fd) == 1)
+    {
+        if (fds_.erase(fd) == 0)
+            return error_();
+        ok_();
+    }
+    else if (starts_with(cmd, "AT+FSDEL="))
+    {
+        if (files_.erase(fs_name(cmd.substr(9))) == 0)
+            return error_();
+        ok_();
+    }
+    else if (starts_with(cmd, "AT+FSATTRI="))
+    {
+        auto it = files_.find(fs_name(cmd.substr(11)));
+        if (it == files_.end())
+            return error_();
+        snprintf(buf, sizeof(buf), "\r\n+FSATTRI: %u\r\n\r\nOK\r\n", (unsigned)it->second.size());
+        reply(buf);
+    }
+    else if (cmd == "AT+FSLS")
+    {
+        std::string out = "\r\n+FSLS: SUBDIRECTORIES:\r\n.\r\n..\r\n\r\n+FSLS: FILES:\r\n";
+        for (const auto &f : files_)
+            out += f.first + "\r\n";
+        reply(out + "\r\nOK\r\n");
+    }
+    else if (cmd == "AT+FSMEM")
+    {
+        size_t used = 0;
+        for (const auto &f : files_)
+            used += f.second.size();
+        snprintf(buf, sizeof(buf), "\r\n+FSMEM: C:(%u, %u)\r\n\r\nOK\r\n", config_.fs_total, (unsigned)used);
+        reply(buf);
+    }
+    else
+    {
+        ok_();
+    }
+}
+
+void modem_sim::http_command_(const std::string &cmd)
+{
+    char buf[96];
+    int method = -1;
+    unsigned a = 0, b = 0;
+
+    if (cmd == "AT+HTTPINIT")
+    {
+        if (http_init_)
+            return error_(); // serviço já aberto
+        http_init_ = true;
+        ok_();
+        return;
+    }
+    if (!http_init_)
+        return error_();
+
+    if (cmd == "AT+HTTPTERM")
+    {
+        http_init_ = false;
+        ok_();
+    }
+    else if (starts_with(cmd, "AT+HTTPPARA=\"URL\",\""))
+    {
+        http_url_ = cmd.substr(19, cmd.size() - 20);
+        ok_();
+    }
+    else if (sscanf(cmd.c_str(), "AT+HTTPDATA=%u,%u", &a, &b) == 2)
+    {
+        reply("\r\nDOWNLOAD\r\n");
+        expect_raw(a, [](modem_sim &sim, const std::string &data)
+                   {
+                       sim.http_body_ = data;
+                       sim.ok_(); });
+    }
+    else if (sscanf(cmd.c_str(), "AT+HTTPACTION=%d", &method) == 1)
+    {
+        ok_();
+        http_backend backend = http_backend_;
+        std::string url = http_url_;
+        std::string body = http_body_;
+        http_body_.clear();
+        // O backend pode bloquear (servidor HTTP local): roda fora da thread que escreve na UART
+        std::thread([this, backend, method, url, body]()
+                    {
+                        sim_http_result result = backend ? backend(method, url, body)
+                                                         : sim_http_result{200, "Content-Length: 5\r\n", "hello"};
+                        std::lock_guard<std::recursive_mutex> lock(m_);
+                        http_result_ = result;
+                        char line[80];
+                        snprintf(line, sizeof(line), "\r\n+HTTPACTION: %d,%d,%u\r\n", method, result.status, (unsigned)result.body.size());
+                        reply(line, config_.http_ms); })
+            .detach();
+    }
+    else if (cmd == "AT+HTTPHEAD")
+    {
+        snprintf(buf, sizeof(buf), "HTTP/1.1 %d X\r\n", http_result_.status);
+        std::string head = buf + http_result_.headers;
+        snprintf(buf, sizeof(buf), "\r\n+HTTPHEAD: %u\r\n", (unsigned)head.size());
+        reply(buf + head + "\r\nOK\r\n");
+    }
+    else if (sscanf(cmd.c_str(), "AT+HTTPREAD=%u,%u", &a, &b) == 2)
+    {
+        std::string data = a < http_result_.body.size() ? http_result_.body.substr(a, b) : std::string();
+        snprintf(buf, sizeof(buf), "\r\nOK\r\n\r\n+HTTPREAD: %u\r\n", (unsigned)data.size());
+        reply(buf + data + (data.empty() ? "" : "\r\n+HTTPREAD: 0\r\n"));
+    }
+    else
+    {
+        ok_();
+    }
+}
@@ -0,0 +1,144 @@
+/*
+Modem A7672 simulado do outro lado da UART_NUM_1 do shim: responde aos comandos AT que a biblioteca usa (boot, MQTT,
+sistema de arquivos, HTTP, COPS, CSQ/CPSI) com os formatos e atrasos configurados. Um teste pode trocar a resposta de
+qualquer comando com on(prefixo, handler).
+
+O pino EN segue o hardware: nível 1 desliga o modem; a descida para 0 inicia o boot, e RDY / +CPIN: READY / SMS DONE /
+PB DONE saem depois de boot_ms. Antes disso os comandos ficam sem resposta.
+*/
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct sim_config
+{
+    uint32_t boot_ms = 300;     // EN liberado -> RDY
+    uint32_t sim_ms = 100;      // RDY -> +CPIN: READY
+    uint32_t sms_ms = 200;      // RDY -> SMS DONE
+    uint32_t pb_ms = 400;       // RDY -> PB DONE
+    uint32_t reply_ms = 1;      // latência de cada resposta AT
+    uint32_t ack_ms[3] = {5, 300, 400}; // comando aceito -> +CMQTTPUB, por QoS (PUBACK / PUBCOMP do broker)
+    uint32_t connect_ms = 20;   // AT+CMQTTCONNECT -> +CMQTTCONNECT: 0,0
+    uint32_t scan_ms = 200;     // AT+COPS=? -> lista
+    uint32_t http_ms = 20;      // AT+HTTPACTION -> +HTTPACTION, além do tempo do http_backend
+    uint32_t fs_total = 4000000; // bytes do sistema de arquivos C:/
+    bool paced = true;          // respostas no ritmo da taxa da UART
+};
+
+struct sim_publish
+{
+    std::string topic;
+    int qos;
+    std::string payload;
+    uint64_t ack_us; // instante (host_micros) em que o +CMQTTPUB chega à UART
+};
+
+struct sim_http_result
+{
+    int status;
+    std::string headers; // "Nome: valor\r\n..."
+    std::string body;
+};
+
+class modem_sim
+{
+public:
+    using handler = std::function<void(modem_sim &sim, const std::string &cmd)>;
+    using raw_handler = std::function<void(modem_sim &sim, const std::string &data)>;
+    // Chamado numa thread auxiliar a cada AT+HTTPACTION (pode bloquear, ex.: servidor HTTP local)
+    using http_backend = std::function<sim_http_result(int method, const std::string &url, const std::string &body)>;
+
+    explicit modem_sim(const sim_config &config = sim_config());
+    ~modem_sim();
+
+    sim_config &config() { return config_; }
+
+    // Troca a resposta dos comandos que começam com prefix (vence o prefixo mais longo)
+    void on(const std::string &prefix, handler h);
+    void set_http_backend(http_backend backend);
+
+    // Para handlers: agenda bytes para a UART delay_ms depois do comando atual; tag permite cancelar
+    void reply(const std::string &bytes, uint32_t delay_ms = 0, int tag = 0);
+    void cancel(int tag);
+    // Os próximos n bytes recebidos são dados (prompt '>' / DOWNLOAD / CONNECT) entregues a done
+    void expect_raw(size_t n, raw_handler done);
+    // Agenda um URC independente de comando
+    void urc(const std::string &bytes, uint32_t delay_ms = 0);
+
+    bool powered();
+    uint64_t boot_started_us();
+    std::vector<sim_publish> publishes();
+    std::vector<std::string> commands();
+    size_t command_count(const std::string &prefix);
+    std::string file(const std::string &name);
+    void set_file(const std::string &name, const std::string &data);
+    void set_operators(const std::string &cops_list);
+
+private:
+    struct pending
+    {
+        uint64_t due;
+        uint64_t seq;
+        std::string bytes;
+        int tag;
+    };
+    struct open_file
+    {
+        std::string name;
+        size_t pos;
+    };
+
+    sim_config config_;
+    std::recursive_mutex m_;
+    std::condition_variable_any cv_;
+    std::thread scheduler_;
+    bool quit_ = false;
+    std::vector<pending> queue_;
+    uint64_t seq_ = 0;
+    uint64_t now_us_ = 0; // base das respostas: fim da transmissão do comando atual
+
+    bool powered_ = false;
+    bool echo_ = true;
+    uint64_t boot_at_us_ = 0;
+    uint64_t boot_started_us_ = 0;
+    std::string line_;
+    char last_ = 0;
+    size_t raw_left_ = 0;
+    std::string raw_;
+    raw_handler raw_done_;
+
+    std::vector<std::pair<std::string, handler>> handlers_;
+    http_backend http_backend_;
+    std::vector<sim_publish> publishes_;
+    std::vector<std::string> commands_;
+
+    bool scanning_ = false;
+    std::string operators_;
+    uint32_t radio_seq_ = 0;
+
+    std::map<std::string, std::string> files_;
+    std::map<int, open_file> fds_;
+    int next_fd_ = 1;
+
+    bool http_init_ = false;
+    std::string http_url_;
+    std::string http_body_;
+    sim_http_result http_result_;
+
+    void run_scheduler_();
+    void on_tx_(const uint8_t *data, size_t len, uint64_t due_us);
+    void on_gpio_(int pin, uint32_t level);
+    void command_(const std::string &cmd);
+    void builtin_(const std::string &cmd);
+    void ok_();
+    void error_();
+    void mqtt_publish_(const std::string &cmd);
+    void fs_command_(const std::string &cmd);
+    void http_command_(const std::string &cmd);
+};
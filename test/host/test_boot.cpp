@@ -0,0 +1,44 @@
+// Inicialização guiada pelos URCs do modem (RDY, +CPIN: READY, PB DONE) e pelas respostas da sondagem
+#include "check.h"
+#include "host_modem.h"
+
+HOST_CASE(boot_sequence)
+{
+    sim_config config;
+    config.boot_ms = 800;
+    host_modem host(config);
+    CHECK(host.start());
+
+    const boot_timeline &boot = host.modem.boot_report();
+    CHECK(host.modem.is_ready());
+    CHECK(boot.rdy >= config.boot_ms);
+    CHECK(boot.at_ok >= boot.rdy);
+    CHECK(boot.cfun >= boot.at_ok);
+    CHECK(boot.sim_ready >= boot.rdy);
+    CHECK(boot.init_done >= boot.cfun);
+    CHECK(boot.at_probes >= 1);
+    // cinco comandos de inicialização, cada um logo após o anterior (sem esperas fixas)
+    CHECK(boot.init_done - boot.cfun < 5 * 250);
+    host_exit(0);
+}
+
+HOST_CASE(boot_pb_done_with_ok)
+{
+    sim_config config;
+    config.pb_ms = 60000; // PB DONE só sai junto com a resposta abaixo
+    host_modem host(config);
+    // o OK do AT+CMEE=2 e o PB DONE chegam no mesmo bloco da UART
+    host.sim.on("AT+CMEE=2", [](modem_sim &sim, const std::string &)
+                { sim.reply("\r\nOK\r\n\r\nPB DONE\r\n"); });
+    CHECK(host.start());
+
+    const boot_timeline &boot = host.modem.boot_report();
+    CHECK(boot.pb_done != 0);
+    CHECK(boot.init_done - boot.cfun < BOOT_CMD_TIMEOUT_MS); // o OK não se perdeu no PB DONE
+    host_exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    return host_run_case(argc, argv);
+}
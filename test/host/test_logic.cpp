@@ -0,0 +1,407 @@
+// Lógica pura (hashes, http_request_desc, lista do COPS, leitura de blocos, anel do rádio) contra o modem simulado
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "host_modem.h"
+
+static std::string hex(const uint8_t *data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < len; i++)
+    {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 15];
+    }
+    return out;
+}
+
+static std::string sha256_hex(const std::string &data, size_t chunk)
+{
+    sha256_state sha;
+    sha.init();
+    for (size_t off = 0; off < data.size(); off += chunk)
+        sha.update((const uint8_t *)data.data() + off, data.size() - off < chunk ? data.size() - off : chunk);
+    uint8_t digest[32];
+    sha.final(digest);
+    return hex(digest, sizeof(digest));
+}
+
+// Conteúdo determinístico para arquivos e respostas
+static std::string pattern(size_t len, uint32_t seed = 1)
+{
+    std::string out(len, '\0');
+    for (size_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        out[i] = (char)(seed >> 16);
+    }
+    return out;
+}
+
+HOST_CASE(sha256_vectors)
+{
+    // FIPS 180-2
+    const std::string two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    CHECK_STR(sha256_hex("", 64).c_str(), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK_STR(sha256_hex("abc", 64).c_str(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    CHECK_STR(sha256_hex(two_blocks, 64).c_str(), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    CHECK_STR(sha256_hex(std::string(1000000, 'a'), 4096).c_str(), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    // blocos de tamanho qualquer atravessando a fronteira de 64 bytes dão o mesmo digest
+    for (size_t chunk = 1; chunk <= 65; chunk += 7)
+        CHECK_STR(sha256_hex(two_blocks, chunk).c_str(), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // o estado pode ser copiado no meio (checkpoint) e continuado
+    sha256_state sha;
+    sha.init();
+    sha.update((const uint8_t *)two_blocks.data(), 30);
+    sha256_state saved = sha;
+    saved.update((const uint8_t *)two_blocks.data() + 30, two_blocks.size() - 30);
+    uint8_t digest[32];
+    saved.final(digest);
+    CHECK_STR(hex(digest, 32).c_str(), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+HOST_CASE(hash_stream_vectors)
+{
+    uint8_t digest[32];
+    hash_stream crc;
+    crc.begin(HASH_CRC32);
+    crc.update((const uint8_t *)"1234", 4);
+    crc.update((const uint8_t *)"56789", 5);
+    CHECK_EQ(crc.bytes, 9);
+    CHECK_EQ(crc.finish(digest), 4);
+    CHECK_STR(hex(digest, 4).c_str(), "cbf43926"); // CRC-32/ISO-HDLC de "123456789", em big-endian
+
+    const uint8_t expected_crc[4] = {0xcb, 0xf4, 0x39, 0x26};
+    const uint8_t wrong_crc[4] = {0xcb, 0xf4, 0x39, 0x27};
+    crc.begin(HASH_CRC32);
+    crc.update((const uint8_t *)"123456789", 9);
+    CHECK(crc.verify(expected_crc, sizeof(expected_crc)));
+    crc.begin(HASH_CRC32);
+    crc.update((const uint8_t *)"123456789", 9);
+    CHECK(!crc.verify(wrong_crc, sizeof(wrong_crc)));
+
+    // wrap() repassa cada bloco ao sink seguinte e acumula o hash
+    hash_stream sha;
+    sha.begin(HASH_SHA256);
+    std::string seen;
+    data_sink sink = sha.wrap([&seen](const uint8_t *data, size_t len, size_t offset)
+                              {
+                                  CHECK_EQ(offset, seen.size());
+                                  seen.append((const char *)data, len);
+                                  return true; });
+    CHECK(sink((const uint8_t *)"a", 1, 0));
+    CHECK(sink((const uint8_t *)"bc", 2, 1));
+    CHECK_STR(seen.c_str(), "abc");
+    CHECK_EQ(sha.finish(digest), 32);
+    CHECK_STR(hex(digest, 32).c_str(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+HOST_CASE(http_desc_build)
+{
+    http_request_desc desc;
+    CHECK(desc.build("http://example.com/api?x=1", POST, true, "my_ca.pem", "Authorization: Bearer t", 30, 60, "application/json", "text/*", 1));
+    CHECK(desc.used > 1);
+    CHECK(desc.has_user_data);
+    CHECK_EQ(desc.recv_timeout, 60);
+    CHECK_STR(desc.line_at(HTTP_PARA_URL), "AT+HTTPPARA=\"URL\",\"http://example.com/api?x=1\"\r\n");
+    CHECK_STR(desc.line_at(HTTP_PARA_SSL), "AT+CSSLCFG=\"cacert\",0,\"my_ca.pem\"\r\n");
+    CHECK_STR(desc.line_at(HTTP_PARA_CONNECTTO), "AT+HTTPPARA=\"CONNECTTO\",30\r\n");
+    CHECK_STR(desc.line_at(HTTP_PARA_RECVTO), "AT+HTTPPARA=\"RECVTO\",60\r\n");
+    CHECK_STR(desc.line_at(HTTP_PARA_CONTENT), "AT+HTTPPARA=\"CONTENT\",\"application/json\"\r\n");
+    CHECK_STR(desc.line_at(HTTP_PARA_ACCEPT), "AT+HTTPPARA=\"ACCEPT\",\"text/*\"\r\n");
+    CHECK_STR(desc.line_at(HTTP_PARA_USERDATA), "AT+HTTPPARA=\"USERDATA\",\"Authorization: Bearer t\"\r\n");
+    CHECK_STR(desc.line_at(HTTP_PARA_READMODE), "AT+HTTPPARA=\"READMODE\",1\r\n");
+    CHECK_STR(desc.arena + desc.action, "AT+HTTPACTION=1\r\n");
+
+    // só a linha que mudou troca de hash (é o que a sessão usa para pular HTTPPARA repetidos)
+    http_request_desc other;
+    CHECK(other.build("http://example.com/api?x=2", POST, true, "my_ca.pem", "Authorization: Bearer t", 30, 60, "application/json", "text/*", 1));
+    CHECK(other.hash[HTTP_PARA_URL] != desc.hash[HTTP_PARA_URL]);
+    for (int i = HTTP_PARA_SSL; i < HTTP_PARA_COUNT; i++)
+        CHECK_EQ(other.hash[i], desc.hash[i]);
+
+    CHECK(desc.build("http://example.com/"));
+    CHECK(!desc.has_user_data);
+    CHECK_STR(desc.arena + desc.action, "AT+HTTPACTION=0\r\n");
+
+    // limites: URL, USERDATA e o arena inteiro
+    std::string url = "http://example.com/" + std::string(HTTP_URL_MAX_LEN, 'u');
+    CHECK(!desc.build(url.c_str()));
+    CHECK_EQ(desc.used, 0);
+    url.resize(HTTP_URL_MAX_LEN);
+    CHECK(desc.build(url.c_str()));
+
+    std::string user_data(HTTP_USERDATA_MAX_LEN + 1, 'h');
+    CHECK(!desc.build("http://example.com/", GET, false, "ca.pem", user_data.c_str()));
+    CHECK_EQ(desc.used, 0);
+
+    user_data.resize(HTTP_USERDATA_MAX_LEN);
+    std::string content(HTTP_REQUEST_ARENA_SIZE - HTTP_URL_MAX_LEN - HTTP_USERDATA_MAX_LEN, 'c');
+    CHECK(!desc.build(url.c_str(), GET, false, "ca.pem", user_data.c_str(), 120, 120, content.c_str()));
+    CHECK_EQ(desc.used, 0);
+}
+
+static bool wait_operator_list(A7672SA &modem, operator_list &list, uint32_t timeout)
+{
+    uint32_t start = millis();
+    while (!modem.operator_list_cached(list) && millis() - start < timeout)
+        vTaskDelay(pdMS_TO_TICKS(20));
+    return modem.operator_list_cached(list);
+}
+
+HOST_CASE(operator_list_parse)
+{
+    sim_config config;
+    config.paced = false;
+    host_modem host(config);
+    host.sim.set_operators("(2,\"VIVO\",\"VIVO\",\"72406\",7),(1,\"TIM, BRASIL\",\"TIM\",\"72402\",2),(3,\"\",\"\",\"\",0),"
+                           "(0,\"CLARO BR\",\"CLARO\",\"72405\",0),,(0,1,2,3,4),(0,1,2)");
+    CHECK(host.start());
+
+    CHECK(host.modem.operator_scan_start());
+    operator_list list;
+    CHECK(wait_operator_list(host.modem, list, 3000));
+    CHECK_EQ(list.count, 3); // a entrada sem código numérico é ignorada
+    CHECK(!list.truncated);
+    CHECK_EQ(list.ops[0].status, 2);
+    CHECK_STR(list.ops[0].long_name, "VIVO");
+    CHECK_STR(list.ops[0].numeric_code, "72406");
+    CHECK_EQ(list.ops[0].access_tech, 7);
+    CHECK_STR(list.ops[1].long_name, "TIM, BRASIL"); // vírgula entre aspas não separa campos
+    CHECK_STR(list.ops[1].short_name, "TIM");
+    CHECK_EQ(list.ops[1].access_tech, 2);
+    CHECK_STR(list.ops[2].numeric_code, "72405");
+    CHECK_EQ(list.ops[2].status, 0);
+    host_exit(0);
+}
+
+HOST_CASE(operator_list_truncated)
+{
+    sim_config config;
+    config.paced = false;
+    host_modem host(config);
+    std::string ops;
+    for (int i = 0; i < OPERATOR_LIST_MAX + 2; i++)
+    {
+        char op[64];
+        snprintf(op, sizeof(op), "(1,\"OP%02d\",\"O%02d\",\"724%02d\",7),", i, i, i);
+        ops += op;
+    }
+    host.sim.set_operators(ops + ",(0,1,2,3,4),(0,1,2)");
+    CHECK(host.start());
+
+    CHECK(host.modem.operator_scan_start());
+    operator_list list;
+    CHECK(wait_operator_list(host.modem, list, 3000));
+    CHECK_EQ(list.count, OPERATOR_LIST_MAX);
+    CHECK(list.truncated);
+    CHECK_STR(list.ops[OPERATOR_LIST_MAX - 1].numeric_code, "72411");
+    host_exit(0);
+}
+
+/*
+FSREAD respondido em pedaços: um URC antes do cabeçalho, os dados em três rajadas espaçadas e um URC depois do OK.
+announce (se > 0) substitui o tamanho pedido no AT+FSREAD; send limita quantos bytes realmente saem.
+*/
+struct fragmented_file
+{
+    std::string content;
+    size_t pos = 0;
+    int announce = 0;
+    size_t send = (size_t)-1;
+};
+
+static void fragmented_fsread(host_modem &host, fragmented_file &file)
+{
+    host.sim.on("AT+FSREAD=", [&file](modem_sim &sim, const std::string &cmd)
+                {
+                    unsigned fd = 0, size = 0;
+                    sscanf(cmd.c_str(), "AT+FSREAD=%u,%u", &fd, &size);
+                    if (file.announce > 0)
+                        size = file.announce;
+                    std::string block = file.content.substr(file.pos < file.content.size() ? file.pos : file.content.size(), size);
+                    file.pos += block.size();
+                    char header[48];
+                    snprintf(header, sizeof(header), "\r\nCONNECT %u\r\n", (unsigned)block.size());
+                    if (file.send < block.size())
+                        block.resize(file.send);
+                    size_t third = block.size() / 3;
+                    sim.reply("\r\n+CGEV: ME PDN ACT 1\r\n");
+                    sim.reply(header + block.substr(0, third), 10);
+                    sim.reply(block.substr(third, third), 25);
+                    if (file.send != (size_t)-1)
+                        sim.reply(block.substr(2 * third), 40);
+                    else
+                        sim.reply(block.substr(2 * third) + "\r\nOK\r\n\r\n+CGEV: ME PDN DEACT 2\r\n", 40); });
+}
+
+HOST_CASE(read_framed_fragments)
+{
+    host_modem host;
+    fragmented_file file;
+    file.content = pattern(10000);
+    fragmented_fsread(host, file);
+    host.sim.set_file("data.bin", file.content);
+    CHECK(host.start());
+
+    int fd = host.modem.fs_open_handle("data.bin", 2);
+    CHECK(fd > 0);
+    std::string got;
+    uint8_t buffer[4096];
+    int n;
+    while ((n = host.modem.fs_read_handle(fd, buffer, sizeof(buffer))) > 0)
+        got.append((const char *)buffer, n);
+    CHECK_EQ(n, 0);
+    CHECK(got == file.content);
+    CHECK(host.modem.pdn_state(1).active); // URC antes do cabeçalho foi para o parser
+    CHECK(host.modem.fs_close_handle(fd));
+    CHECK(host.modem.test_at()); // nada ficou para trás na UART
+    host_exit(0);
+}
+
+HOST_CASE(read_framed_eof)
+{
+    sim_config config;
+    config.paced = false;
+    host_modem host(config);
+    host.sim.set_file("a.bin", pattern(100));
+    host.sim.set_file("b.bin", pattern(100, 3));
+    CHECK(host.start());
+
+    // CONNECT 0 + OK no fim do arquivo: o OK é consumido junto, e os comandos seguintes recebem a própria resposta
+    int fd = host.modem.fs_open_handle("a.bin", 2);
+    CHECK(fd > 0);
+    uint8_t buffer[256];
+    CHECK_EQ(host.modem.fs_read_handle(fd, buffer, sizeof(buffer)), 100);
+    CHECK_EQ(host.modem.fs_read_handle(fd, buffer, sizeof(buffer)), 0);
+    CHECK(host.modem.fs_close_handle(fd));
+    int next = host.modem.fs_open_handle("b.bin", 2);
+    CHECK_EQ(next, fd + 1);
+    CHECK(host.modem.fs_close_handle(next));
+    host_exit(0);
+}
+
+HOST_CASE(read_framed_truncated)
+{
+    host_modem host;
+    fragmented_file file;
+    file.content = pattern(300);
+    fragmented_fsread(host, file);
+    CHECK(host.start());
+
+    // o modem manda 300 bytes para um buffer de 100: os 100 primeiros ficam, o resto é consumido
+    uint8_t buffer[300] = {};
+    file.announce = 300;
+    CHECK_EQ(host.modem.fs_read_handle(1, buffer, 100), -3);
+    CHECK(memcmp(buffer, file.content.data(), 100) == 0);
+    for (int i = 100; i < 300; i++)
+        CHECK_EQ(buffer[i], 0);
+    CHECK(host.modem.test_at());
+    host_exit(0);
+}
+
+HOST_CASE(read_framed_short)
+{
+    host_modem host;
+    fragmented_file file;
+    file.content = pattern(300);
+    file.announce = 300;
+    file.send = 150; // o modem anuncia 300 e para no meio
+    fragmented_fsread(host, file);
+    CHECK(host.start());
+
+    uint8_t buffer[300];
+    CHECK_EQ(host.modem.fs_read_handle(1, buffer, sizeof(buffer), 300), -2);
+    CHECK(memcmp(buffer, file.content.data(), 150) == 0);
+    CHECK(host.modem.test_at());
+    host_exit(0);
+}
+
+HOST_CASE(read_framed_http)
+{
+    host_modem host;
+    const std::string body = pattern(5000, 7);
+    // OK, +HTTPREAD: <n>, dados e +HTTPREAD: 0, com o cabeçalho quebrado entre duas rajadas
+    host.sim.on("AT+HTTPREAD=", [&body](modem_sim &sim, const std::string &cmd)
+                {
+                    unsigned offset = 0, size = 0;
+                    sscanf(cmd.c_str(), "AT+HTTPREAD=%u,%u", &offset, &size);
+                    std::string block = body.substr(offset < body.size() ? offset : body.size(), size);
+                    char header[48];
+                    snprintf(header, sizeof(header), "\r\n+HTTPREAD: %u\r\n", (unsigned)block.size());
+                    std::string first = std::string("\r\nOK\r\n") + header;
+                    sim.reply(first.substr(0, 10));
+                    sim.reply(first.substr(10) + block.substr(0, block.size() / 2), 15);
+                    sim.reply(block.substr(block.size() / 2) + "\r\n+HTTPREAD: 0\r\n", 30); });
+    CHECK(host.start());
+
+    std::string got;
+    uint8_t buffer[1024];
+    int n;
+    while ((n = host.modem.http_read_response(buffer, sizeof(buffer), got.size())) > 0)
+        got.append((const char *)buffer, n);
+    CHECK_EQ(n, 0);
+    CHECK(got == body);
+    host_exit(0);
+}
+
+static bool radio_sample_consistent(const radio_sample &s)
+{
+    uint32_t k = s.cell_id;
+    return s.tac == k && s.csq == k % 32 && s.ber == k % 8 && s.rsrq == -(int)(k % 200) && s.rsrp == -(int)(k % 1000) &&
+           s.rssi == -(int)(k % 700) && s.sinr == (int)(k % 30) && s.mcc == 724 && s.mnc == 5 && strcmp(s.system_mode, "LTE") == 0;
+}
+
+HOST_CASE(radio_seqlock)
+{
+    host_modem host;
+    CHECK(host.start());
+
+    // leitores em laço apertado enquanto o chamador publica amostras: nenhuma leitura pode misturar duas amostras
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> reads(0), torn(0), misordered(0);
+    auto reader = [&]()
+    {
+        radio_sample history[RADIO_HISTORY_SIZE];
+        while (!done)
+        {
+            size_t n = host.modem.radio_history(history, RADIO_HISTORY_SIZE);
+            for (size_t i = 0; i < n; i++)
+            {
+                if (!radio_sample_consistent(history[i]))
+                    torn++;
+                if (i > 0 && history[i].cell_id + 1 != history[i - 1].cell_id)
+                    misordered++; // mais nova primeiro, sem buracos
+            }
+            reads++;
+        }
+    };
+    std::thread r1(reader), r2(reader);
+
+    const int samples = RADIO_HISTORY_SIZE * 2 + 5;
+    for (int i = 0; i < samples; i++)
+        CHECK(host.modem.signal_quality(1000) == (i + 1) % 32);
+    done = true;
+    r1.join();
+    r2.join();
+
+    CHECK_EQ(torn.load(), 0);
+    CHECK_EQ(misordered.load(), 0);
+    CHECK(reads.load() > 1000);
+
+    radio_sample history[RADIO_HISTORY_SIZE + 4];
+    CHECK_EQ(host.modem.radio_history(history, RADIO_HISTORY_SIZE + 4), RADIO_HISTORY_SIZE);
+    CHECK_EQ(history[0].cell_id, samples);
+    CHECK_EQ(history[RADIO_HISTORY_SIZE - 1].cell_id, samples - RADIO_HISTORY_SIZE + 1);
+    host_exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    return host_run_case(argc, argv);
+}
@@ -0,0 +1,103 @@
+// Correlação dos +CMQTTPUB com publicações de QoS diferentes intercaladas (QoS 0 confirma na hora, QoS 1/2 só depois do broker)
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "check.h"
+#include "host_modem.h"
+
+static std::mutex completions_lock;
+static std::map<uint16_t, std::pair<bool, uint64_t>> completions; // msg_id -> (delivered, host_micros)
+
+static void on_complete(uint16_t msg_id, bool delivered)
+{
+    std::lock_guard<std::mutex> lock(completions_lock);
+    completions[msg_id] = std::make_pair(delivered, host_micros());
+}
+
+static host_modem *connect_modem(const sim_config &config)
+{
+    host_modem *host = new host_modem(config);
+    CHECK(host->start());
+    host->modem.on_publish_complete(on_complete);
+    CHECK(host->modem.mqtt_connect("broker.local", 1883, "host-test"));
+    return host;
+}
+
+HOST_CASE(interleaved_qos0_qos1)
+{
+    sim_config config;
+    config.paced = false;
+    host_modem *host = connect_modem(config);
+
+    // q1, q0, q2, q1, q0...: sem a espera por QoS o ack imediato do QoS 0 liberaria o slot do QoS 1 antes do PUBACK
+    const int qos_seq[] = {1, 0, 2, 1, 0, 1, 1, 0, 2, 0};
+    const int n = sizeof(qos_seq) / sizeof(qos_seq[0]);
+    std::map<std::string, uint16_t> ids; // payload -> msg_id das publicações QoS 1/2
+    for (int i = 0; i < n; i++)
+    {
+        std::string payload = "p" + std::to_string(i);
+        if (qos_seq[i] == 0)
+        {
+            CHECK(host->modem.mqtt_publish("t/qos0", (uint8_t *)payload.data(), payload.size(), 0, 3000));
+        }
+        else
+        {
+            uint16_t id = host->modem.mqtt_publish_async("t/qos", (const uint8_t *)payload.data(), payload.size(), qos_seq[i], 3000);
+            CHECK(id != 0);
+            ids[payload] = id;
+        }
+    }
+
+    uint32_t start = millis();
+    while (host->modem.mqtt_inflight_count() > 0 && millis() - start < 5000)
+        vTaskDelay(pdMS_TO_TICKS(20));
+    CHECK_EQ(host->modem.mqtt_inflight_count(), 0);
+
+    // Cada publicação confirmada saiu uma vez, e nenhuma conclusão chegou antes do +CMQTTPUB dela
+    std::vector<sim_publish> sent = host->sim.publishes();
+    CHECK_EQ(sent.size(), n);
+    std::lock_guard<std::mutex> lock(completions_lock);
+    CHECK_EQ(completions.size(), ids.size());
+    for (int i = 0; i < n; i++)
+    {
+        CHECK_STR(sent[i].payload.c_str(), ("p" + std::to_string(i)).c_str());
+        CHECK_EQ(sent[i].qos, qos_seq[i]);
+        if (sent[i].qos == 0)
+            continue;
+        auto done = completions.find(ids[sent[i].payload]);
+        CHECK(done != completions.end());
+        CHECK(done->second.first);
+        CHECK(done->second.second >= sent[i].ack_us);
+    }
+    host_exit(0);
+}
+
+HOST_CASE(qos0_waits_for_pending_acks)
+{
+    sim_config config;
+    config.paced = false;
+    config.ack_ms[1] = 500;
+    host_modem *host = connect_modem(config);
+
+    const char payload[] = "first";
+    uint16_t id = host->modem.mqtt_publish_async("t/qos1", (const uint8_t *)payload, sizeof(payload) - 1, 1, 3000);
+    CHECK(id != 0);
+
+    // O QoS 0 espera o PUBACK pendente; com um timeout menor que ele, desiste sem enviar nada
+    CHECK(!host->modem.mqtt_publish("t/qos0", (uint8_t *)"x", 1, 0, 100));
+    CHECK_EQ(host->sim.command_count("AT+CMQTTPUB=0,\"t/qos0\""), 0);
+
+    CHECK(host->modem.mqtt_publish("t/qos0", (uint8_t *)"y", 1, 0, 3000));
+    std::vector<sim_publish> sent = host->sim.publishes();
+    CHECK_EQ(sent.size(), 2);
+    CHECK(host_micros() >= sent[0].ack_us);
+    std::lock_guard<std::mutex> lock(completions_lock);
+    CHECK(completions.count(id) == 1 && completions[id].first);
+    host_exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    return host_run_case(argc, argv);
+}